@@ -202,6 +202,11 @@ N_("preserve-width: whether to preserve linewith with centerline fitting; "	\
 #define  at_doc__width_weight_factor				\
 N_("width-weight-factor <real>: weight factor for fitting the linewidth.")
     gfloat width_weight_factor;
+
+#define at_doc__thread_count						\
+N_("thread-count <unsigned>: number of threads fitting outlines "	\
+"concurrently; default is 1.")
+    unsigned thread_count;
   };
 
   struct _at_input_opts_type {
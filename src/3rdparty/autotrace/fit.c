@@ -44,6 +44,9 @@
 #endif
 #include <string.h>
 #include <assert.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #define SQUARE(x) ((x) * (x))
 #define CUBE(x) ((x) * (x) * (x))
@@ -106,17 +109,40 @@ fitting_opts_type new_fitting_opts(void)
   fitting_opts.centerline = FALSE;
   fitting_opts.preserve_width = FALSE;
   fitting_opts.width_weight_factor = 6.0;
+  fitting_opts.thread_count = 1;
 
   return (fitting_opts);
 }
 
+/* Fitting threads report warnings through a forwarder that keeps
+   calls into the client's message function serialized.  */
+
+typedef struct {
+  at_msg_func client_func;
+  gpointer client_data;
+} msg_forward_type;
+
+static void forward_msg(const gchar * msg, at_msg_type msg_type, gpointer data)
+{
+  msg_forward_type *forward = (msg_forward_type *) data;
+#ifdef _OPENMP
+#pragma omp critical (at_fit_msg)
+#endif
+  forward->client_func(msg, msg_type, forward->client_data);
+}
+
 /* The top-level call that transforms the list of pixels in the outlines
    of the original character to a list of spline lists fitted to those
    pixels.  */
 
 spline_list_array_type fitted_splines(pixel_outline_list_type pixel_outline_list, fitting_opts_type * fitting_opts, at_distance_map * dist, unsigned short width, unsigned short height, at_exception_type * exception, at_progress_func notify_progress, gpointer progress_data, at_testcancel_func test_cancel, gpointer testcancel_data)
 {
-  unsigned this_list;
+  int this_list, list_count;
+  int fitted_count = 0;
+  int threads = fitting_opts->thread_count > 1 ? (int)fitting_opts->thread_count : 1;
+  gboolean stop = FALSE, fatal = FALSE, warned = FALSE;
+  spline_list_type *fitted;
+  msg_forward_type forward;
 
   spline_list_array_type char_splines = new_spline_list_array();
   curve_list_array_type curve_array = split_at_corners(pixel_outline_list,
@@ -135,29 +161,88 @@ spline_list_array_type fitted_splines(pixel_outline_list_type pixel_outline_list
   char_splines.width = width;
   char_splines.height = height;
 
-  for (this_list = 0; this_list < CURVE_LIST_ARRAY_LENGTH(curve_array); this_list++) {
-    spline_list_type curve_list_splines;
+  /* Every curve list is fitted independently, into its own slot of
+     FITTED, so that the lists can be fitted concurrently and still be
+     appended in outline order.  Progress and cancellation are only
+     handled by the first thread.  STOP is shared between the threads,
+     while FATAL and WARNED are reduced at the end of the loop.  */
+  list_count = CURVE_LIST_ARRAY_LENGTH(curve_array);
+  XCALLOC(fitted, (list_count ? list_count : 1) * sizeof(spline_list_type));
+  forward.client_func = exception ? exception->client_func : NULL;
+  forward.client_data = exception ? exception->client_data : NULL;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(threads) if(threads > 1 && !logging) reduction(||:fatal, warned)
+#endif
+  for (this_list = 0; this_list < list_count; this_list++) {
+    at_exception_type list_exception = at_exception_new(forward.client_func ? forward_msg : NULL, &forward);
     curve_list_type curves = CURVE_LIST_ARRAY_ELT(curve_array, this_list);
+    gboolean first_thread = TRUE, stopped;
+    int done;
 
-    if (notify_progress)
-      notify_progress((((gfloat) this_list) / ((gfloat) CURVE_LIST_ARRAY_LENGTH(curve_array) * (gfloat) 3.0) + (gfloat) 0.333), progress_data);
-    if (test_cancel && test_cancel(testcancel_data))
-      goto cleanup;
+#ifdef _OPENMP
+    first_thread = omp_get_thread_num() == 0;
+#endif
+#ifdef _OPENMP
+#pragma omp atomic read
+#endif
+    stopped = stop;
+    if (stopped)
+      continue;
+    if (first_thread) {
+#ifdef _OPENMP
+#pragma omp atomic read
+#endif
+      done = fitted_count;
+      if (notify_progress)
+        notify_progress((((gfloat) done) / ((gfloat) list_count * (gfloat) 3.0) + (gfloat) 0.333), progress_data);
+      if (test_cancel && test_cancel(testcancel_data)) {
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+        stop = TRUE;
+        continue;
+      }
+    }
 
-    LOG("\nFitting curve list #%u:\n", this_list);
+    LOG("\nFitting curve list #%d:\n", this_list);
 
-    curve_list_splines = fit_curve_list(curves, fitting_opts, dist, exception);
-    if (at_exception_got_fatal(exception)) {
-      if (char_splines.background_color)
-        at_color_free(char_splines.background_color);
-      goto cleanup;
-    }
-    curve_list_splines.clockwise = curves.clockwise;
+    fitted[this_list] = fit_curve_list(curves, fitting_opts, dist, &list_exception);
+    fitted[this_list].clockwise = curves.clockwise;
+    memcpy(&(fitted[this_list].color), &(O_LIST_OUTLINE(pixel_outline_list, this_list).color), sizeof(at_color));
+
+    if (at_exception_got_fatal(&list_exception)) {
+      fatal = TRUE;
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+      stop = TRUE;
+    } else if (list_exception.msg_type == AT_MSG_WARNING)
+      warned = TRUE;
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+    fitted_count++;
+  }
 
-    memcpy(&(curve_list_splines.color), &(O_LIST_OUTLINE(pixel_outline_list, this_list).color), sizeof(at_color));
-    append_spline_list(&char_splines, curve_list_splines);
+  if (stop) {
+    /* Fatal error or cancellation: the caller drops the result.  */
+    if (fatal && exception)
+      exception->msg_type = AT_MSG_FATAL;
+    for (this_list = 0; this_list < list_count; this_list++)
+      free_spline_list(fitted[this_list]);
+    if (char_splines.background_color) {
+      at_color_free(char_splines.background_color);
+      char_splines.background_color = NULL;
+    }
+  } else {
+    if (warned && exception)
+      exception->msg_type = AT_MSG_WARNING;
+    for (this_list = 0; this_list < list_count; this_list++)
+      append_spline_list(&char_splines, fitted[this_list]);
   }
-cleanup:
+  free(fitted);
+
   free_curve_list_array(&curve_array, notify_progress, progress_data);
 
   return char_splines;
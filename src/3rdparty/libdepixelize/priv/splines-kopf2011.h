@@ -25,6 +25,11 @@
 #ifndef LIBDEPIXELIZE_TRACER_SPLINES_KOPF2011_H
 #define LIBDEPIXELIZE_TRACER_SPLINES_KOPF2011_H
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include "../splines.h"
 #include "homogeneoussplines.h"
 #include "optimization-kopf2011.h"
@@ -137,17 +142,34 @@ Splines::Splines(const SimplifiedVoronoi<T, adjust_splines> &diagram) :
 
 template<class T>
 Splines::Splines(const HomogeneousSplines<T> &homogeneousSplines,
-                 bool optimize, int /*nthreads*/) :
+                 bool optimize, int nthreads) :
     _paths(homogeneousSplines.size()),
     _width(homogeneousSplines.width()),
     _height(homogeneousSplines.height())
 {
-    // TODO: It should be threaded
-    iterator paths_it = begin();
-    for ( typename HomogeneousSplines<T>::const_iterator
-              it = homogeneousSplines.begin(), end = homogeneousSplines.end()
-              ; it != end ; ++it, ++paths_it ) {
-        worker<T>(*it, *paths_it, optimize);
+    typedef typename HomogeneousSplines<T>::const_iterator polygon_iter;
+
+    polygon_iter polygons = homogeneousSplines.begin();
+    iterator paths = begin();
+    std::size_t size = _paths.size();
+
+    // Every polygon is converted independently of the others, into its own
+    // path, so the threads only have to share the index of the next one.
+    std::atomic<std::size_t> next(0);
+    auto run = [&]() {
+        for ( std::size_t i = next++ ; i < size ; i = next++ )
+            worker<T>(*(polygons + i), *(paths + i), optimize);
+    };
+
+    std::size_t nworkers = std::min<std::size_t>(std::max(nthreads, 1), size);
+    std::vector<std::thread> threads;
+    for ( std::size_t i = 1 ; i < nworkers ; ++i )
+        threads.emplace_back(run);
+    run();
+
+    for ( std::vector<std::thread>::iterator it = threads.begin(),
+              end = threads.end() ; it != end ; ++it ) {
+        it->join();
     }
 }
 
@@ -13,8 +13,11 @@
 #include <giomm.h> // Not <gtkmm.h>! To eventually allow a headless version!
 #include <glibmm/i18n.h>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 
 #include "actions-helper.h"
+#include "display/cairo-utils.h" // Inkscape::Pixbuf
 #include "document-undo.h"
 #include "inkscape-application.h"
 #include "inkscape.h" // Inkscape::Application
@@ -24,23 +27,169 @@
 #include "trace/depixelize/inkscape-depixelize.h"
 #include "trace/potrace/inkscape-potrace.h"
 
+// Reads a whole setting as a number, with std::stoi() or std::stof() which throw on bad input and
+// stop at the first character that is not part of the number. A bad setting is reported.
+template <typename T, typename Parse>
+static bool parse_setting(Glib::ustring const &setting, T &value, Parse parse, char const *name, char const *action)
+{
+    std::size_t end = 0;
+    try {
+        value = parse(setting.raw(), &end);
+    } catch (std::logic_error const &) {
+        end = 0;
+    }
+    if (end == 0 || end != setting.bytes()) {
+        std::cerr << "action:" << action << ": " << name << " '" << setting << "' is not a number" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Helper for the trace actions: a color potrace engine from the seven settings
+// "scans,smooth,stack,removeBackground,speckles,smoothCorners,optimize" starting at settings[first],
+// or nullptr if one of them is not valid.
+std::unique_ptr<Inkscape::Trace::Potrace::PotraceTracingEngine>
+trace_engine_from_settings(std::vector<Glib::ustring> const &settings, int first, char const *action)
+{
+    auto toInt = [](std::string const &str, std::size_t *end) { return std::stoi(str, end); };
+    auto toFloat = [](std::string const &str, std::size_t *end) { return std::stof(str, end); };
+    int scans = 0;
+    int speckles = 0;
+    float smoothCorners = 0;
+    float optimize = 0;
+    if (!parse_setting(settings[first], scans, toInt, "scans", action) ||
+        !parse_setting(settings[first + 4], speckles, toInt, "speckles", action) ||
+        !parse_setting(settings[first + 5], smoothCorners, toFloat, "smoothCorners", action) ||
+        !parse_setting(settings[first + 6], optimize, toFloat, "optimize", action)) {
+        return nullptr;
+    }
+
+    auto smooth = settings[first + 1] == "true";            // Smooth
+    auto stack = settings[first + 2] == "true";             // Stack
+    auto removeBackground = settings[first + 3] == "true";  // Remove background
+    auto pte = std::make_unique<Inkscape::Trace::Potrace::PotraceTracingEngine>(
+        Inkscape::Trace::Potrace::TRACE_QUANT_COLOR, false, 64, 0.45, 0., .65, scans, stack, smooth, removeBackground);
+    pte->potraceParams->opticurve = true;
+    pte->potraceParams->opttolerance = optimize;
+    pte->potraceParams->alphamax = smoothCorners;
+    pte->potraceParams->turdsize = speckles;
+    return pte;
+}
+
 void selection_trace(const Glib::VariantBase &value, InkscapeApplication *app)
 {
     Glib::Variant<Glib::ustring> s = Glib::VariantBase::cast_dynamic<Glib::Variant<Glib::ustring>>(value);
     std::vector<Glib::ustring> settings = Glib::Regex::split_simple(",", s.get());
+    if (settings.size() != 7) {
+        std::cerr << "action:selection_trace: requires 'scans,smooth,stack,removeBackground,speckles,smoothCorners,optimize'" << std::endl;
+        return;
+    }
+
+    auto pte = trace_engine_from_settings(settings, 0, "selection_trace");
+    if (!pte) {
+        return;
+    }
+
+    auto selection = app->get_active_selection();
+    // We should not have to do this!
+    auto document  = app->get_active_document();
+    selection->setDocument(document);
+
+    Inkscape::Trace::Tracer tracer;
+    tracer.trace(pte.get());
+}
+
+// Traces a bitmap file straight to an SVG file, without loading it into a document. An optional
+// last field lists sample image files, separated by spaces, whose colors make the palette: frames
+// of an animation traced with the same samples get the same colors.
+void trace_file(const Glib::VariantBase &value, InkscapeApplication *app)
+{
+    Glib::Variant<Glib::ustring> s = Glib::VariantBase::cast_dynamic<Glib::Variant<Glib::ustring>>(value);
+    std::vector<Glib::ustring> settings = Glib::Regex::split_simple(",", s.get());
+    if (settings.size() != 9 && settings.size() != 10) {
+        std::cerr << "action:trace_file: requires 'input file,output file,scans,smooth,stack,removeBackground,speckles,smoothCorners,optimize[,palette samples]'" << std::endl;
+        return;
+    }
+
+    auto pte = trace_engine_from_settings(settings, 2, "trace_file");
+    if (!pte) {
+        return;
+    }
+
+    if (settings.size() == 10) {
+        std::vector<std::unique_ptr<Inkscape::Pixbuf>> pixbufs;
+        std::vector<Glib::RefPtr<Gdk::Pixbuf>> samples;
+        for (auto const &name : Glib::Regex::split_simple(" +", settings[9])) {
+            if (name.empty()) {
+                continue;
+            }
+            pixbufs.emplace_back(Inkscape::Pixbuf::create_from_file(name));
+            if (!pixbufs.back()) {
+                std::cerr << "action:trace_file: could not read palette sample '" << name << "'" << std::endl;
+                return;
+            }
+            samples.push_back(Glib::wrap(pixbufs.back()->getPixbufRaw(), true));
+        }
+        pte->setSharedPalette(samples);
+    }
+
+    Inkscape::Trace::Tracer tracer;
+    tracer.traceFile(pte.get(), settings[0], settings[1]);
+}
+
+// Traces a bitmap file with several parameter sets, writing one SVG file per set. The sets are
+// "scans smooth stack removeBackground speckles smoothCorners optimize", separated by spaces.
+// Set n is written to the output file name with "-n" inserted before its extension.
+void trace_sweep(const Glib::VariantBase &value, InkscapeApplication *app)
+{
+    Glib::Variant<Glib::ustring> s = Glib::VariantBase::cast_dynamic<Glib::Variant<Glib::ustring>>(value);
+    std::vector<Glib::ustring> tokens = Glib::Regex::split_simple(",", s.get());
+    if (tokens.size() < 3) {
+        std::cerr << "action:trace_sweep: requires 'input file,output file,settings[,settings...]'" << std::endl;
+        return;
+    }
+
+    std::string output = tokens[1];
+    auto dot = output.rfind('.');
+    if (dot == std::string::npos || output.find('/', dot) != std::string::npos) {
+        dot = output.size();
+    }
+
+    std::vector<std::unique_ptr<Inkscape::Trace::Potrace::PotraceTracingEngine>> engines;
+    std::vector<Inkscape::Trace::TracingEngine *> variants;
+    std::vector<std::string> outputs;
+    for (unsigned i = 2; i < tokens.size(); ++i) {
+        std::vector<Glib::ustring> settings;
+        for (auto const &setting : Glib::Regex::split_simple(" +", tokens[i])) {
+            if (!setting.empty()) {
+                settings.push_back(setting);
+            }
+        }
+        if (settings.size() != 7) {
+            std::cerr << "action:trace_sweep: settings '" << tokens[i]
+                      << "' must be 'scans smooth stack removeBackground speckles smoothCorners optimize'" << std::endl;
+            return;
+        }
+        engines.push_back(trace_engine_from_settings(settings, 0, "trace_sweep"));
+        if (!engines.back()) {
+            return;
+        }
+        // Variants may run on other threads than the GUI
+        engines.back()->potraceParams->progress.callback = nullptr;
+        variants.push_back(engines.back().get());
+        outputs.push_back(output.substr(0, dot) + "-" + std::to_string(i - 1) + output.substr(dot));
+    }
+
     Inkscape::Trace::Tracer tracer;
-    auto scans = std::stoi(settings[0]);           // Scans
-    auto smooth = settings[1] == "true";           // Smooth
-    auto stack = settings[2] == "true";            // Stack
-    auto removeBackground = settings[3] == "true"; // Remove background
-    Inkscape::Trace::Potrace::PotraceTracingEngine pte(Inkscape::Trace::Potrace::TRACE_QUANT_COLOR, false, 64, 0.45, 0.,
-                                                       .65, scans, stack, smooth, removeBackground);
-    pte.potraceParams->opticurve = true;
-    pte.potraceParams->opttolerance = std::stof(settings[6]); // Optimize
-    pte.potraceParams->alphamax = std::stof(settings[5]);     // Smooth corners
-    pte.potraceParams->turdsize = std::stoi(settings[4]);     // Speckles
-
-    tracer.trace(&pte);
+    auto nodeCounts = tracer.traceFileVariants(variants, tokens[0], outputs);
+    for (unsigned i = 0; i < nodeCounts.size(); ++i) {
+        std::cout << outputs[i] << ": " << tokens[i + 2] << ": ";
+        if (nodeCounts[i] < 0) {
+            std::cout << "failed" << std::endl;
+        } else {
+            std::cout << nodeCounts[i] << " nodes" << std::endl;
+        }
+    }
 }
 
 // No sanity checking is done... should probably add.
@@ -153,7 +302,9 @@ std::vector<std::vector<Glib::ustring>> raw_data_object = {
     {"app.object-unlink-clones",      N_("Unlink Clones"),         "Object",     N_("Unlink clones and symbols")                          },
     {"app.object-to-path",            N_("Object To Path"),        "Object",     N_("Convert shapes to paths")                            },
     {"app.object-stroke-to-path",     N_("Stroke to Path"),        "Object",     N_("Convert strokes to paths")                           },
-    {"app.object-simplify-path",      N_("Simplify Path"),         "Object",     N_("Simplify paths, reducing node counts")               }
+    {"app.object-simplify-path",      N_("Simplify Path"),         "Object",     N_("Simplify paths, reducing node counts")               },
+    {"app.trace-file",                N_("Trace File"),            "Object",     N_("Trace a bitmap file straight to an SVG file, optionally to the palette of sample files; usage: trace-file:input,output,scans,smooth,stack,removeBackground,speckles,smoothCorners,optimize[,sample sample...];")},
+    {"app.trace-sweep",               N_("Trace Sweep"),           "Object",     N_("Trace a bitmap file with several settings, writing output-1.svg, output-2.svg, ...; usage: trace-sweep:input,output,scans smooth stack removeBackground speckles smoothCorners optimize[,...];")}
     // clang-format on
 };
 
@@ -172,6 +323,8 @@ void add_actions_object(InkscapeApplication *app)
     // clang-format off
     gapp->add_action_with_parameter( "object-set-attribute",     String, sigc::bind<InkscapeApplication*>(sigc::ptr_fun(&object_set_attribute),      app));
     gapp->add_action_with_parameter( "selection-trace",          String, sigc::bind<InkscapeApplication*>(sigc::ptr_fun(&selection_trace),           app));
+    gapp->add_action_with_parameter( "trace-file",               String, sigc::bind<InkscapeApplication*>(sigc::ptr_fun(&trace_file),                app));
+    gapp->add_action_with_parameter( "trace-sweep",              String, sigc::bind<InkscapeApplication*>(sigc::ptr_fun(&trace_sweep),               app));
     gapp->add_action_with_parameter( "object-set-property",      String, sigc::bind<InkscapeApplication*>(sigc::ptr_fun(&object_set_property),       app));
     gapp->add_action(                "object-unlink-clones",             sigc::bind<InkscapeApplication*>(sigc::ptr_fun(&object_unlink_clones),      app));
     gapp->add_action(                "object-to-path",                   sigc::bind<InkscapeApplication*>(sigc::ptr_fun(&object_to_path),            app));
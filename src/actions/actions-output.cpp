@@ -212,10 +212,16 @@ void
 export_do(InkscapeApplication *app)
 {
     SPDocument* document = app->get_active_document();
+    if (!document) {
+        std::cerr << "export_do: No document!" << std::endl;
+        return;
+    }
     std::string filename;
     if (document->getDocumentURI()) {
         filename = document->getDocumentURI();
     }
+    // PNG files may still be written when this returns; the application waits for them before
+    // any later action that may change the document.
     app->file_export()->do_export(document, filename);
 }
 
@@ -13,6 +13,7 @@
 #include <cstring>
 #include <fstream>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <glib.h>
@@ -53,6 +54,29 @@ static void write_escaped_value(std::ostream &os, char const *value) {
     }
 }
 
+static void write_json_string(std::ostream &os, char const *value) {
+    os.put('"');
+    for ( char const *current=value ; *current ; ++current ) {
+        switch (*current) {
+        case '"':
+            os << "\\\"";
+            break;
+        case '\\':
+            os << "\\\\";
+            break;
+        default:
+            if (static_cast<unsigned char>(*current) < 0x20) {
+                char escaped[8];
+                g_snprintf(escaped, sizeof(escaped), "\\u%04x", *current);
+                os << escaped;
+            } else {
+                os.put(*current);
+            }
+        }
+    }
+    os.put('"');
+}
+
 static void write_indent(std::ostream &os, unsigned depth) {
     for ( unsigned i = 0 ; i < depth ; i++ ) {
         os.write("  ", 2);
@@ -63,10 +87,51 @@ static std::ofstream log_stream;
 static bool empty_tag=false;
 typedef std::vector<std::shared_ptr<std::string>> TagStack;
 static TagStack &tag_stack() {
-    static TagStack stack;
+    thread_local TagStack stack;
     return stack;
 }
 
+/* Events may come from several threads: each has its own stack of
+ * open events, and writing to the log is serialized.  The XML log nests
+ * events in the order they are written, so it is only meaningful for one
+ * thread at a time; the Chrome trace format keeps threads apart. */
+static std::recursive_mutex log_mutex;
+
+/* Write events in the Chrome trace event format, which chrome://tracing
+ * and Perfetto can display, instead of XML. */
+static bool chrome_format=false;
+static bool first_chrome_event=true;
+
+static unsigned thread_number() {
+    static unsigned thread_count=0;
+    thread_local unsigned number=++thread_count;
+    return number;
+}
+
+static void write_chrome_event(char phase, Event const *event) {
+    log_stream << ( first_chrome_event ? "\n" : ",\n" );
+    first_chrome_event = false;
+    log_stream << "{\"ph\":\"" << phase << "\",\"ts\":" << g_get_monotonic_time()
+               << ",\"pid\":1,\"tid\":" << thread_number();
+    if (event) {
+        log_stream << ",\"name\":";
+        write_json_string(log_stream, event->name());
+        log_stream << ",\"args\":{";
+        unsigned property_count=event->propertyCount();
+        for ( unsigned i = 0 ; i < property_count ; i++ ) {
+            Event::PropertyPair property=event->property(i);
+            if (i) {
+                log_stream << ",";
+            }
+            write_json_string(log_stream, property.name);
+            log_stream << ":";
+            write_json_string(log_stream, property.value->c_str());
+        }
+        log_stream << "}";
+    }
+    log_stream << "}";
+}
+
 static void do_shutdown() {
     Debug::Logger::shutdown();
 }
@@ -111,6 +176,7 @@ static void set_category_mask(bool * const mask, char const *filter) {
                 { "FINALIZERS", Event::FINALIZERS },
                 { "INTERACTION", Event::INTERACTION },
                 { "CONFIGURATION", Event::CONFIGURATION },
+                { "TRACE", Event::TRACE },
                 { "OTHER", Event::OTHER },
                 { nullptr, Event::OTHER }
             };
@@ -150,7 +216,13 @@ void Logger::init() {
             if (log_stream.is_open()) {
                 char const *log_filter=std::getenv("INKSCAPE_DEBUG_FILTER");
                 set_category_mask(_category_mask, log_filter);
-                log_stream << "<?xml version=\"1.0\"?>\n";
+                char const *log_format=std::getenv("INKSCAPE_DEBUG_FORMAT");
+                chrome_format = log_format && !std::strcmp(log_format, "chrome");
+                if (chrome_format) {
+                    log_stream << "[";
+                } else {
+                    log_stream << "<?xml version=\"1.0\"?>\n";
+                }
                 log_stream.flush();
                 _enabled = true;
                 start<SessionEvent>();
@@ -161,8 +233,17 @@ void Logger::init() {
 }
 
 void Logger::_start(Event const &event) {
+    std::lock_guard<std::recursive_mutex> lock(log_mutex);
     char const *name=event.name();
 
+    if (chrome_format) {
+        write_chrome_event('B', &event);
+        log_stream.flush();
+        tag_stack().push_back(std::make_shared<std::string>(name));
+        event.generateChildEvents();
+        return;
+    }
+
     if (empty_tag) {
         log_stream << ">\n";
     }
@@ -192,7 +273,11 @@ void Logger::_skip() {
 }
 
 void Logger::_finish() {
-    if (tag_stack().back()) {
+    std::lock_guard<std::recursive_mutex> lock(log_mutex);
+    if (tag_stack().back() && chrome_format) {
+        write_chrome_event('E', nullptr);
+        log_stream.flush();
+    } else if (tag_stack().back()) {
         if (empty_tag) {
             log_stream << "/>\n";
         } else {
@@ -212,6 +297,12 @@ void Logger::shutdown() {
         while (!tag_stack().empty()) {
             finish();
         }
+        if (chrome_format) {
+            std::lock_guard<std::recursive_mutex> lock(log_mutex);
+            log_stream << "\n]\n";
+            log_stream.flush();
+            chrome_format = false;
+        }
     }
 }
 
@@ -23,114 +23,11 @@ class Logger {
 public:
     static void init();
 
-    template <typename EventType>
-    inline static void start() {
+    template <typename EventType, typename... Args>
+    inline static void start(Args const &...args) {
         if (_enabled) {
             if (_category_mask[EventType::category()]) {
-                _start(EventType());
-            } else {
-                _skip();
-            }
-        }
-    }
-
-    template <typename EventType, typename A>
-    inline static void start(A const &a) {
-        if (_enabled) {
-            if (_category_mask[EventType::category()]) {
-                _start(EventType(a));
-            } else {
-                _skip();
-            }
-        }
-    }
-
-    template <typename EventType, typename A, typename B>
-    inline static void start(A const &a, B const &b) {
-        if (_enabled) {
-            if (_category_mask[EventType::category()]) {
-                _start(EventType(a, b));
-            } else {
-                _skip();
-            }
-        }
-    }
-
-    template <typename EventType, typename A, typename B, typename C>
-    inline static void start(A const &a, B const &b, C const &c) {
-        if (_enabled) {
-            if (_category_mask[EventType::category()]) {
-                _start(EventType(a, b, c));
-            } else {
-                _skip();
-            }
-        }
-    }
-
-    template <typename EventType, typename A, typename B,
-                                  typename C, typename D>
-    inline static void start(A const &a, B const &b, C const &c, D const &d) {
-        if (_enabled) {
-            if (_category_mask[EventType::category()]) {
-                _start(EventType(a, b, c, d));
-            } else {
-                _skip();
-            }
-        }
-    }
-
-    template <typename EventType, typename A, typename B, typename C,
-                                  typename D, typename E>
-    inline static void start(A const &a, B const &b, C const &c,
-                             D const &d, E const &e)
-    {
-        if (_enabled) {
-            if (_category_mask[EventType::category()]) {
-                _start(EventType(a, b, c, d, e));
-            } else {
-                _skip();
-            }
-        }
-    }
-
-    template <typename EventType, typename A, typename B, typename C,
-                                  typename D, typename E, typename F>
-    inline static void start(A const &a, B const &b, C const &c,
-                             D const &d, E const &e, F const &f)
-    {
-        if (_enabled) {
-            if (_category_mask[EventType::category()]) {
-                _start(EventType(a, b, c, d, e, f));
-            } else {
-                _skip();
-            }
-        }
-    }
-
-    template <typename EventType, typename A, typename B, typename C,
-                                  typename D, typename E, typename F,
-                                  typename G>
-    inline static void start(A const &a, B const &b, C const &c, D const &d,
-                             E const &e, F const &f, G const &g)
-    {
-        if (_enabled) {
-            if (_category_mask[EventType::category()]) {
-                _start(EventType(a, b, c, d, e, f, g));
-            } else {
-                _skip();
-            }
-        }
-    }
-
-    template <typename EventType, typename A, typename B, typename C,
-                                  typename D, typename E, typename F,
-                                  typename G, typename H>
-    inline static void start(A const &a, B const &b, C const &c, D const &d,
-                             E const &e, F const &f, G const &g, H const &h)
-    {
-        if (_enabled) {
-            if (_category_mask[EventType::category()]) {
-                _start(EventType(a, b, c, d, e, f, g, h));
+                _start(EventType(args...));
             } else {
                 _skip();
             }
@@ -143,78 +40,9 @@ public:
         }
     }
 
-    template <typename EventType>
-    inline static void write() {
-        start<EventType>();
-        finish();
-    }
-
-    template <typename EventType, typename A>
-    inline static void write(A const &a) {
-        start<EventType, A>(a);
-        finish();
-    }
-
-    template <typename EventType, typename A, typename B>
-    inline static void write(A const &a, B const &b) {
-        start<EventType, A, B>(a, b);
-        finish();
-    }
-
-    template <typename EventType, typename A, typename B, typename C>
-    inline static void write(A const &a, B const &b, C const &c) {
-        start<EventType, A, B, C>(a, b, c);
-        finish();
-    }
-
-    template <typename EventType, typename A, typename B,
-                                  typename C, typename D>
-    inline static void write(A const &a, B const &b, C const &c, D const &d) {
-        start<EventType, A, B, C, D>(a, b, c, d);
-        finish();
-    }
-
-    template <typename EventType, typename A, typename B,
-                                  typename C, typename D,
-                                  typename E>
-    inline static void write(A const &a, B const &b, C const &c,
-                             D const &d, E const &e)
-    {
-        start<EventType, A, B, C, D, E>(a, b, c, d, e);
-        finish();
-    }
-
-    template <typename EventType, typename A, typename B,
-                                  typename C, typename D,
-                                  typename E, typename F>
-    inline static void write(A const &a, B const &b, C const &c,
-                             D const &d, E const &e, F const &f)
-    {
-        start<EventType, A, B, C, D, E, F>(a, b, c, d, e, f);
-        finish();
-    }
-
-    template <typename EventType, typename A, typename B,
-                                  typename C, typename D,
-                                  typename E, typename F,
-                                  typename G>
-    inline static void write(A const &a, B const &b, C const &c,
-                             D const &d, E const &e, F const &f,
-                             G const &g)
-    {
-        start<EventType, A, B, C, D, E, F, G>(a, b, c, d, e, f, g);
-        finish();
-    }
-
-    template <typename EventType, typename A, typename B,
-                                  typename C, typename D,
-                                  typename E, typename F,
-                                  typename G, typename H>
-    inline static void write(A const &a, B const &b, C const &c,
-                             D const &d, E const &e, F const &f,
-                             G const &g, H const &h)
-    {
-        start<EventType, A, B, C, D, E, F, G, H>(a, b, c, d, e, f, g, h);
+    template <typename EventType, typename... Args>
+    inline static void write(Args const &...args) {
+        start<EventType>(args...);
         finish();
     }
 
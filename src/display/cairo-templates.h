@@ -21,7 +21,6 @@
 
 #ifdef HAVE_OPENMP
 #include <omp.h>
-#include "preferences.h"
 // single-threaded operation if the number of pixels is below this threshold
 static const int OPENMP_THRESHOLD = 2048;
 #endif
@@ -76,8 +75,7 @@ void ink_cairo_surface_blend(cairo_surface_t *in1, cairo_surface_t *in2, cairo_s
     // OpenMP probably doesn't help much here.
     // It would be better to render more than 1 tile at a time.
     #if HAVE_OPENMP
-    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
-    int numOfThreads = prefs->getIntLimited("/options/threading/numthreads", omp_get_num_procs(), 1, 256);
+    int numOfThreads = ink_cairo_num_threads();
     if (numOfThreads){} // inform compiler we are using it.
     #endif
 
@@ -204,8 +202,7 @@ void ink_cairo_surface_filter(cairo_surface_t *in, cairo_surface_t *out, Filter
     guint32 *const out_data = reinterpret_cast<guint32*>(cairo_image_surface_get_data(out));
 
     #if HAVE_OPENMP
-    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
-    int numOfThreads = prefs->getIntLimited("/options/threading/numthreads", omp_get_num_procs(), 1, 256);
+    int numOfThreads = ink_cairo_num_threads();
     if (numOfThreads){} // inform compiler we are using it.
     #endif
 
@@ -353,8 +350,7 @@ void ink_cairo_surface_synthesize(cairo_surface_t *out, cairo_rectangle_t const
 
     #if HAVE_OPENMP
     int limit = w * h;
-    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
-    int numOfThreads = prefs->getIntLimited("/options/threading/numthreads", omp_get_num_procs(), 1, 256);
+    int numOfThreads = ink_cairo_num_threads();
     if (numOfThreads){} // inform compiler we are using it.
     #endif
 
@@ -1292,6 +1292,26 @@ static guint32 linear_to_srgb( const guint32 c, const guint32 a ) {
     return premul_alpha( c2, a );
 }
 
+/**
+ * Number of threads for the pixel loops of filters and surface operations.
+ *
+ * Inside a parallel region, such as the tiles of Drawing::renderTiled(), nested loops
+ * run on one thread anyway, so the preferences are left alone: they are not safe to
+ * read from several threads.
+ */
+int ink_cairo_num_threads()
+{
+#if HAVE_OPENMP
+    if (omp_in_parallel()) {
+        return 1;
+    }
+    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+    return prefs->getIntLimited("/options/threading/numthreads", omp_get_num_procs(), 1, 256);
+#else
+    return 1;
+#endif // HAVE_OPENMP
+}
+
 struct SurfaceSrgbToLinear {
 
     guint32 operator()(guint32 in) {
@@ -1656,10 +1676,32 @@ convert_pixels_pixbuf_to_argb32(guchar *data, int w, int h, int stride)
     }
 }
 
+/**
+ * Reciprocals of the alpha values, scaled by 2^32 and rounded up.  For
+ * the numerators of unpremultiplication, which are below 2^16,
+ * (n * reciprocal[a]) >> 32 is exactly n / a.  reciprocal[0] is 0, which
+ * turns fully transparent pixels into 0 like pixbuf_from_argb32() does.
+ */
+static guint64 const *unpremul_reciprocals()
+{
+    static guint64 const *table = []() {
+        static guint64 reciprocal[256];
+        reciprocal[0] = 0;
+        for (guint64 a = 1; a < 256; ++a) {
+            reciprocal[a] = ((G_GUINT64_CONSTANT(1) << 32) + a - 1) / a;
+        }
+        return reciprocal;
+    }();
+    return table;
+}
+
 /**
  * Convert pixel data from ARGB to GdkPixbuf format.
  * This will convert pixel data from GdkPixbuf format to Cairo's native pixel format.
  * This involves premultiplying alpha and shuffling around the channels.
+ * The result is the same as pixbuf_from_argb32() on every pixel, but the
+ * divisions are replaced by multiplications and the loop has no branches,
+ * so that it can be vectorized.
  */
 void
 convert_pixels_argb32_to_pixbuf(guchar *data, int w, int h, int stride)
@@ -1667,11 +1709,22 @@ convert_pixels_argb32_to_pixbuf(guchar *data, int w, int h, int stride)
     if (!data || w < 1 || h < 1 || stride < 1) {
         return;
     }
-    for (size_t i = 0; i < h; ++i) {
+    guint64 const *reciprocal = unpremul_reciprocals();
+    for (int i = 0; i < h; ++i) {
         guint32 *px = reinterpret_cast<guint32*>(data + i*stride);
-        for (size_t j = 0; j < w; ++j) {
-            *px = pixbuf_from_argb32(*px);
-            ++px;
+        for (int j = 0; j < w; ++j) {
+            guint32 c = px[j];
+            guint32 a = c >> 24;
+            guint64 m = reciprocal[a];
+            // unpremultiply; adding a/2 gives correct rounding
+            guint32 r = ((((c >> 16) & 0xff) * 255 + a/2) * m) >> 32;
+            guint32 g = ((((c >> 8) & 0xff) * 255 + a/2) * m) >> 32;
+            guint32 b = (((c & 0xff) * 255 + a/2) * m) >> 32;
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+            px[j] = (r) | (g << 8) | (b << 16) | (a << 24);
+#else
+            px[j] = (r << 24) | (g << 16) | (b << 8) | (a);
+#endif
         }
     }
 }
@@ -87,6 +87,7 @@ public:
     void newPath() { cairo_new_path(_ct); }
     void newSubpath() { cairo_new_sub_path(_ct); }
     void path(Geom::PathVector const &pv);
+    void path(cairo_path_t const *path) { cairo_append_path(_ct, path); }
 
     void paint(double alpha = 1.0);
     void fill() { cairo_fill(_ct); }
@@ -119,6 +119,16 @@ DrawingGroup::_renderItem(DrawingContext &dc, Geom::IntRect const &area, unsigne
     return RENDER_OK;
 }
 
+bool
+DrawingGroup::_prepareItem(DrawingContext & /*dc*/)
+{
+    // propagate antialias setting, as _renderItem() does
+    for (auto &i : _children) {
+        i.setAntialiasing(_antialias);
+    }
+    return true;
+}
+
 void
 DrawingGroup::_clipItem(DrawingContext &dc, Geom::IntRect const &area)
 {
@@ -35,6 +35,7 @@ protected:
     unsigned _renderItem(DrawingContext &dc, Geom::IntRect const &area, unsigned flags,
                                  DrawingItem *stop_at) override;
     void _clipItem(DrawingContext &dc, Geom::IntRect const &area) override;
+    bool _prepareItem(DrawingContext &dc) override;
     DrawingItem *_pickItem(Geom::Point const &p, double delta, unsigned flags) override;
     bool _canClip() override;
 
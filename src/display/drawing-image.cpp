@@ -93,12 +93,22 @@ DrawingImage::_updateItem(Geom::IntRect const &, UpdateContext const &, unsigned
     return STATE_ALL;
 }
 
+bool DrawingImage::_prepareItem(DrawingContext & /*dc*/)
+{
+    // converts the pixels to Cairo's format on first use
+    if (_pixbuf) {
+        _pixbuf->getSurfaceRaw();
+    }
+    return true;
+}
+
 unsigned DrawingImage::_renderItem(DrawingContext &dc, Geom::IntRect const &/*area*/, unsigned /*flags*/, DrawingItem * /*stop_at*/)
 {
     bool outline = _drawing.outline();
 
-    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
-    bool imgoutline = prefs->getBool("/options/rendering/imageinoutlinemode", false);
+    // Only outline mode needs the preference, and it is never rendered concurrently
+    Inkscape::Preferences *prefs = outline ? Inkscape::Preferences::get() : nullptr;
+    bool imgoutline = outline && prefs->getBool("/options/rendering/imageinoutlinemode", false);
 
     if (!outline || imgoutline) {
         if (!_pixbuf) return RENDER_OK;
@@ -40,6 +40,7 @@ protected:
                                  unsigned flags, unsigned reset) override;
     unsigned _renderItem(DrawingContext &dc, Geom::IntRect const &area, unsigned flags,
                                  DrawingItem *stop_at) override;
+    bool _prepareItem(DrawingContext &dc) override;
     DrawingItem *_pickItem(Geom::Point const &p, double delta, unsigned flags) override;
 
     Inkscape::Pixbuf *_pixbuf;
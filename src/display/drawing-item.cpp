@@ -669,6 +669,8 @@ DrawingItem::render(DrawingContext &dc, Geom::IntRect const &area, unsigned flag
 {
     bool outline = _drawing.outline();
     bool render_filters = _drawing.renderFilters();
+    // several threads may be rendering this item; leave the cache state alone
+    bool concurrent = _drawing.renderingConcurrently();
     // stop_at is handled in DrawingGroup, but this check is required to handle the case
     // where a filtered item with background-accessing filter has enable-background: new
     if (this == stop_at) {
@@ -705,12 +707,14 @@ DrawingItem::render(DrawingContext &dc, Geom::IntRect const &area, unsigned flag
     Geom::OptIntRect iarea = carea;
     // expand carea to contain the dependent area of filters.
     if (_filter && render_filters) {
-        iarea = _cacheRect();
+        iarea = concurrent ? Geom::OptIntRect() : _cacheRect();
         if (!iarea) {
             iarea = carea;
             _filter->area_enlarge(*iarea, this);
             iarea.intersectWith(_drawbox);
-            setCached(false, true);
+            if (!concurrent) {
+                setCached(false, true);
+            }
         } else {
             setCached(true, true);
         }
@@ -767,10 +771,12 @@ DrawingItem::render(DrawingContext &dc, Geom::IntRect const &area, unsigned flag
     nir |= (_mix_blend_mode != SP_CSS_BLEND_NORMAL); // 5. it has blend mode           
     nir |= (_isolation == SP_CSS_ISOLATION_ISOLATE); // 6. it is isolated    
     nir |= !parent();                                // 7. is root, need isolation from background
-    if (_prev_nir && !needs_intermediate_rendering) {
-        setCached(false, true);
+    if (!concurrent) {
+        if (_prev_nir && !needs_intermediate_rendering) {
+            setCached(false, true);
+        }
+        _prev_nir = needs_intermediate_rendering;
     }
-    _prev_nir = needs_intermediate_rendering;
     nir |= (_cache != nullptr);                      // 5. it is to be cached
 
     /* How the rendering is done.
@@ -905,6 +911,51 @@ DrawingItem::render(DrawingContext &dc, Geom::IntRect const &area, unsigned flag
     return render_result;
 }
 
+/**
+ * Get this item and its descendants ready to be rendered from several threads at once.
+ *
+ * Rendering creates some state lazily: paint server patterns (which may render a
+ * DrawingPattern), image surfaces in the right pixel format and the antialiasing of
+ * clips and masks.  This creates all of it up front.  Items must not be cached, see
+ * Drawing::beginConcurrentRender().
+ *
+ * @param dc Scratch context; only its tolerance is used by paint servers.
+ * @return false if something in the tree cannot be rendered concurrently.
+ */
+bool
+DrawingItem::prepareConcurrentRender(DrawingContext &dc)
+{
+    if (!_visible) {
+        return true;
+    }
+
+    if (_filter && _drawing.renderFilters() && !_filter->prepare_concurrent_render()) {
+        return false;
+    }
+    if (_clip) {
+        _clip->setAntialiasing(_antialias); // propagate antialias setting, as render() does
+        if (!_clip->prepareConcurrentRender(dc)) {
+            return false;
+        }
+    }
+    if (_mask) {
+        _mask->setAntialiasing(_antialias);
+        if (!_mask->prepareConcurrentRender(dc)) {
+            return false;
+        }
+    }
+
+    if (!_prepareItem(dc)) {
+        return false;
+    }
+    for (auto &i : _children) {
+        if (!i.prepareConcurrentRender(dc)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void
 DrawingItem::_renderOutline(DrawingContext &dc, Geom::IntRect const &area, unsigned flags)
 {
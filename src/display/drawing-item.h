@@ -139,6 +139,7 @@ public:
 
     void update(Geom::IntRect const &area = Geom::IntRect::infinite(), UpdateContext const &ctx = UpdateContext(), unsigned flags = STATE_ALL, unsigned reset = 0);
     unsigned render(DrawingContext &dc, Geom::IntRect const &area, unsigned flags = 0, DrawingItem *stop_at = nullptr);
+    bool prepareConcurrentRender(DrawingContext &dc);
     void clip(DrawingContext &dc, Geom::IntRect const &area);
     DrawingItem *pick(Geom::Point const &p, double delta, unsigned flags = 0);
 
@@ -170,6 +171,7 @@ protected:
     virtual unsigned _renderItem(DrawingContext &/*dc*/, Geom::IntRect const &/*area*/, unsigned /*flags*/,
                                  DrawingItem * /*stop_at*/) { return RENDER_OK; }
     virtual void _clipItem(DrawingContext &/*dc*/, Geom::IntRect const &/*area*/) {}
+    virtual bool _prepareItem(DrawingContext &/*dc*/) { return true; }
     virtual DrawingItem *_pickItem(Geom::Point const &/*p*/, double /*delta*/, unsigned /*flags*/) { return nullptr; }
     virtual bool _canClip() { return false; }
 
@@ -303,6 +303,17 @@ DrawingShape::_renderItem(DrawingContext &dc, Geom::IntRect const &area, unsigne
     return RENDER_OK;
 }
 
+bool DrawingShape::_prepareItem(DrawingContext &dc)
+{
+    if (!_curve || !_style) return true;
+
+    Inkscape::DrawingContext::Save save(dc);
+    dc.transform(_ctm);
+    _nrstyle.prepareFill(dc, _item_bbox, _fill_pattern);
+    _nrstyle.prepareStroke(dc, _item_bbox, _stroke_pattern);
+    return true;
+}
+
 void DrawingShape::_clipItem(DrawingContext &dc, Geom::IntRect const & /*area*/)
 {
     if (!_curve) return;
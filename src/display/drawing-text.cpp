@@ -31,6 +31,8 @@ DrawingGlyphs::DrawingGlyphs(Drawing &drawing)
     : DrawingItem(drawing)
     , _font(nullptr)
     , _glyph(0)
+    , _pathvec(nullptr)
+    , _cairo_path(nullptr)
 {}
 
 DrawingGlyphs::~DrawingGlyphs()
@@ -101,7 +103,7 @@ unsigned DrawingGlyphs::_updateItem(Geom::IntRect const &/*area*/, UpdateContext
 
     Geom::Rect b;
     if (_drawable) {
-        Geom::OptRect tiltb = bounds_exact(*_font->PathVector(_glyph));
+        Geom::OptRect tiltb = _font->BBox(_glyph);
         if (tiltb) {
             Geom::Rect bigbox(Geom::Point(tiltb->left(),-_dsc*scale_bigbox*1.1),Geom::Point(tiltb->right(),_asc*scale_bigbox*1.1));
             b = bigbox * ctx.ctm;
@@ -123,7 +125,7 @@ unsigned DrawingGlyphs::_updateItem(Geom::IntRect const &/*area*/, UpdateContext
 
     Geom::OptRect pb;
     if (_drawable) {
-        Geom::PathVector *glyphv = _font->PathVector(_glyph);
+        Geom::PathVector const *glyphv = _pathvec;
         if (glyphv && !glyphv->empty()) {
             pb = bounds_exact_transformed(*glyphv, ctx.ctm);
         }
@@ -241,8 +243,9 @@ DrawingText::addComponent(font_instance *font, int glyph, Geom::Affine const &tr
     _markForRendering();
     DrawingGlyphs *ng = new DrawingGlyphs(_drawing);
     ng->setGlyph(font, glyph, trans);
-    if(font->PathVector(glyph)){ ng->_drawable = true;  }
-    else {                       ng->_drawable = false; }
+    ng->_pathvec = font->PathVector(glyph);
+    ng->_cairo_path = font->CairoPath(glyph);
+    ng->_drawable = ng->_pathvec != nullptr;
     ng->_width  = width;   // used especially when _drawable = false, otherwise, it is the advance of the font
     ng->_asc    = ascent;  // of font, not of this one character
     ng->_dsc    = descent; // of font, not of this one character
@@ -473,7 +476,7 @@ unsigned DrawingText::_renderItem(DrawingContext &dc, Geom::IntRect const &/*are
             if (g->_ctm.isSingular()) continue;
             dc.transform(g->_ctm);
             if(g->_drawable){
-                dc.path(*g->_font->PathVector(g->_glyph));
+                dc.path(g->_cairo_path);
                 dc.fill();
             }
         }
@@ -625,10 +628,10 @@ unsigned DrawingText::_renderItem(DrawingContext &dc, Geom::IntRect const &/*are
                             dc.paint(1);
                         }
                     } else {
-                        dc.path(*g->_font->PathVector(g->_glyph));
+                        dc.path(g->_cairo_path);
                     }
                 } else {
-                    dc.path(*g->_font->PathVector(g->_glyph));
+                    dc.path(g->_cairo_path);
                 }
             }
         }
@@ -710,6 +713,31 @@ unsigned DrawingText::_renderItem(DrawingContext &dc, Geom::IntRect const &/*are
     return RENDER_OK;
 }
 
+bool DrawingText::_prepareItem(DrawingContext &dc)
+{
+    {
+        Inkscape::DrawingContext::Save save(dc);
+        dc.transform(_ctm);
+        _nrstyle.prepareFill(dc, _item_bbox, _fill_pattern);
+        _nrstyle.prepareStroke(dc, _item_bbox, _stroke_pattern);
+        if (_nrstyle.text_decoration_line != NRStyle::TEXT_DECORATION_LINE_CLEAR) {
+            _nrstyle.prepareTextDecorationFill(dc, _item_bbox, _fill_pattern);
+            _nrstyle.prepareTextDecorationStroke(dc, _item_bbox, _stroke_pattern);
+        }
+    }
+
+    // SVG glyphs are rendered to a pixbuf on first use
+    for (auto & i : _children) {
+        DrawingGlyphs *g = dynamic_cast<DrawingGlyphs *>(&i);
+        if (g && g->_drawable && g->_font->FontHasSVG()) {
+            if (Inkscape::Pixbuf *pixbuf = g->_font->PixBuf(g->_glyph)) {
+                pixbuf->getSurfaceRaw();
+            }
+        }
+    }
+    return true;
+}
+
 void DrawingText::_clipItem(DrawingContext &dc, Geom::IntRect const &/*area*/)
 {
     Inkscape::DrawingContext::Save save(dc);
@@ -732,7 +760,7 @@ void DrawingText::_clipItem(DrawingContext &dc, Geom::IntRect const &/*area*/)
         Inkscape::DrawingContext::Save save(dc);
         dc.transform(g->_ctm);
         if(g->_drawable){
-            dc.path(*g->_font->PathVector(g->_glyph));
+            dc.path(g->_cairo_path);
         }
     }
     dc.fill();
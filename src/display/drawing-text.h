@@ -39,6 +39,8 @@ public:
 
     font_instance *_font;
     int            _glyph;
+    Geom::PathVector const *_pathvec; // owned by _font; kept so that rendering does not look it up
+    cairo_path_t const *_cairo_path;  // owned by _font and shared by all its uses of the glyph
     bool           _drawable;
     float          _width;          // These three are used to set up bounding box
     float          _asc;            //
@@ -68,6 +70,7 @@ protected:
     unsigned _renderItem(DrawingContext &dc, Geom::IntRect const &area, unsigned flags,
                                  DrawingItem *stop_at) override;
     void _clipItem(DrawingContext &dc, Geom::IntRect const &area) override;
+    bool _prepareItem(DrawingContext &dc) override;
     DrawingItem *_pickItem(Geom::Point const &p, double delta, unsigned flags) override;
     bool _canClip() override;
 
@@ -11,10 +11,24 @@
  * Released under GNU GPL v2+, read the file 'COPYING' for more information.
  */
 
+#ifdef HAVE_CONFIG_H
+# include "config.h"  // only include where actually required!
+#endif
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#if HAVE_OPENMP
+#include <omp.h>
+#endif // HAVE_OPENMP
+
 #include "display/drawing.h"
+#include "display/drawing-surface.h"
 #include "display/control/canvas-item-drawing.h"
 #include "nr-filter-gaussian.h"
 #include "nr-filter-types.h"
+#include "preferences.h"
 
 //grayscale colormode:
 #include "cairo-templates.h"
@@ -178,12 +192,145 @@ Drawing::render(DrawingContext &dc, Geom::IntRect const &area, unsigned flags, i
 {
     if (_root) {
         int prev_a = _root->_antialias;
-        if(antialiasing >= 0)
+        // when rendering concurrently, beginConcurrentRender() has set it
+        if (antialiasing >= 0 && !_render_concurrently)
             _root->setAntialiasing(antialiasing);
         _root->render(dc, area, flags);
-        _root->setAntialiasing(prev_a);
+        if (!_render_concurrently)
+            _root->setAntialiasing(prev_a);
+    }
+
+    _renderGrayscale(dc);
+}
+
+/**
+ * Render an area in tiles on several threads, each tile to its own surface, and
+ * composite the tiles onto the context in order.  The result is the same as render().
+ *
+ * Meant for offscreen drawings such as exports, see beginConcurrentRender().  When
+ * the drawing cannot be rendered concurrently, or the area fits in one tile, this
+ * is just render().
+ */
+void
+Drawing::renderTiled(DrawingContext &dc, Geom::IntRect const &area, unsigned flags, int antialiasing)
+{
+    static int const tile_size = 256;
+
+#if HAVE_OPENMP
+    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+    int const num_threads = prefs->getIntLimited("/options/threading/numthreads", omp_get_num_procs(), 1, 256);
+#else
+    int const num_threads = 1;
+#endif // HAVE_OPENMP
+
+    std::vector<Geom::IntRect> tiles;
+    for (int y = area.top(); y < area.bottom(); y += tile_size) {
+        for (int x = area.left(); x < area.right(); x += tile_size) {
+            tiles.emplace_back(x, y, std::min(x + tile_size, area.right()), std::min(y + tile_size, area.bottom()));
+        }
+    }
+
+    // Tiles are composited with OVER, which is only what the root would do with normal blending
+    if (!_root || num_threads < 2 || tiles.size() < 2 || _root->_mix_blend_mode != SP_CSS_BLEND_NORMAL ||
+        !beginConcurrentRender(antialiasing)) {
+        render(dc, area, flags, antialiasing);
+        return;
+    }
+
+    int const device_scale = dc.surface()->device_scale();
+    int const num_tiles = tiles.size();
+    // A few tiles per thread at a time, so that memory use does not grow with the area
+    int const batch = 2 * num_threads;
+    std::vector<std::unique_ptr<DrawingSurface>> surfaces(batch);
+
+    Inkscape::DrawingContext::Save save(dc);
+    for (int start = 0; start < num_tiles; start += batch) {
+        int const end = std::min(start + batch, num_tiles);
+
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+#endif // HAVE_OPENMP
+        for (int i = start; i < end; i++) {
+            auto surface = std::make_unique<DrawingSurface>(tiles[i], device_scale);
+            DrawingContext tdc(*surface);
+            _root->render(tdc, tiles[i], flags);
+            surfaces[i - start] = std::move(surface);
+        }
+
+        for (int i = start; i < end; i++) {
+            dc.rectangle(tiles[i]);
+            dc.setSource(surfaces[i - start].get());
+            dc.setOperator(CAIRO_OPERATOR_OVER);
+            dc.fill();
+            surfaces[i - start].reset();
+        }
+    }
+    dc.setSource(0, 0, 0, 0); // drop the reference to the last tile
+
+    endConcurrentRender();
+    _renderGrayscale(dc);
+}
+
+/**
+ * Get the drawing ready for render() calls from several threads at once, each with its
+ * own DrawingContext, until endConcurrentRender().  The drawing must not be updated or
+ * changed in the meantime.
+ *
+ * Rendering normally updates the cache and creates patterns, image surfaces and filter
+ * state on first use, none of which is thread-safe.  So caching is turned off and the
+ * rest is created up front.
+ *
+ * @param antialiasing Root antialiasing for all the renders, or -1 to keep it.
+ * @return false if the drawing cannot be rendered concurrently, in which case
+ *         render() must be called from one thread at a time as usual.
+ */
+bool
+Drawing::beginConcurrentRender(int antialiasing)
+{
+    // Canvas drawings have caches and signal handlers of their own
+    if (!_root || _canvas_item_drawing || _render_concurrently || outline()) {
+        return false;
+    }
+
+    // setCached() modifies _cached_items
+    std::set<DrawingItem *> cached = _cached_items;
+    for (auto item : cached) {
+        item->setCached(false, true);
+    }
+
+    _prev_antialias = _root->_antialias;
+    if (antialiasing >= 0) {
+        _root->setAntialiasing(antialiasing);
     }
 
+    // Filter::render() would set these
+    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+    setFilterQuality(prefs->getInt("/options/filterquality/value", 0));
+    setBlurQuality(prefs->getInt("/options/blurquality/value", 0));
+
+    DrawingSurface scratch(Geom::IntRect::from_xywh(0, 0, 1, 1));
+    DrawingContext scratch_dc(scratch);
+    if (!_root->prepareConcurrentRender(scratch_dc)) {
+        _root->setAntialiasing(_prev_antialias);
+        return false;
+    }
+
+    _render_concurrently = true;
+    return true;
+}
+
+void
+Drawing::endConcurrentRender()
+{
+    if (_render_concurrently) {
+        _render_concurrently = false;
+        _root->setAntialiasing(_prev_antialias);
+    }
+}
+
+void
+Drawing::_renderGrayscale(DrawingContext &dc)
+{
     if (colorMode() == ColorMode::GRAYSCALE) {
         // apply grayscale filter on top of everything
         cairo_surface_t *input = dc.rawTarget();
@@ -78,6 +78,10 @@ public:
                 unsigned reset = 0);
 
     void render(DrawingContext &dc, Geom::IntRect const &area, unsigned flags = 0, int antialiasing = -1);
+    void renderTiled(DrawingContext &dc, Geom::IntRect const &area, unsigned flags = 0, int antialiasing = -1);
+    bool beginConcurrentRender(int antialiasing = -1);
+    void endConcurrentRender();
+    bool renderingConcurrently() const { return _render_concurrently; }
     DrawingItem *pick(Geom::Point const &p, double delta, unsigned flags);
 
     void average_color(Geom::IntRect const &area, double &R, double &G, double &B, double &A);
@@ -88,6 +92,7 @@ public:
 
 private:
     void _pickItemsForCaching();
+    void _renderGrayscale(DrawingContext &dc);
 
     typedef std::list<CacheRecord> CandidateList;
     bool _outline_sensitive = false;
@@ -102,6 +107,8 @@ public:
 
 private:
     bool _exact = false;  // if true then rendering must be exact
+    bool _render_concurrently = false; // between beginConcurrentRender() and endConcurrentRender()
+    unsigned _prev_antialias = 0;      // root antialiasing to restore in endConcurrentRender()
     RenderMode _rendermode = RenderMode::NORMAL;
     ColorMode _colormode = ColorMode::NORMAL;
     int _blur_quality = BLUR_QUALITY_BEST;
@@ -608,12 +608,7 @@ void FilterGaussian::render_cairo(FilterSlot &slot)
             bytes_per_pixel = 4; break;
     }
 
-#if HAVE_OPENMP
-    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
-    int threads = prefs->getIntLimited("/options/threading/numthreads", omp_get_num_procs(), 1, 256);
-#else
-    int threads = 1;
-#endif
+    int threads = ink_cairo_num_threads();
 
     int quality = slot.get_blurquality();
     int x_step = 1 << _effect_subsample_step_log2(deviation_x_orig, quality);
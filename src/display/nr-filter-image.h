@@ -33,6 +33,8 @@ public:
     void render_cairo(FilterSlot &slot) override;
     bool can_handle_affine(Geom::Affine const &) override;
     double complexity(Geom::Affine const &ctm) override;
+    // renders an SVG element or loads a file while rendering
+    bool prepare_concurrent_render() override { return false; }
 
     void set_document( SPDocument *document );
     void set_href(char const *href);
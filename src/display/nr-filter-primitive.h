@@ -73,6 +73,13 @@ public:
     // this should return how many times slower this primitive is that normal rendering
     virtual double complexity(Geom::Affine const &/*ctm*/) { return 1.0; }
 
+    /**
+     * Creates any state render_cairo() would otherwise create lazily, so that the
+     * primitive can be rendered from several threads at once.  Returns false if it
+     * cannot be.
+     */
+    virtual bool prepare_concurrent_render() { return true; }
+
     virtual bool uses_background() {
         if (_input == NR_FILTER_BACKGROUNDIMAGE || _input == NR_FILTER_BACKGROUNDALPHA) {
             return true;
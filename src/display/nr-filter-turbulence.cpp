@@ -374,6 +374,23 @@ private:
     int _x0, _y0;
 };
 
+void FilterTurbulence::_initGenerator()
+{
+    if (!gen->ready()) {
+        Geom::Point ta(fTileX, fTileY);
+        Geom::Point tb(fTileX + fTileWidth, fTileY + fTileHeight);
+        gen->init(seed, Geom::Rect(ta, tb),
+            Geom::Point(XbaseFrequency, YbaseFrequency), stitchTiles,
+            type == TURBULENCE_FRACTALNOISE, numOctaves);
+    }
+}
+
+bool FilterTurbulence::prepare_concurrent_render()
+{
+    _initGenerator();
+    return true;
+}
+
 void FilterTurbulence::render_cairo(FilterSlot &slot)
 {
     cairo_surface_t *input = slot.getcairo(_input);
@@ -397,13 +414,7 @@ void FilterTurbulence::render_cairo(FilterSlot &slot)
         set_cairo_surface_ci(out, (SPColorInterpolation)_style->color_interpolation_filters.computed );
     }
 
-    if (!gen->ready()) {
-        Geom::Point ta(fTileX, fTileY);
-        Geom::Point tb(fTileX + fTileWidth, fTileY + fTileHeight);
-        gen->init(seed, Geom::Rect(ta, tb),
-            Geom::Point(XbaseFrequency, YbaseFrequency), stitchTiles,
-            type == TURBULENCE_FRACTALNOISE, numOctaves);
-    }
+    _initGenerator();
 
     Geom::Affine unit_trans = slot.get_units().get_matrix_primitiveunits2pb().inverse();
     Geom::Rect slot_area = slot.get_slot_area();
@@ -48,6 +48,7 @@ public:
     void render_cairo(FilterSlot &slot) override;
     double complexity(Geom::Affine const &ctm) override;
     bool uses_background() override { return false; }
+    bool prepare_concurrent_render() override;
 
     void set_baseFrequency(int axis, double freq);
     void set_numOctaves(int num);
@@ -59,6 +60,8 @@ public:
     Glib::ustring name() override { return Glib::ustring("Turbulence"); }
 
 private:
+    void _initGenerator();
+
 
     TurbulenceGenerator *gen;
 
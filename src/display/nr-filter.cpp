@@ -108,9 +108,12 @@ int Filter::render(Inkscape::DrawingItem const *item, DrawingContext &graphic, D
         graphic.setOperator(CAIRO_OPERATOR_OVER);
         return 1;
     }
-    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
-    item->drawing().setFilterQuality(prefs->getInt("/options/filterquality/value", 0));
-    item->drawing().setBlurQuality(prefs->getInt("/options/blurquality/value", 0));
+    // Drawing::beginConcurrentRender() has already done this
+    if (!item->drawing().renderingConcurrently()) {
+        Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+        item->drawing().setFilterQuality(prefs->getInt("/options/filterquality/value", 0));
+        item->drawing().setBlurQuality(prefs->getInt("/options/blurquality/value", 0));
+    }
     FilterQuality const filterquality = (FilterQuality)item->drawing().filterQuality();
     int const blurquality = item->drawing().blurQuality();
 
@@ -288,6 +291,16 @@ double Filter::complexity(Geom::Affine const &ctm)
     return factor;
 }
 
+bool Filter::prepare_concurrent_render()
+{
+    for (auto & i : _primitive) {
+        if (i && !i->prepare_concurrent_render()) {
+            return false;
+        }
+    }
+    return true;
+}
+
 bool Filter::uses_background()
 {
     for (auto & i : _primitive) {
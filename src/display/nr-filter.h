@@ -164,6 +164,10 @@ public:
     // says whether the filter accesses any of the background images
     bool uses_background();
 
+    // gets the primitives ready for render() calls from several threads at once;
+    // returns false if some primitive cannot be rendered that way
+    bool prepare_concurrent_render();
+
     /** Creates a new filter with space for one filter element */
     Filter();
     /** 
@@ -118,8 +118,8 @@ Inkscape::Pixbuf *sp_generate_internal_bitmap(SPDocument *doc, gchar const */*fi
     if (cairo_surface_status(surface) == CAIRO_STATUS_SUCCESS) {
         Inkscape::DrawingContext dc(surface, Geom::Point(0,0));
 
-        // render items
-        drawing.render(dc, final_bbox, Inkscape::DrawingItem::RENDER_BYPASS_CACHE);
+        // render items, in tiles on several threads if the drawing allows it
+        drawing.renderTiled(dc, final_bbox, Inkscape::DrawingItem::RENDER_BYPASS_CACHE);
 
         inkpb = new Inkscape::Pixbuf(surface);
     }
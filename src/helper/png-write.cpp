@@ -14,12 +14,26 @@
  * Released under GNU GPL v2+, read the file 'COPYING' for more information.
  */
 
+#ifdef HAVE_CONFIG_H
+# include "config.h"  // only include where actually required!
+#endif
 
 #include <2geom/rect.h>
 #include <2geom/transforms.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <png.h>
 
+#if HAVE_OPENMP
+#include <omp.h>
+#endif // HAVE_OPENMP
+
 #include "document.h"
 #include "inkscape.h"
 #include "png-write.h"
@@ -54,8 +68,9 @@
 struct SPEBP {
     unsigned long int width, height, sheight;
     guint32 background;
-    Inkscape::Drawing *drawing; // it is assumed that all unneeded items are hidden
-    guchar *px;
+    Inkscape::Drawing *drawing; // it is assumed that all unneeded items are hidden, and that it is up to date
+    bool concurrent; // Drawing::beginConcurrentRender() succeeded
+    std::mutex render_mutex;
     unsigned (*status)(float, void *);
     void *data;
 };
@@ -67,6 +82,139 @@ struct SPPNGBD {
     int rowstride;
 };
 
+/**
+ * The rows of one stripe of the image, ready for libpng.
+ */
+struct SPPNGStripe {
+    std::vector<guchar const *> rows;
+    void *to_free = nullptr;
+    int num_rows = 0;
+    bool ready = false;
+};
+
+/**
+ * Stripes are rendered a batch at a time on several threads, while
+ * another thread hands the finished ones to libpng in order, so that
+ * row filtering and deflate overlap with the rendering of later stripes.
+ */
+class SPPNGPipeline {
+public:
+    SPPNGPipeline(size_t count) : _stripes(count) {}
+
+    ~SPPNGPipeline()
+    {
+        for (auto &stripe : _stripes) {
+            g_free(stripe.to_free);
+        }
+    }
+
+    SPPNGStripe &stripe(size_t i) { return _stripes[i]; }
+    size_t size() const { return _stripes.size(); }
+
+    /**
+     * Called by a renderer when stripe i is finished.  A stripe without
+     * rows stops the writer there.
+     */
+    void finished(size_t i)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stripes[i].ready = true;
+        _changed.notify_all();
+    }
+
+    /**
+     * Wait until at most window stripes before end are still to be
+     * written, so that memory use stays bounded.  False if the writer
+     * has stopped.
+     */
+    bool waitForRoom(size_t end, size_t window)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _changed.wait(lock, [=]() { return _stopped || _written + window >= end; });
+        return !_stopped;
+    }
+
+    /**
+     * Wait for stripe i.  Null if there is nothing more to write.
+     */
+    SPPNGStripe *waitForStripe(size_t i)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _changed.wait(lock, [=]() { return _aborted || _stripes[i].ready; });
+        if (!_stripes[i].ready || _stripes[i].num_rows == 0) {
+            return nullptr;
+        }
+        return &_stripes[i];
+    }
+
+    /**
+     * Called by the writer once stripe i is written.
+     */
+    void written(size_t i)
+    {
+        g_free(_stripes[i].to_free);
+        _stripes[i].to_free = nullptr;
+        std::lock_guard<std::mutex> lock(_mutex);
+        _written = i + 1;
+        _changed.notify_all();
+    }
+
+    /**
+     * Called by the writer when it is done, successfully or not.
+     */
+    void stop(bool failed)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopped = true;
+        _failed = failed;
+        _changed.notify_all();
+    }
+
+    /**
+     * Tell the writer that no more stripes will come.
+     */
+    void abort()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _aborted = true;
+        _changed.notify_all();
+    }
+
+    bool failed() const { return _failed; }
+
+private:
+    std::vector<SPPNGStripe> _stripes;
+    size_t _written = 0;
+    bool _stopped = false;
+    bool _failed = false;
+    bool _aborted = false;
+    std::mutex _mutex;
+    std::condition_variable _changed;
+};
+
+/**
+ * The writer thread: hand the stripes to libpng in order.
+ */
+static void
+sp_png_write_stripes(png_structp png_ptr, SPPNGPipeline *pipeline)
+{
+    // libpng reports errors with a longjmp, which must stay on this thread
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        pipeline->stop(true);
+        return;
+    }
+
+    for (size_t i = 0; i < pipeline->size(); i++) {
+        SPPNGStripe *stripe = pipeline->waitForStripe(i);
+        if (!stripe) {
+            break;
+        }
+        png_write_rows(png_ptr, const_cast<png_bytepp>(stripe->rows.data()), stripe->num_rows);
+        pipeline->written(i);
+    }
+    pipeline->stop(false);
+}
+
 /**
  * A simple wrapper to list png_text.
  */
@@ -123,8 +271,54 @@ void PngTextList::add(gchar const* key, gchar const* text)
     }
 }
 
+/**
+ * Collect the PNG text chunks from the document metadata.
+ */
+static void
+sp_png_get_text(SPDocument *doc, PngTextList &textList)
+{
+    textList.add("Software", "www.inkscape.org"); // Made by Inkscape comment
+    {
+        const gchar* pngToDc[] = {"Title", "title",
+                               "Author", "creator",
+                               "Description", "description",
+                               //"Copyright", "",
+                               "Creation Time", "date",
+                               //"Disclaimer", "",
+                               //"Warning", "",
+                               "Source", "source"
+                               //"Comment", ""
+        };
+        for (size_t i = 0; i < G_N_ELEMENTS(pngToDc); i += 2) {
+            struct rdf_work_entity_t * entity = rdf_find_entity ( pngToDc[i + 1] );
+            if (entity) {
+                gchar const* data = rdf_get_work_entity(doc, entity);
+                if (data && *data) {
+                    textList.add(pngToDc[i], data);
+                }
+            } else {
+                g_warning("Unable to find entity [%s]", pngToDc[i + 1]);
+            }
+        }
+
+
+        struct rdf_license_t *license =  rdf_get_license(doc);
+        if (license) {
+            if (license->name && license->uri) {
+                gchar* tmp = g_strdup_printf("%s %s", license->name, license->uri);
+                textList.add("Copyright", tmp);
+                g_free(tmp);
+            } else if (license->name) {
+                textList.add("Copyright", license->name);
+            } else if (license->uri) {
+                textList.add("Copyright", license->uri);
+            }
+        }
+    }
+}
+
 static bool
-sp_png_write_rgba_striped(SPDocument *doc,
+sp_png_write_rgba_striped(PngTextList &textList,
                           gchar const *filename, unsigned long int width, unsigned long int height, double xdpi, double ydpi,
                           int (* get_rows)(guchar const **rows, void **to_free, int row, int num_rows, void *data, int color_type, int bit_depth, int antialias),
                           void *data, bool interlace, int color_type, int bit_depth, int zlib, int antialiasing)
@@ -210,46 +404,6 @@ sp_png_write_rgba_striped(SPDocument *doc,
         png_set_sBIT(png_ptr, info_ptr, &sig_bit);
     }
 
-    PngTextList textList;
-
-    textList.add("Software", "www.inkscape.org"); // Made by Inkscape comment
-    {
-        const gchar* pngToDc[] = {"Title", "title",
-                               "Author", "creator",
-                               "Description", "description",
-                               //"Copyright", "",
-                               "Creation Time", "date",
-                               //"Disclaimer", "",
-                               //"Warning", "",
-                               "Source", "source"
-                               //"Comment", ""
-        };
-        for (size_t i = 0; i < G_N_ELEMENTS(pngToDc); i += 2) {
-            struct rdf_work_entity_t * entity = rdf_find_entity ( pngToDc[i + 1] );
-            if (entity) {
-                gchar const* data = rdf_get_work_entity(doc, entity);
-                if (data && *data) {
-                    textList.add(pngToDc[i], data);
-                }
-            } else {
-                g_warning("Unable to find entity [%s]", pngToDc[i + 1]);
-            }
-        }
-
-
-        struct rdf_license_t *license =  rdf_get_license(doc);
-        if (license) {
-            if (license->name && license->uri) {
-                gchar* tmp = g_strdup_printf("%s %s", license->name, license->uri);
-                textList.add("Copyright", tmp);
-                g_free(tmp);
-            } else if (license->name) {
-                textList.add("Copyright", license->name);
-            } else if (license->uri) {
-                textList.add("Copyright", license->uri);
-            }
-        }
-    }
     if (textList.getCount() > 0) {
         png_set_text(png_ptr, info_ptr, textList.getPtext(), textList.getCount());
     }
@@ -282,22 +436,61 @@ sp_png_write_rgba_striped(SPDocument *doc,
      * use the first method if you aren't handling interlacing yourself.
      */
 
-    png_bytep* row_pointers = new png_bytep[ebp->sheight];
     int number_of_passes = interlace ? png_set_interlace_handling(png_ptr) : 1;
 
-    for(int i=0;i<number_of_passes; ++i){
-        r = 0;
-        while (r < static_cast<png_uint_32>(height)) {
-            void *to_free;
-            int n = get_rows((unsigned char const **) row_pointers, &to_free, r, height-r, data, color_type, bit_depth, antialiasing);
-            if (!n) break;
-            png_write_rows(png_ptr, row_pointers, n);
-            g_free(to_free);
-            r += n;
+    // Each interlacing pass goes through the whole image again
+    size_t stripes_per_pass = (height + ebp->sheight - 1) / ebp->sheight;
+    SPPNGPipeline pipeline(number_of_passes * stripes_per_pass);
+
+    int num_threads = 1;
+#if HAVE_OPENMP
+    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+    num_threads = prefs->getIntLimited("/options/threading/numthreads", omp_get_num_procs(), 1, 256);
+#endif // HAVE_OPENMP
+    size_t batch_size = 2 * num_threads;
+
+    std::thread writer(sp_png_write_stripes, png_ptr, &pipeline);
+
+    bool complete = true;
+    for (size_t first = 0; first < pipeline.size() && complete; first += batch_size) {
+        size_t last = std::min(pipeline.size(), first + batch_size);
+
+        // The status callback may update the GUI, so it is only called from here
+        r = (first % stripes_per_pass) * ebp->sheight;
+        if (ebp->status && !ebp->status((float) r / height, ebp->data)) {
+            break;
+        }
+        // Render at most one batch ahead of the writer
+        if (!pipeline.waitForRoom(last, 2 * batch_size)) {
+            break;
+        }
+
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+#endif // HAVE_OPENMP
+        for (size_t i = first; i < last; i++) {
+            SPPNGStripe &stripe = pipeline.stripe(i);
+            int row = (i % stripes_per_pass) * ebp->sheight;
+            stripe.rows.resize(ebp->sheight);
+            stripe.num_rows = get_rows(stripe.rows.data(), &stripe.to_free, row, height - row, data,
+                                       color_type, bit_depth, antialiasing);
+            pipeline.finished(i);
+        }
+
+        for (size_t i = first; i < last; i++) {
+            complete = complete && pipeline.stripe(i).num_rows > 0;
         }
     }
 
-    delete[] row_pointers;
+    pipeline.abort();
+    writer.join();
+
+    // The writer has used the jump buffer for itself: take it back
+    if (pipeline.failed() || setjmp(png_jmpbuf(png_ptr))) {
+        fclose(fp);
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        return false;
+    }
 
     /* You can write optional chunks like tEXt, zTXt, and tIME at the end
      * as well.
@@ -327,22 +520,12 @@ sp_export_get_rows(guchar const **rows, void **to_free, int row, int num_rows, v
 {
     struct SPEBP *ebp = (struct SPEBP *) data;
 
-    if (ebp->status) {
-        if (!ebp->status((float) row / ebp->height, ebp->data)) return 0;
-    }
-
     num_rows = MIN(num_rows, static_cast<int>(ebp->sheight));
     num_rows = MIN(num_rows, static_cast<int>(ebp->height - row));
 
     /* Set area of interest */
-    // bbox is now set to the entire image to prevent discontinuities
-    // in the image when blur is used (the borders may still be a bit
-    // off, but that's less noticeable).
     Geom::IntRect bbox = Geom::IntRect::from_xywh(0, row, ebp->width, num_rows);
 
-    /* Update to renderable state */
-    ebp->drawing->update(bbox);
-
     int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, ebp->width);
     unsigned char *px = g_new(guchar, num_rows * stride);
 
@@ -355,17 +538,34 @@ sp_export_get_rows(guchar const **rows, void **to_free, int row, int num_rows, v
     dc.setOperator(CAIRO_OPERATOR_OVER);
 
     /* Render */
-    ebp->drawing->render(dc, bbox, 0, antialiasing);
+    {
+        // Unless the drawing is ready for concurrent rendering, Drawing::render()
+        // updates the state of the items as it goes, so the stripes take turns.
+        std::unique_lock<std::mutex> lock(ebp->render_mutex, std::defer_lock);
+        if (!ebp->concurrent) {
+            lock.lock();
+        }
+        ebp->drawing->render(dc, bbox, 0, antialiasing);
+    }
     cairo_surface_destroy(s);
 
     // PNG stores data as unpremultiplied big-endian RGBA, which means
     // it's identical to the GdkPixbuf format.
     convert_pixels_argb32_to_pixbuf(px, ebp->width, num_rows, stride);
-    
+
+    if (color_type == PNG_COLOR_TYPE_RGB_ALPHA && bit_depth == 8) {
+        // libpng can take the rows as they are
+        for (int i = 0; i < num_rows; i++) {
+            rows[i] = px + i * stride;
+        }
+        *to_free = px;
+        return num_rows;
+    }
+
     // If a custom bit depth or color type is asked, then convert rgb to grayscale, etc.
     const guchar* new_data = pixbuf_to_png(rows, px, num_rows, ebp->width, stride, color_type, bit_depth);
     *to_free = (void*) new_data;
-    free(px);
+    g_free(px);
 
     return num_rows;
 }
@@ -405,6 +605,22 @@ ExportResult sp_export_png_file(SPDocument *doc, gchar const *filename,
                               width, height, xdpi, ydpi, bgcolor, status, data, force_overwrite, items_only, interlace, color_type, bit_depth, zlib, antialiasing);
 }
 
+/**
+ * A PNG export set up by sp_export_png_new().
+ */
+struct SPExportPNG {
+    SPDocument *doc;
+    std::string filename;
+    unsigned long width, height;
+    double xdpi, ydpi;
+    bool interlace;
+    int color_type, bit_depth, zlib, antialiasing;
+    unsigned dkey;
+    Inkscape::Drawing drawing;
+    SPEBP ebp;
+    PngTextList text;
+};
+
 /**
  * Export an area to a PNG file
  *
@@ -429,6 +645,26 @@ ExportResult sp_export_png_file(SPDocument *doc, gchar const *filename,
 	return EXPORT_ABORTED;
     }
 
+    SPExportPNG *png = sp_export_png_new(doc, filename, area, width, height, xdpi, ydpi, bgcolor,
+                                         items_only, interlace, color_type, bit_depth, zlib, antialiasing);
+    ExportResult result = sp_export_png_write(png, status, data);
+    sp_export_png_free(png);
+
+    return result;
+}
+
+SPExportPNG *sp_export_png_new(SPDocument *doc, gchar const *filename,
+                               Geom::Rect const &area,
+                               unsigned long width, unsigned long height, double xdpi, double ydpi,
+                               unsigned long bgcolor,
+                               const std::vector<SPItem*> &items_only, bool interlace, int color_type, int bit_depth, int zlib, int antialiasing)
+{
+    g_return_val_if_fail(doc != nullptr, nullptr);
+    g_return_val_if_fail(filename != nullptr, nullptr);
+    g_return_val_if_fail(width >= 1, nullptr);
+    g_return_val_if_fail(height >= 1, nullptr);
+    g_return_val_if_fail(!area.hasZeroArea(), nullptr);
+
     doc->ensureUpToDate();
 
     /* Calculate translation by transforming to document coordinates (flipping Y)*/
@@ -454,44 +690,88 @@ ExportResult sp_export_png_file(SPDocument *doc, gchar const *filename,
                             * Geom::Scale(width / area.width(),
                                         height / area.height()));
 
-    struct SPEBP ebp;
+    SPExportPNG *png = new SPExportPNG();
+    png->doc = doc;
+    png->filename = filename;
+    png->width = width;
+    png->height = height;
+    png->xdpi = xdpi;
+    png->ydpi = ydpi;
+    png->interlace = interlace;
+    png->color_type = color_type;
+    png->bit_depth = bit_depth;
+    png->zlib = zlib;
+    png->antialiasing = antialiasing;
+
+    struct SPEBP &ebp = png->ebp;
     ebp.width  = width;
     ebp.height = height;
     ebp.background = bgcolor;
+    ebp.status = nullptr;
+    ebp.data = nullptr;
 
     /* Create new drawing */
-    Inkscape::Drawing drawing;
+    Inkscape::Drawing &drawing = png->drawing;
     drawing.setExact(true); // export with maximum blur rendering quality
-    unsigned const dkey = SPItem::display_key_new(1);
+    png->dkey = SPItem::display_key_new(1);
 
     // Create ArenaItems and set transform
-    drawing.setRoot(doc->getRoot()->invoke_show(drawing, dkey, SP_ITEM_SHOW_DISPLAY));
+    drawing.setRoot(doc->getRoot()->invoke_show(drawing, png->dkey, SP_ITEM_SHOW_DISPLAY));
     drawing.root()->setTransform(affine);
     ebp.drawing = &drawing;
 
     // We show all and then hide all items we don't want, instead of showing only requested items,
     // because that would not work if the shown item references something in defs
     if (!items_only.empty()) {
-        hide_other_items_recursively(doc->getRoot(), items_only, dkey);
+        hide_other_items_recursively(doc->getRoot(), items_only, png->dkey);
     }
 
-    ebp.status = status;
-    ebp.data   = data;
-
-    bool write_status = false;;
+    /* Update to renderable state, once for all stripes */
+    // bbox is the entire image to prevent discontinuities in the image
+    // when blur is used (the borders may still be a bit off, but that's
+    // less noticeable).
+    drawing.update(Geom::IntRect::from_xywh(0, 0, width, height));
 
+    ebp.concurrent = drawing.beginConcurrentRender(antialiasing);
     ebp.sheight = 64;
-    ebp.px = g_try_new(guchar, 4 * ebp.sheight * width);
 
-    if (ebp.px) {
-        write_status = sp_png_write_rgba_striped(doc, filename, width, height, xdpi, ydpi, sp_export_get_rows, &ebp, interlace, color_type, bit_depth, zlib, antialiasing);
-        g_free(ebp.px);
+    sp_png_get_text(doc, png->text);
+
+    return png;
+}
+
+bool sp_export_png_is_concurrent(SPExportPNG const *png)
+{
+    return png && png->ebp.concurrent;
+}
+
+ExportResult sp_export_png_write(SPExportPNG *png, unsigned (*status)(float, void *), void *data)
+{
+    g_return_val_if_fail(png != nullptr, EXPORT_ERROR);
+
+    png->ebp.status = status;
+    png->ebp.data   = data;
+
+    bool write_status = sp_png_write_rgba_striped(png->text, png->filename.c_str(), png->width, png->height,
+                                                  png->xdpi, png->ydpi, sp_export_get_rows, &png->ebp,
+                                                  png->interlace, png->color_type, png->bit_depth, png->zlib,
+                                                  png->antialiasing);
+
+    return write_status ? EXPORT_OK : EXPORT_ERROR;
+}
+
+void sp_export_png_free(SPExportPNG *png)
+{
+    if (!png) {
+        return;
     }
 
+    png->drawing.endConcurrentRender();
+
     // Hide items, this releases arenaitem
-    doc->getRoot()->invoke_hide(dkey);
+    png->doc->getRoot()->invoke_hide(png->dkey);
 
-    return write_status ? EXPORT_OK : EXPORT_ERROR;
+    delete png;
 }
 
 
@@ -48,4 +48,29 @@ ExportResult sp_export_png_file(SPDocument *doc, gchar const *filename,
 				unsigned int (*status) (float, void *), void *data, bool force_overwrite = false, const std::vector<SPItem*> &items_only = std::vector<SPItem*>(), 
                                 bool interlace = false, int color_type = 6, int bit_depth = 8, int zlib = 6, int antialiasing = 2);
 
+/**
+ * The same export in steps, so that the file can be written on another thread.
+ *
+ * sp_export_png_new() shows the document in a new drawing and reads its metadata,
+ * sp_export_png_write() renders and writes the file, and sp_export_png_free() hides
+ * the drawing again.  Unlike sp_export_png_file(), sp_export_png_new() does not ask
+ * before overwriting a file.
+ *
+ * sp_export_png_new() and sp_export_png_free() must be called on the thread that
+ * owns the document.  If sp_export_png_is_concurrent(), sp_export_png_write() may be
+ * called on any thread, as long as the document is not changed in the meantime;
+ * otherwise it must be called on the document's thread too.
+ */
+struct SPExportPNG;
+
+SPExportPNG *sp_export_png_new(SPDocument *doc, gchar const *filename,
+                               Geom::Rect const &area,
+                               unsigned long int width, unsigned long int height, double xdpi, double ydpi,
+                               unsigned long bgcolor,
+                               const std::vector<SPItem*> &items_only = std::vector<SPItem*>(),
+                               bool interlace = false, int color_type = 6, int bit_depth = 8, int zlib = 6, int antialiasing = 2);
+bool sp_export_png_is_concurrent(SPExportPNG const *png);
+ExportResult sp_export_png_write(SPExportPNG *png, unsigned int (*status) (float, void *) = nullptr, void *data = nullptr);
+void sp_export_png_free(SPExportPNG *png);
+
 #endif // SEEN_SP_PNG_WRITE_H
@@ -8,11 +8,13 @@
  *
  */
 
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <cerrno>  // History file
 #include <regex>
 #include <numeric>
+#include <sstream>
 
 #include <glibmm/i18n.h>  // Internationalization
 
@@ -70,6 +72,11 @@
 #include "helper/gettext.h"   // gettext init
 #endif // ENABLE_NLS
 
+#ifdef G_OS_UNIX
+#include <glib/gstdio.h>  // Daemon socket
+#include <sys/stat.h>
+#endif
+
 #ifdef WITH_GNU_READLINE
 #include <readline/readline.h>
 #include <readline/history.h>
@@ -566,10 +573,8 @@ InkscapeApplication::InkscapeApplication()
     // Garbage Collector
     Inkscape::GC::init();
 
-#ifndef NDEBUG
     // Use environment variable INKSCAPE_DEBUG_LOG=log.txt for event logging
     Inkscape::Debug::Logger::init();
-#endif
 
 #ifdef ENABLE_NLS
     // Native Language Support (shouldn't this always be used?).
@@ -660,6 +665,7 @@ InkscapeApplication::InkscapeApplication()
     // FIXME: Opacity should really be a DOUBLE, but an upstream bug means 0.0 is detected as NULL
     gapp->add_main_option_entry(T::OPTION_TYPE_STRING,   "export-background-opacity", 'y', N_("Background opacity for exported bitmaps (0.0 to 1.0, or 1 to 255)"), N_("VALUE")); // Bxx
     gapp->add_main_option_entry(T::OPTION_TYPE_STRING,   "export-png-color-mode", '\0', N_("Color mode (bit depth and color type) for exported bitmaps (Gray_1/Gray_2/Gray_4/Gray_8/Gray_16/RGB_8/RGB_16/GrayAlpha_8/GrayAlpha_16/RGBA_8/RGBA_16)"), N_("COLOR-MODE")); // Bxx
+    gapp->add_main_option_entry(T::OPTION_TYPE_INT,      "export-jobs",           '\0', N_("Number of files written at once when exporting several input files to PNG; default is 1"), N_("JOBS")); // Bxx
 
     // Query - Geometry
     _start_main_option_section(_("Query object/document geometry"));
@@ -691,6 +697,9 @@ InkscapeApplication::InkscapeApplication()
     gapp->add_main_option_entry(T::OPTION_TYPE_BOOL,     "batch-process",         '\0', N_("Close GUI after executing all actions/verbs"),"");
     _start_main_option_section();
     gapp->add_main_option_entry(T::OPTION_TYPE_BOOL,     "shell",                 '\0', N_("Start Inkscape in interactive shell mode"),                                 "");
+#ifdef G_OS_UNIX
+    gapp->add_main_option_entry(T::OPTION_TYPE_FILENAME, "daemon",                '\0', N_("Serve shell mode requests on a Unix domain socket"),                 N_("SOCKET"));
+#endif
 
 #ifdef WITH_DBUS
     _start_main_option_section(_("D-Bus"));
@@ -935,8 +944,9 @@ InkscapeApplication::process_document(SPDocument* document, std::string output_p
         if (!_gio_application->has_action(action.first)) {
             std::cerr << "ConcreteInkscapeApplication<T>::process_document: Unknown action name: " <<  action.first << std::endl;
         }
-        _gio_application->activate_action( action.first, action.second );
+        activate_action(action.first, action.second);
     }
+    _file_export.finish_exports(document);
 
     if (_use_shell) {
         shell();
@@ -956,6 +966,11 @@ InkscapeApplication::on_activate()
 {
     on_startup2();
 
+    if (!_daemon_socket.empty()) {
+        daemon();
+        return;
+    }
+
     std::string output;
 
     // Create new document, either from pipe or from template.
@@ -1015,6 +1030,30 @@ InkscapeApplication::on_open(const Gio::Application::type_vec_files& files, cons
         return;
     }
 
+    // With --export-jobs, PNG files are written in the background while the next files are
+    // loaded; each document is closed once its files are written to bound the memory held.
+    bool pipelined = _auto_export && _file_export.export_jobs > 1 && !_with_gui && !_use_shell;
+    std::vector<SPDocument *> exported;
+    auto close_exported = [&](bool finish) {
+        if (finish) {
+            _file_export.finish_exports();
+        }
+        auto open = std::remove_if(exported.begin(), exported.end(), [&](SPDocument *document) {
+            if (_file_export.exporting(document)) {
+                return false;
+            }
+            if (document == _active_document) {
+                _active_document  = nullptr;
+                _active_selection = nullptr;
+                _active_view      = nullptr;
+            }
+            INKSCAPE.remove_document(document);
+            document_close(document);
+            return true;
+        });
+        exported.erase(open, exported.end());
+    };
+
     for (auto file : files) {
 
         // Open file
@@ -1026,6 +1065,19 @@ InkscapeApplication::on_open(const Gio::Application::type_vec_files& files, cons
 
         // Process document (command line actions, shell, create window)
         process_document (document, file->get_path());
+
+        if (pipelined) {
+            exported.push_back(document);
+            close_exported(false);
+        }
+    }
+
+    if (pipelined) {
+        close_exported(true);
+    }
+
+    if (!_daemon_socket.empty()) {
+        daemon();
     }
 
     if (_batch_process) {
@@ -1034,6 +1086,20 @@ InkscapeApplication::on_open(const Gio::Application::type_vec_files& files, cons
     }
 }
 
+/**
+ * Activate an action of a sequence. PNG exports are written in the background while the
+ * following export actions run; any other action first waits for those of the active document,
+ * as it may change or close it.
+ */
+void
+InkscapeApplication::activate_action(std::string const &name, Glib::VariantBase const &value)
+{
+    if (_active_document && name.compare(0, 7, "export-") != 0) {
+        _file_export.finish_exports(_active_document);
+    }
+    _gio_application->activate_action(name, value);
+}
+
 void
 InkscapeApplication::parse_actions(const Glib::ustring& input, action_vector_t& action_vector)
 {
@@ -1219,7 +1285,10 @@ InkscapeApplication::shell()
         action_vector_t action_vector;
         parse_actions(input, action_vector);
         for (auto action: action_vector) {
-            _gio_application->activate_action( action.first, action.second );
+            activate_action(action.first, action.second);
+        }
+        if (_active_document) {
+            _file_export.finish_exports(_active_document);
         }
 
         // This would allow displaying the results of actions on the fly... but it needs to be well
@@ -1241,6 +1310,177 @@ InkscapeApplication::shell()
     }
 }
 
+// Serve shell lines from a Unix domain socket, keeping fonts, extensions and preferences loaded
+// between them. Requests are run one at a time, each line on its own.
+void
+InkscapeApplication::daemon()
+{
+#ifdef G_OS_UNIX
+    // Remove the socket of a daemon that did not exit cleanly, which refuses connections. A daemon
+    // that still listens on it is left alone, and so is a socket that cannot be probed: bind fails.
+    GStatBuf st;
+    if (g_lstat(_daemon_socket.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+        try {
+            auto probe = Gio::Socket::create(Gio::SOCKET_FAMILY_UNIX, Gio::SOCKET_TYPE_STREAM, Gio::SOCKET_PROTOCOL_DEFAULT);
+            probe->connect(Gio::UnixSocketAddress::create(_daemon_socket));
+            probe->close();
+            std::cerr << "InkscapeApplication::daemon: Another daemon is listening on " << _daemon_socket << std::endl;
+            return;
+        } catch (Glib::Error &e) {
+            if (e.domain() == G_IO_ERROR && e.code() == G_IO_ERROR_CONNECTION_REFUSED) {
+                g_unlink(_daemon_socket.c_str());
+            }
+        }
+    }
+
+    Glib::RefPtr<Gio::SocketListener> listener;
+    try {
+        auto socket = Gio::Socket::create(Gio::SOCKET_FAMILY_UNIX, Gio::SOCKET_TYPE_STREAM, Gio::SOCKET_PROTOCOL_DEFAULT);
+        socket->bind(Gio::UnixSocketAddress::create(_daemon_socket), false);
+        socket->listen();
+        listener = Gio::SocketListener::create();
+        listener->add_socket(socket);
+    } catch (Glib::Error &e) {
+        std::cerr << "InkscapeApplication::daemon: Cannot listen on " << _daemon_socket << ": " << e.what() << std::endl;
+        return;
+    }
+
+    std::cerr << "Inkscape daemon listening on " << _daemon_socket << ". Send 'quit' to quit." << std::endl;
+
+    // Every request starts from the export options of the command line.
+    InkFileExportCmd file_export;
+    file_export.set_options(_file_export);
+
+    bool quit = false;
+    while (!quit) {
+        Glib::RefPtr<Gio::SocketConnection> connection;
+        try {
+            connection = listener->accept();
+        } catch (Glib::Error &e) {
+            std::cerr << "InkscapeApplication::daemon: " << e.what() << std::endl;
+            break;
+        }
+
+        try {
+            auto input = Gio::DataInputStream::create(connection->get_input_stream());
+            auto output = connection->get_output_stream();
+            std::string line;
+            while (input->read_line(line)) {
+                // Remove trailing space (and carriage return)
+                line = std::regex_replace(line, std::regex("[ \r]+$"), "");
+
+                if (line == "quit" || line == "q") {
+                    quit = true;
+                    break;
+                }
+
+                // The reply is framed by a line with its length in bytes, as it may be empty or
+                // hold any number of lines.
+                std::string reply = daemon_request(line, file_export);
+                gsize written = 0;
+                output->write_all(std::to_string(reply.size()) + "\n", written);
+                output->write_all(reply, written);
+            }
+            connection->close();
+        } catch (Glib::Error &e) {
+            std::cerr << "InkscapeApplication::daemon: " << e.what() << std::endl;
+        }
+    }
+
+    listener->close();
+    g_unlink(_daemon_socket.c_str());
+#else
+    std::cerr << "InkscapeApplication::daemon: Not supported on this platform." << std::endl;
+#endif
+}
+
+namespace {
+
+// Sends what is printed on std::cout and std::cerr to another buffer for as long as it lives.
+class StandardStreamsRedirect
+{
+public:
+    StandardStreamsRedirect(std::streambuf *buf)
+        : _cout_buf(std::cout.rdbuf(buf))
+        , _cerr_buf(std::cerr.rdbuf(buf))
+    {}
+    ~StandardStreamsRedirect()
+    {
+        std::cout.rdbuf(_cout_buf);
+        std::cerr.rdbuf(_cerr_buf);
+    }
+    StandardStreamsRedirect(StandardStreamsRedirect const &) = delete;
+    StandardStreamsRedirect &operator=(StandardStreamsRedirect const &) = delete;
+
+private:
+    std::streambuf *_cout_buf;
+    std::streambuf *_cerr_buf;
+};
+
+// Runs part of a daemon request, reporting instead of passing on what it throws: a bad request
+// must not take down the daemon.
+template <typename F>
+void daemon_guard(F &&run)
+{
+    try {
+        run();
+    } catch (Glib::Error &e) {
+        std::cerr << "InkscapeApplication::daemon: " << e.what() << std::endl;
+    } catch (std::exception &e) {
+        std::cerr << "InkscapeApplication::daemon: " << e.what() << std::endl;
+    } catch (...) {
+        std::cerr << "InkscapeApplication::daemon: Unknown error" << std::endl;
+    }
+}
+
+} // namespace
+
+// Run one daemon request, returning what it printed. Documents the request opens are closed
+// again, so that requests only share what Inkscape keeps loaded between documents.
+std::string
+InkscapeApplication::daemon_request(std::string const &input, InkFileExportCmd const &file_export)
+{
+    std::vector<SPDocument *> documents = get_documents();
+
+    _file_export.set_options(file_export);
+    _active_document  = nullptr;
+    _active_selection = nullptr;
+    _active_view      = nullptr;
+
+    std::ostringstream reply;
+    {
+        StandardStreamsRedirect redirect(reply.rdbuf());
+
+        daemon_guard([&] {
+            action_vector_t action_vector;
+            parse_actions(input, action_vector);
+            for (auto action: action_vector) {
+                activate_action(action.first, action.second);
+            }
+        });
+
+        // Even after a failed action, so that nothing is left pending for the next request.
+        daemon_guard([&] {
+            Glib::RefPtr<Glib::MainContext> context = Glib::MainContext::get_default();
+            while (context->iteration(false)) {};
+
+            _file_export.finish_exports();
+        });
+    }
+
+    for (auto document : get_documents()) {
+        if (std::find(documents.begin(), documents.end(), document) == documents.end()) {
+            INKSCAPE.remove_document(document);
+            document_close(document);
+        }
+    }
+    _active_document  = nullptr;
+    _active_selection = nullptr;
+    _active_view      = nullptr;
+
+    return reply.str();
+}
+
 
 // ========================= Callbacks ==========================
 
@@ -1341,7 +1581,8 @@ InkscapeApplication::on_handle_local_options(const Glib::RefPtr<Glib::VariantDic
         options->contains("select")                ||
         options->contains("actions")               ||
         options->contains("verb")                  ||
-        options->contains("shell")
+        options->contains("shell")                 ||
+        options->contains("daemon")
         ) {
         _with_gui = false;
     }
@@ -1355,6 +1596,9 @@ InkscapeApplication::on_handle_local_options(const Glib::RefPtr<Glib::VariantDic
     if (options->contains("batch-process"))  _batch_process = true;
     if (options->contains("shell"))          _use_shell = true;
     if (options->contains("pipe"))           _use_pipe  = true;
+#ifdef G_OS_UNIX
+    if (options->contains("daemon"))         options->lookup_value("daemon", _daemon_socket);
+#endif
 
 
     // Enable auto-export
@@ -1521,6 +1765,10 @@ InkscapeApplication::on_handle_local_options(const Glib::RefPtr<Glib::VariantDic
         options->lookup_value("export-png-color-mode", _file_export.export_png_color_mode);
     }
 
+    if (options->contains("export-jobs")) {
+        options->lookup_value("export-jobs", _file_export.export_jobs);
+    }
+
 
     // ==================== D-BUS ======================
 
@@ -127,6 +127,7 @@ protected:
     bool _with_gui    = true;
     bool _batch_process = false; // Temp
     bool _use_shell   = false;
+    std::string _daemon_socket; // Path of the socket served by --daemon
     bool _use_pipe    = false;
     bool _auto_export = false;
     int _pdf_page     = 1;
@@ -156,9 +157,12 @@ protected:
     void on_open(const Gio::Application::type_vec_files &files, const Glib::ustring &hint);
     void process_document(SPDocument* document, std::string output_path);
     void parse_actions(const Glib::ustring& input, action_vector_t& action_vector);
+    void activate_action(std::string const &name, Glib::VariantBase const &value);
 
     void on_about();
     void shell();
+    void daemon();
+    std::string daemon_request(std::string const &input, InkFileExportCmd const &file_export);
 
     void _start_main_option_section(const Glib::ustring& section_name = "");
 };
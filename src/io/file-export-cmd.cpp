@@ -15,6 +15,8 @@
 
 #include "file-export-cmd.h"
 
+#include <algorithm>
+#include <iterator>
 #include <boost/algorithm/string.hpp>
 #include <png.h> // PNG export
 
@@ -31,6 +33,7 @@
 #include "selection-chemistry.h" // fit_canvas_to_drawing
 #include "svg/svg-color.h" // Background color
 #include "helper/png-write.h" // PNG Export
+#include "preferences.h"
 
 #include "extension/extension.h"
 #include "extension/system.h"
@@ -67,9 +70,48 @@ InkFileExportCmd::InkFileExportCmd()
     , export_id_only(false)
     , export_background_opacity(-1) // default is unset != actively set to 0
     , export_plain_svg(false)
+    , export_jobs(1)
+    , png_in_flight(0)
+    , png_bytes(0)
+    , png_stop(false)
 {
 }
 
+InkFileExportCmd::~InkFileExportCmd()
+{
+    finish_exports();
+}
+
+void
+InkFileExportCmd::set_options(InkFileExportCmd const &other)
+{
+    export_filename           = other.export_filename;
+    export_type               = other.export_type;
+    export_extension          = other.export_extension;
+    export_overwrite          = other.export_overwrite;
+    export_area               = other.export_area;
+    export_area_drawing       = other.export_area_drawing;
+    export_area_page          = other.export_area_page;
+    export_margin             = other.export_margin;
+    export_area_snap          = other.export_area_snap;
+    export_width              = other.export_width;
+    export_height             = other.export_height;
+    export_dpi                = other.export_dpi;
+    export_ignore_filters     = other.export_ignore_filters;
+    export_text_to_path       = other.export_text_to_path;
+    export_ps_level           = other.export_ps_level;
+    export_pdf_level          = other.export_pdf_level;
+    export_latex              = other.export_latex;
+    export_id                 = other.export_id;
+    export_id_only            = other.export_id_only;
+    export_use_hints          = other.export_use_hints;
+    export_background         = other.export_background;
+    export_background_opacity = other.export_background_opacity;
+    export_png_color_mode     = other.export_png_color_mode;
+    export_plain_svg          = other.export_plain_svg;
+    export_jobs               = other.export_jobs;
+}
+
 void
 InkFileExportCmd::do_export(SPDocument* doc, std::string filename_in)
 {
@@ -175,6 +217,10 @@ InkFileExportCmd::do_export(SPDocument* doc, std::string filename_in)
             }
             continue;
         }
+        // Other exports may change the document (e.g. --export-text-to-path) while PNG files of it
+        // are still being written.
+        finish_exports(doc);
+
         // for SVG export, we let the do_export_svg function handle the selection of the extension, unless
         // an extension ID was explicitly given. This makes handling of --export-plain-svg easier (which
         // should also work when multiple file types are given, unlike --export-extension)
@@ -704,10 +750,18 @@ InkFileExportCmd::do_export_png(SPDocument *doc, std::string const &filename_in)
 
         reverse(items.begin(),items.end()); // But there was only one item!
 
-        if( sp_export_png_file(doc, filename_out.c_str(), area, width, height, xdpi, ydpi,
-                               bgcolor, nullptr, nullptr, true, export_id_only ? items : std::vector<SPItem*>(),
-                               false, color_type, bit_depth) == 1 ) {
-        } else {
+        SPExportPNG *png = sp_export_png_new(doc, filename_out.c_str(), area, width, height, xdpi, ydpi,
+                                             bgcolor, export_id_only ? items : std::vector<SPItem*>(),
+                                             false, color_type, bit_depth);
+        if (export_jobs > 1 && sp_export_png_is_concurrent(png)) {
+            // Rendered and compressed by a worker while the next document is loaded.
+            queue_png(doc, png, filename_out, 4 * (size_t)width * height);
+            continue;
+        }
+
+        ExportResult result = sp_export_png_write(png);
+        sp_export_png_free(png);
+        if (result != EXPORT_OK) {
             std::cerr << "InkFileExport::do_export_png: Failed to export to " << filename_out << std::endl;
             continue;
         }
@@ -716,6 +770,130 @@ InkFileExportCmd::do_export_png(SPDocument *doc, std::string const &filename_in)
     return 0;
 }
 
+/**
+ * Hand a PNG export to the workers, waiting first while too many exports are in flight.
+ *
+ * The budget, in MiB, bounds the pixels of the images being written at once, as an estimate
+ * of the memory held by their drawings and documents.  One export is always let through.
+ */
+void
+InkFileExportCmd::queue_png(SPDocument *doc, SPExportPNG *png, std::string const &filename, size_t bytes)
+{
+    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+    size_t budget = (size_t)prefs->getIntLimited("/options/export/batchmemory", 1024, 1, 1048576) << 20;
+
+    reap_pngs();
+
+    std::unique_lock<std::mutex> lock(png_mutex);
+    while (png_workers.size() < (size_t)export_jobs) {
+        png_workers.emplace_back(&InkFileExportCmd::png_worker, this);
+    }
+    while (png_in_flight > 0 && (png_in_flight >= 2 * export_jobs || png_bytes + bytes > budget)) {
+        png_done_cond.wait(lock);
+        lock.unlock();
+        reap_pngs();
+        lock.lock();
+    }
+
+    png_jobs.emplace_back(new PNGJob{doc, png, filename, bytes, false, false});
+    png_queue.push_back(png_jobs.back().get());
+    png_in_flight++;
+    png_bytes += bytes;
+    png_cond.notify_one();
+}
+
+/**
+ * Write queued PNG files until told to stop and the queue is empty.
+ */
+void
+InkFileExportCmd::png_worker()
+{
+    std::unique_lock<std::mutex> lock(png_mutex);
+    while (true) {
+        png_cond.wait(lock, [this] { return !png_queue.empty() || png_stop; });
+        if (png_queue.empty()) {
+            return;
+        }
+        PNGJob *job = png_queue.front();
+        png_queue.pop_front();
+
+        lock.unlock();
+        bool ok = sp_export_png_write(job->png) == EXPORT_OK;
+        lock.lock();
+
+        job->ok = ok;
+        job->done = true;
+        png_in_flight--;
+        png_bytes -= job->bytes;
+        png_done_cond.notify_all();
+    }
+}
+
+/**
+ * Release the drawings of the written PNG files, on the thread that owns their documents.
+ */
+void
+InkFileExportCmd::reap_pngs()
+{
+    std::vector<std::unique_ptr<PNGJob>> done;
+    {
+        std::lock_guard<std::mutex> lock(png_mutex);
+        auto first_done = std::stable_partition(png_jobs.begin(), png_jobs.end(),
+                                                [](std::unique_ptr<PNGJob> const &job) { return !job->done; });
+        std::move(first_done, png_jobs.end(), std::back_inserter(done));
+        png_jobs.erase(first_done, png_jobs.end());
+    }
+
+    for (auto &job : done) {
+        if (!job->ok) {
+            std::cerr << "InkFileExport::do_export_png: Failed to export to " << job->filename << std::endl;
+        }
+        sp_export_png_free(job->png);
+    }
+}
+
+/**
+ * Whether PNG files of the document are still being written.
+ */
+bool
+InkFileExportCmd::exporting(SPDocument *doc)
+{
+    reap_pngs();
+
+    std::lock_guard<std::mutex> lock(png_mutex);
+    return std::any_of(png_jobs.begin(), png_jobs.end(),
+                       [doc](std::unique_ptr<PNGJob> const &job) { return job->doc == doc; });
+}
+
+/**
+ * Wait until the PNG files of the document, or of all documents, are written.
+ * Without a document, this also stops the workers.
+ */
+void
+InkFileExportCmd::finish_exports(SPDocument *doc)
+{
+    std::unique_lock<std::mutex> lock(png_mutex);
+    if (doc) {
+        png_done_cond.wait(lock, [this, doc] {
+            return std::none_of(png_jobs.begin(), png_jobs.end(),
+                                [doc](std::unique_ptr<PNGJob> const &job) { return job->doc == doc && !job->done; });
+        });
+    } else {
+        png_stop = true;
+        png_cond.notify_all();
+        lock.unlock();
+        for (auto &worker : png_workers) {
+            worker.join();
+        }
+        lock.lock();
+        png_workers.clear();
+        png_stop = false;
+    }
+    lock.unlock();
+
+    reap_pngs();
+}
+
 
 /**
  *  Perform a PDF/PS/EPS export
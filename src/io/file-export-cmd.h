@@ -12,10 +12,17 @@
 #ifndef INK_FILE_EXPORT_CMD_H
 #define INK_FILE_EXPORT_CMD_H
 
+#include <condition_variable>
+#include <deque>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <glibmm.h>
 
 class SPDocument;
+struct SPExportPNG;
 namespace Inkscape {
 namespace Extension {
 class Output;
@@ -26,9 +33,18 @@ class InkFileExportCmd {
 
 public:
     InkFileExportCmd();
+    ~InkFileExportCmd();
 
     void do_export(SPDocument* doc, std::string filename_in="");
 
+    // Copy the command line options (not the exports in progress) from another instance.
+    void set_options(InkFileExportCmd const &other);
+
+    // With export_jobs > 1, PNG files are written in the background: a document may only be
+    // changed or closed once exporting() returns false or finish_exports() has returned.
+    bool exporting(SPDocument *doc);
+    void finish_exports(SPDocument *doc = nullptr);
+
 private:
     guint32 get_bgcolor(SPDocument *doc);
     std::string get_filename_out(std::string filename_in = "", std::string object_id = "");
@@ -41,6 +57,28 @@ private:
     int do_export_extension(SPDocument *doc, std::string const &filename_in, Inkscape::Extension::Output *extension);
     Glib::ustring export_type_current;
 
+    struct PNGJob {
+        SPDocument *doc;
+        SPExportPNG *png;
+        std::string filename;
+        size_t bytes;
+        bool done;
+        bool ok;
+    };
+    void queue_png(SPDocument *doc, SPExportPNG *png, std::string const &filename, size_t bytes);
+    void reap_pngs();
+    void png_worker();
+
+    std::vector<std::thread> png_workers;
+    std::deque<PNGJob *> png_queue;                // Waiting for a worker
+    std::vector<std::unique_ptr<PNGJob>> png_jobs; // Queued, being written or waiting to be reaped
+    std::mutex png_mutex;
+    std::condition_variable png_cond;      // A job was queued, or the workers should stop
+    std::condition_variable png_done_cond; // A job was written
+    int png_in_flight;
+    size_t png_bytes;
+    bool png_stop;
+
 public:
     // Should be private, but this is just temporary code (I hope!).
 
@@ -72,6 +110,7 @@ public:
     double        export_background_opacity;
     Glib::ustring export_png_color_mode;
     bool          export_plain_svg;
+    int           export_jobs;
 };
 
 #endif // INK_FILE_EXPORT_CMD_H
@@ -151,6 +151,9 @@ font_instance::~font_instance()
         if ( glyphs[i].pathvector ) {
             delete glyphs[i].pathvector;
         }
+        if ( glyphs[i].cairo_path ) {
+            cairo_path_destroy(glyphs[i].cairo_path);
+        }
     }
     if ( glyphs ) {
         free(glyphs);
@@ -416,6 +419,7 @@ void font_instance::LoadGlyph(int glyph_id)
         }
         font_glyph  n_g;
         n_g.pathvector=nullptr;
+        n_g.cairo_path=nullptr;
         n_g.bbox[0]=n_g.bbox[1]=n_g.bbox[2]=n_g.bbox[3]=0;
         n_g.h_advance = 0;
         n_g.v_advance = 0;
@@ -691,6 +695,26 @@ Geom::PathVector* font_instance::PathVector(int glyph_id)
     return glyphs[no].pathvector;
 }
 
+cairo_path_t const* font_instance::CairoPath(int glyph_id)
+{
+    Geom::PathVector *pathv = PathVector(glyph_id);
+    if ( pathv == nullptr ) return nullptr;
+
+    font_glyph &glyph = glyphs[id_to_no[glyph_id]];
+    if ( glyph.cairo_path == nullptr ) {
+        // Cairo keeps paths in 24.8 fixed point device units, while glyphs are on a [0..1] scale:
+        // convert them through a scaled context so that they keep their precision.
+        cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_A8, 1, 1);
+        cairo_t *ct = cairo_create(surface);
+        cairo_scale(ct, 16384, 16384);
+        feed_pathvector_to_cairo(ct, *pathv);
+        glyph.cairo_path = cairo_copy_path(ct);
+        cairo_destroy(ct);
+        cairo_surface_destroy(surface);
+    }
+    return glyph.cairo_path;
+}
+
 Inkscape::Pixbuf* font_instance::PixBuf(int glyph_id)
 {
     Inkscape::Pixbuf* pixbuf = nullptr;
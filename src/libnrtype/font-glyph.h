@@ -10,6 +10,7 @@
 #ifndef SEEN_LIBNRTYPE_FONT_GLYPH_H
 #define SEEN_LIBNRTYPE_FONT_GLYPH_H
 
+#include <cairo.h>
 #include <2geom/forward.h>
 
 // the info for a glyph in a font. it's totally resolution- and fontsize-independent
@@ -19,6 +20,7 @@ struct font_glyph {
     double         bbox[4];            // bbox of the path (and the artbpath), not the bbox of the glyph
 																			 // as the fonts sometimes contain
     Geom::PathVector* pathvector;      // outline as 2geom pathvector, for text->curve stuff (should be unified with livarot)
+    cairo_path_t*     cairo_path;      // the same outline for rendering, converted on first use
 };
 
 
@@ -14,6 +14,7 @@
 
 #include <pango/pango-types.h>
 #include <pango/pango-font.h>
+#include <cairo.h>
 
 #include <2geom/d2.h>
 
@@ -88,6 +89,10 @@ public:
     // Return 2geom pathvector for glyph. Deallocated when font instance dies.
     Geom::PathVector*    PathVector(int glyph_id);
 
+    // Return the same outline as a cairo path, converted once and shared by all users of the
+    // glyph. Deallocated when font instance dies. Not thread-safe: look it up before rendering.
+    cairo_path_t const*  CairoPath(int glyph_id);
+
     // Return font has SVG OpenType enties.
     bool                 FontHasSVG() { return fontHasSVG; };
 
@@ -21,17 +21,28 @@
 static int const minprec = 1;
 static int const maxprec = 16;
 
-int Inkscape::SVG::PathString::numericprecision;
-int Inkscape::SVG::PathString::minimumexponent;
-Inkscape::SVG::PATHSTRING_FORMAT Inkscape::SVG::PathString::format;
+Inkscape::SVG::PathString::Settings Inkscape::SVG::PathString::Settings::fromPreferences()
+{
+    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+    Settings settings;
+    settings.format = (PATHSTRING_FORMAT)prefs->getIntLimited("/options/svgoutput/pathstring_format", 1, 0, PATHSTRING_FORMAT_SIZE - 1 );
+    settings.force_repeat_commands = !prefs->getBool("/options/svgoutput/disable_optimizations" ) && prefs->getBool("/options/svgoutput/forcerepeatcommands");
+    settings.numericprecision = std::max<int>(minprec,std::min<int>(maxprec, prefs->getInt("/options/svgoutput/numericprecision", 8)));
+    settings.minimumexponent = prefs->getInt("/options/svgoutput/minimumexponent", -8);
+    return settings;
+}
 
 Inkscape::SVG::PathString::PathString() :
-    force_repeat_commands(!Inkscape::Preferences::get()->getBool("/options/svgoutput/disable_optimizations" ) && Inkscape::Preferences::get()->getBool("/options/svgoutput/forcerepeatcommands"))
+    PathString(Settings::fromPreferences())
+{
+}
+
+Inkscape::SVG::PathString::PathString(Settings const &settings) :
+    _abs_state(settings.numericprecision, settings.minimumexponent),
+    _rel_state(settings.numericprecision, settings.minimumexponent),
+    format(settings.format),
+    force_repeat_commands(settings.force_repeat_commands)
 {
-    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
-    format = (PATHSTRING_FORMAT)prefs->getIntLimited("/options/svgoutput/pathstring_format", 1, 0, PATHSTRING_FORMAT_SIZE - 1 );
-    numericprecision = std::max<int>(minprec,std::min<int>(maxprec, prefs->getInt("/options/svgoutput/numericprecision", 8)));
-    minimumexponent = prefs->getInt("/options/svgoutput/minimumexponent", -8);
 }
 
 // For absolute and relative paths... the entire path is kept in the "tail".
@@ -37,7 +37,21 @@ enum PATHSTRING_FORMAT {
  */
 class PathString {
 public:
+    /**
+     * How numbers and commands are written, from the /options/svgoutput preferences.
+     * Read them once to build path strings on several threads.
+     */
+    struct Settings {
+        PATHSTRING_FORMAT format;
+        bool force_repeat_commands;
+        int numericprecision;
+        int minimumexponent;
+
+        static Settings fromPreferences();
+    };
+
     PathString();
+    explicit PathString(Settings const &settings);
 
     // default copy
     // default assign
@@ -51,6 +65,12 @@ public:
         return final;
     }
 
+    // Same as string(), but moves the result out instead of copying it
+    std::string release() {
+        string();
+        return std::move(final);
+    }
+
     operator std::string const &() {
         return string();
     }
@@ -189,7 +209,12 @@ private:
     }
 
     struct State {
-        State() { prevop = 0; switches = 0; }
+        State(int precision, int minexp)
+            : switches(0)
+            , prevop(0)
+            , numericprecision(precision)
+            , minimumexponent(minexp)
+        {}
 
         void appendOp(char op) {
             if (prevop != 0) str += ' ';
@@ -224,8 +249,13 @@ private:
         char prevop;
 
     private:
-        void appendNumber(double v, int precision=numericprecision, int minexp=minimumexponent);
-        void appendNumber(double v, double &rv, int precision=numericprecision, int minexp=minimumexponent);
+        int numericprecision;
+        int minimumexponent;
+
+        void appendNumber(double v) { appendNumber(v, numericprecision, minimumexponent); }
+        void appendNumber(double v, double &rv) { appendNumber(v, rv, numericprecision, minimumexponent); }
+        void appendNumber(double v, int precision, int minexp);
+        void appendNumber(double v, double &rv, int precision, int minexp);
         void appendRelativeCoord(Geom::Coord v, Geom::Coord r);
     } _abs_state, _rel_state; // State with the last operator being an absolute/relative operator
 
@@ -243,10 +273,8 @@ private:
                  _abs_state.str : _rel_state.str );
     }
 
-    static PATHSTRING_FORMAT format;
-    bool const force_repeat_commands;
-    static int numericprecision;
-    static int minimumexponent;
+    PATHSTRING_FORMAT format;
+    bool force_repeat_commands;
 };
 
 }
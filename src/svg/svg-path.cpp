@@ -112,11 +112,15 @@ static void sp_svg_write_path(Inkscape::SVG::PathString & str, Geom::Path const
 std::string sp_svg_write_path(Geom::PathVector const &p) {
     Inkscape::SVG::PathString str;
 
+    sp_svg_write_path(str, p);
+
+    return str;
+}
+
+void sp_svg_write_path(Inkscape::SVG::PathString &str, Geom::PathVector const &p) {
     for(const auto & pit : p) {
         sp_svg_write_path(str, pit);
     }
-
-    return str;
 }
 
 std::string sp_svg_write_path(Geom::Path const &p) {
@@ -20,6 +20,12 @@
 #include "svg/svg-length.h"
 #include <2geom/forward.h>
 
+namespace Inkscape {
+namespace SVG {
+class PathString;
+}
+}
+
 /* Generic */
 
 /*
@@ -65,6 +71,8 @@ double sp_svg_read_percentage( const char * str, double def );
 Geom::PathVector sp_svg_read_pathv( char const * str );
 std::string sp_svg_write_path(Geom::PathVector const &p);
 std::string sp_svg_write_path(Geom::Path const &p);
+/* Appends p to str, whose settings need not come from the preferences */
+void sp_svg_write_path(Inkscape::SVG::PathString &str, Geom::PathVector const &p);
 
 #endif // SEEN_SP_SVG_H
 
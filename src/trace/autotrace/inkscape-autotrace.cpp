@@ -22,11 +22,11 @@ extern "C" {
 
 #include <glibmm/i18n.h>
 #include <gtkmm/main.h>
-#include <iomanip>
 
 #include "trace/filterset.h"
 #include "trace/imagemap-gdk.h"
 #include "trace/quantize.h"
+#include "trace/trace-events.h"
 
 #include "desktop.h"
 #include "message-stack.h"
@@ -119,95 +119,110 @@ int test_cancel (void* keepGoing){return !(* ((int*)keepGoing));}
  *  of an SVG <path> element.
  */
 std::vector<TracingEngineResult> AutotraceTracingEngine::trace(Glib::RefPtr<Gdk::Pixbuf> pixbuf)
+{
+    std::vector<TracingEngineResult> results;
+    traceTo(pixbuf, [&results](TracingEngineResult &&result) {
+        results.push_back(std::move(result));
+    });
+    return results;
+}
+
+
+/**
+ *  Trace, handing the path of every color to sink as soon as all of
+ *  its spline lists have been written.
+ */
+void AutotraceTracingEngine::traceTo(Glib::RefPtr<Gdk::Pixbuf> pixbuf, ResultSink const &sink)
 {
     GdkPixbuf *pb1 = pixbuf->gobj();
     guchar *pb = to_3channels(pb1);
     if (!pb) {
-        return std::vector<TracingEngineResult>();
+        return;
     }
-    
-    at_bitmap *bitmap =
-//        at_bitmap_new(gdk_pixbuf_get_width(pb), gdk_pixbuf_get_height(pb), gdk_pixbuf_get_n_channels(pb));
-//    bitmap->bitmap = gdk_pixbuf_get_pixels(pb);
-    at_bitmap_new(gdk_pixbuf_get_width(pb1), gdk_pixbuf_get_height(pb1), 3);
+
+    keepGoing = 1;
+
+    TraceStage stage("autotrace", "pixels", (long)gdk_pixbuf_get_width(pb1) * gdk_pixbuf_get_height(pb1));
+
+    opts->thread_count = threads;
+
+    at_bitmap *bitmap = at_bitmap_new(gdk_pixbuf_get_width(pb1), gdk_pixbuf_get_height(pb1), 3);
     free(bitmap->bitmap); // should create at_bitmap with bitmap->bitmap = pb
     bitmap->bitmap = pb;
-    
-    at_splines_type *splines = at_splines_new_full(bitmap, opts, NULL, NULL, NULL, NULL, test_cancel, &keepGoing);
-    // at_output_write_func wfunc = at_output_get_handler_by_suffix("svg");
-    // at_spline_writer *wfunc = at_output_get_handler_by_suffix("svg");
 
+    at_splines_type *splines = nullptr;
+    {
+        TraceStage fit("autotrace-fit", "threads", opts->thread_count);
+        splines = at_splines_new_full(bitmap, opts, NULL, NULL, NULL, NULL, test_cancel, &keepGoing);
+        fit.result("lists", splines ? SPLINE_LIST_ARRAY_LENGTH(*splines) : 0);
+    }
+    at_bitmap_free(bitmap);
+    if (!splines) {
+        return;
+    }
 
     int height = splines->height;
-    // const at_splines_type spline = *splines;
-    at_spline_list_array_type spline = *splines;
+    at_spline_list_array_type const &spline = *splines;
 
-    unsigned this_list;
-    at_spline_list_type list;
+    // Consecutive spline lists of the same color end up in one path
+    Inkscape::SVG::PathString thePath(pathStringSettings);
+    std::string theStyle;
     at_color last_color = { 0, 0, 0 };
-
-    std::stringstream theStyle;
-    std::stringstream thePath;
-    char color[10];
-    int nNodes = 0;
-
-    std::vector<TracingEngineResult> res;
-
-    // at_splines_write(wfunc, stdout, "", NULL, splines, NULL, NULL);
-
-    for (this_list = 0; this_list < SPLINE_LIST_ARRAY_LENGTH(spline); this_list++) {
-        unsigned this_spline;
-        at_spline_type first;
-
-        list = SPLINE_LIST_ARRAY_ELT(spline, this_list);
-        first = SPLINE_LIST_ELT(list, 0);
-
-        if (this_list == 0 || !at_color_equal(&list.color, &last_color)) {
-            if (this_list > 0) {
-                if (!(spline.centerline || list.open)) {
-                    thePath << "z";
-                    nNodes++;
-                }
-                TracingEngineResult ter(theStyle.str(), thePath.str(), nNodes);
-                res.push_back(ter);
-                theStyle.clear();
-                thePath.clear();
-                nNodes = 0;
-            }
-            sprintf(color, "#%02x%02x%02x;", list.color.r, list.color.g, list.color.b);
-
-            theStyle << ((spline.centerline || list.open) ? "stroke:" : "fill:") << color
-                     << ((spline.centerline || list.open) ? "fill:" : "stroke:") << "none";
+    long nNodes = 0;
+    long paths = 0, nodes = 0, bytes = 0;
+    auto emit = [&]() {
+        std::string d = thePath.release();
+        paths++;
+        nodes += nNodes;
+        bytes += d.size();
+        sink(TracingEngineResult(theStyle, std::move(d), nNodes));
+    };
+
+    for (unsigned this_list = 0; this_list < SPLINE_LIST_ARRAY_LENGTH(spline); this_list++) {
+        at_spline_list_type const &list = SPLINE_LIST_ARRAY_ELT(spline, this_list);
+        bool stroked = spline.centerline || list.open;
+
+        if (SPLINE_LIST_LENGTH(list) == 0) {
+            continue;
         }
-        thePath << "M" << START_POINT(first).x << " " << height - START_POINT(first).y;
+        if (nNodes > 0 && !at_color_equal(&list.color, &last_color)) {
+            emit();
+            thePath = Inkscape::SVG::PathString(pathStringSettings);
+            nNodes = 0;
+        }
+        if (nNodes == 0) {
+            char color[8];
+            g_snprintf(color, sizeof(color), "#%02x%02x%02x", list.color.r, list.color.g, list.color.b);
+            theStyle = std::string(stroked ? "stroke:" : "fill:") + color + (stroked ? ";fill:none" : ";stroke:none");
+        }
+        last_color = list.color;
+
+        at_spline_type const &first = SPLINE_LIST_ELT(list, 0);
+        thePath.moveTo(START_POINT(first).x, height - START_POINT(first).y);
         nNodes++;
-        for (this_spline = 0; this_spline < SPLINE_LIST_LENGTH(list); this_spline++) {
-            at_spline_type s = SPLINE_LIST_ELT(list, this_spline);
+        for (unsigned this_spline = 0; this_spline < SPLINE_LIST_LENGTH(list); this_spline++) {
+            at_spline_type const &s = SPLINE_LIST_ELT(list, this_spline);
 
             if (SPLINE_DEGREE(s) == AT_LINEARTYPE) {
-                thePath << "L" << END_POINT(s).x << " " << height - END_POINT(s).y;
-                nNodes++;
+                thePath.lineTo(END_POINT(s).x, height - END_POINT(s).y);
+            } else {
+                thePath.curveTo(CONTROL1(s).x, height - CONTROL1(s).y,
+                                CONTROL2(s).x, height - CONTROL2(s).y,
+                                END_POINT(s).x, height - END_POINT(s).y);
             }
-            else {
-                thePath << "C" << CONTROL1(s).x << " " << height - CONTROL1(s).y << " " << CONTROL2(s).x << " "
-                        << height - CONTROL2(s).y << " " << END_POINT(s).x << " " << height - END_POINT(s).y;
-                nNodes++;
-            }
-            last_color = list.color;
+            nNodes++;
+        }
+        if (!stroked) {
+            thePath.closePath();
+            nNodes++;
         }
     }
-    if (!(spline.centerline || list.open))
-        thePath << "z";
-    nNodes++;
-    if (SPLINE_LIST_ARRAY_LENGTH(spline) > 0) {
-        TracingEngineResult ter(theStyle.str(), thePath.str(), nNodes);
-        res.push_back(ter);
-        theStyle.clear();
-        thePath.clear();
-        nNodes = 0;
+    if (nNodes > 0) {
+        emit();
     }
 
-    return res;
+    at_splines_free(splines);
+    stage.result("paths", paths, "nodes", nodes, "bytes", bytes);
 }
 
 
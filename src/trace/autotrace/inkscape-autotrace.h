@@ -54,6 +54,12 @@ class AutotraceTracingEngine : public TracingEngine {
      */
     std::vector<TracingEngineResult> trace(Glib::RefPtr<Gdk::Pixbuf> pixbuf) override;
 
+    /**
+     *  Trace, handing the path of every color to sink as soon as it
+     *  is complete.
+     */
+    void traceTo(Glib::RefPtr<Gdk::Pixbuf> pixbuf, ResultSink const &sink) override;
+
     /**
      *  Abort the thread that is executing getPathDataFromPixbuf()
      */
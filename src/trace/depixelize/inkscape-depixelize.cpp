@@ -23,6 +23,7 @@
 #include <iomanip>
 
 #include "desktop.h"
+#include "inkscape.h"
 #include "message-stack.h"
 #include "helper/geom.h"
 #include "object/sp-path.h"
@@ -68,20 +69,14 @@ DepixelizeTracingEngine::DepixelizeTracingEngine(TraceType traceType, double cur
     params->sparsePixelsRadius = sparsePixels;
     params->sparsePixelsMultiplier = sparseMultiplier;
     params->optimize = optimize;
-    params->nthreads = Inkscape::Preferences::get()->getIntLimited("/options/threading/numthreads",
-#ifdef HAVE_OPENMP
-                                                                   omp_get_num_procs(),
-#else
-                                                                   1,
-#endif // HAVE_OPENMP
-                                                                   1, 256);
 }
 
 DepixelizeTracingEngine::~DepixelizeTracingEngine() { delete params; }
 
 std::vector<TracingEngineResult> DepixelizeTracingEngine::trace(Glib::RefPtr<Gdk::Pixbuf> pixbuf)
 {
-    if (pixbuf->get_width() > 256 || pixbuf->get_height() > 256) {
+    bool gui = Inkscape::Application::exists() && INKSCAPE.use_gui();
+    if (gui && (pixbuf->get_width() > 256 || pixbuf->get_height() > 256)) {
         char *msg = _("Image looks too big. Process may take a while and it is"
                       " wise to save your document before continuing."
                       "\n\nContinue the procedure (without saving)?");
@@ -94,6 +89,7 @@ std::vector<TracingEngineResult> DepixelizeTracingEngine::trace(Glib::RefPtr<Gdk
 
     ::Tracer::Splines splines;
 
+    params->nthreads = threads;
     if (traceType == TRACE_VORONOI)
         splines = ::Tracer::Kopf2011::to_voronoi(pixbuf, *params);
     else
@@ -112,7 +108,9 @@ std::vector<TracingEngineResult> DepixelizeTracingEngine::trace(Glib::RefPtr<Gdk
         osalpha << float(it->rgba[3]) / 255.;
         gchar* style = g_strdup_printf("fill:%s;fill-opacity:%s;", b, osalpha.str().c_str());
         printf("%s\n", style);
-        TracingEngineResult r(style, sp_svg_write_path(it->pathVector), count_pathvector_nodes(it->pathVector));
+        Inkscape::SVG::PathString d(pathStringSettings);
+        sp_svg_write_path(d, it->pathVector);
+        TracingEngineResult r(style, d.release(), count_pathvector_nodes(it->pathVector));
         res.push_back(r);
         g_free(style);
     }
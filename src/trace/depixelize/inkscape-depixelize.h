@@ -17,9 +17,6 @@
 #include <trace/trace.h>
 #include "3rdparty/libdepixelize/kopftracer2011.h"
 
-struct GrayMap_def;
-typedef GrayMap_def GrayMap;
-
 namespace Inkscape {
 
 namespace Trace {
@@ -11,8 +11,18 @@
  * Released under GNU GPL v2+, read the file 'COPYING' for more information.
  */
 
+#ifdef HAVE_CONFIG_H
+# include "config.h"  // only include where actually required!
+#endif
+
+#if HAVE_OPENMP
+#include <omp.h>
+#endif // HAVE_OPENMP
+
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
+#include <vector>
 
 #include "imagemap-gdk.h"
 #include "filterset.h"
@@ -23,60 +33,98 @@
 #########################################################################*/
 
 /**
+ * 5x5 Gaussian kernel, divided by 159:
  *
+ *     2,  4,  5,  4, 2,
+ *     4,  9, 12,  9, 4,
+ *     5, 12, 15, 12, 5,
+ *     4,  9, 12,  9, 4,
+ *     2,  4,  5,  4, 2
+ *
+ * It is not separable, but it is symmetric: every column of it is
+ * a combination of the sums a = p[y-2] + p[y+2], b = p[y-1] + p[y+1]
+ * and c = p[y] of a column of pixels.  A vertical pass computes, for
+ * every column, its weighted sum for the kernel columns at distance 2, 1
+ * and 0 from the center; a horizontal pass then adds five of them.  The
+ * integer sums are the same as the full 5x5 convolution.
  */
-static int gaussMatrix[] =
+static inline void gaussColumn(int a, int b, int c, int *v0, int *v1, int *v2)
 {
-     2,  4,  5,  4, 2,
-     4,  9, 12,  9, 4,
-     5, 12, 15, 12, 5,
-     4,  9, 12,  9, 4,
-     2,  4,  5,  4, 2
-};
+    *v2 = 2 * a +  4 * b +  5 * c;
+    *v1 = 4 * a +  9 * b + 12 * c;
+    *v0 = 5 * a + 12 * b + 15 * c;
+}
 
 
 /**
- *
+ * Smooth the rows of a map of n channels of type T, stored as
+ * width * n consecutive values per row.
  */
-GrayMap *grayMapGaussian(GrayMap *me)
+template <typename Map, typename T, int n>
+static void gaussianRows(Map const &me, Map &out, int numThreads)
 {
-    int width  = me->width;
-    int height = me->height;
-    int firstX = 2;
-    int lastX  = width-3;
-    int firstY = 2;
-    int lastY  = height-3;
-
-    GrayMap *newGm = GrayMapCreate(width, height);
-    if (!newGm)
-        return nullptr;
-
+    int width  = me.width();
+    int height = me.height();
+    int len    = width * n;
+
+#if HAVE_OPENMP
+#pragma omp parallel num_threads(numThreads)
+#endif // HAVE_OPENMP
+    {
+    /* column sums of the vertical pass, reused for every row of a thread */
+    std::vector<int> v0(len), v1(len), v2(len);
+
+#if HAVE_OPENMP
+#pragma omp for schedule(static)
+#endif // HAVE_OPENMP
     for (int y = 0 ; y<height ; y++)
         {
-        for (int x = 0 ; x<width ; x++)
+        T const *in = reinterpret_cast<T const *>(me.row(y));
+        T *dst = reinterpret_cast<T *>(out.row(y));
+
+        /* image boundaries */
+        if (y<2 || y>height-3 || width<5)
             {
-	    /* image boundaries */
-            if (x<firstX || x>lastX || y<firstY || y>lastY)
-                {
-                newGm->setPixel(newGm, x, y, me->getPixel(me, x, y));
-                continue;
-                }
+            std::copy(in, in + len, dst);
+            continue;
+            }
 
-            /* all other pixels */
-            int gaussIndex = 0;
-            unsigned long sum = 0;
-            for (int i= y-2 ; i<=y+2 ; i++)
-                {
-                for (int j= x-2; j<=x+2 ; j++)
-                    {
-                    int weight = gaussMatrix[gaussIndex++];
-                    sum += me->getPixel(me, j, i) * weight;
-		    }
-	        }
-            sum /= 159;
-	    newGm->setPixel(newGm, x, y, sum);
-	    }
-	}
+        T const *up2   = reinterpret_cast<T const *>(me.row(y-2));
+        T const *up1   = reinterpret_cast<T const *>(me.row(y-1));
+        T const *down1 = reinterpret_cast<T const *>(me.row(y+1));
+        T const *down2 = reinterpret_cast<T const *>(me.row(y+2));
+
+        /* vertical pass */
+        for (int i = 0 ; i<len ; i++)
+            {
+            gaussColumn(up2[i] + down2[i], up1[i] + down1[i], in[i], &v0[i], &v1[i], &v2[i]);
+            }
+
+        /* horizontal pass, all other pixels */
+        for (int i = 2*n ; i<len-2*n ; i++)
+            {
+            int sum = v2[i-2*n] + v1[i-n] + v0[i] + v1[i+n] + v2[i+2*n];
+            dst[i] = sum / 159;
+            }
+
+        /* image boundaries */
+        std::copy(in, in + 2*n, dst);
+        std::copy(in + len - 2*n, in + len, dst + len - 2*n);
+        }
+    }
+}
+
+
+/**
+ *
+ */
+std::unique_ptr<GrayMap> grayMapGaussian(GrayMap const &me, int numThreads)
+{
+    auto newGm = GrayMapCreate(me.width(), me.height());
+    if (!newGm)
+        return nullptr;
+
+    gaussianRows<GrayMap, unsigned short, 1>(me, *newGm, numThreads);
 
     return newGm;
 }
@@ -88,53 +136,15 @@ GrayMap *grayMapGaussian(GrayMap *me)
 /**
  *
  */
-RgbMap *rgbMapGaussian(RgbMap *me)
+std::unique_ptr<RgbMap> rgbMapGaussian(RgbMap const &me, int numThreads)
 {
-    int width  = me->width;
-    int height = me->height;
-    int firstX = 2;
-    int lastX  = width-3;
-    int firstY = 2;
-    int lastY  = height-3;
-
-    RgbMap *newGm = RgbMapCreate(width, height);
+    static_assert(sizeof(RGB) == 3, "RGB pixels must be three consecutive bytes");
+
+    auto newGm = RgbMapCreate(me.width(), me.height());
     if (!newGm)
         return nullptr;
 
-    for (int y = 0 ; y<height ; y++)
-        {
-        for (int x = 0 ; x<width ; x++)
-            {
-	    /* image boundaries */
-            if (x<firstX || x>lastX || y<firstY || y>lastY)
-                {
-                newGm->setPixelRGB(newGm, x, y, me->getPixel(me, x, y));
-                continue;
-                }
-
-            /* all other pixels */
-            int gaussIndex = 0;
-            int sumR       = 0;
-            int sumG       = 0;
-            int sumB       = 0;
-            for (int i= y-2 ; i<=y+2 ; i++)
-                {
-                for (int j= x-2; j<=x+2 ; j++)
-                    {
-                    int weight = gaussMatrix[gaussIndex++];
-                    RGB rgb = me->getPixel(me, j, i);
-                    sumR += weight * (int)rgb.r;
-                    sumG += weight * (int)rgb.g;
-                    sumB += weight * (int)rgb.b;
-		    }
-	        }
-            RGB rout;
-            rout.r = ( sumR / 159 ) & 0xff;
-            rout.g = ( sumG / 159 ) & 0xff;
-            rout.b = ( sumB / 159 ) & 0xff;
-	    newGm->setPixelRGB(newGm, x, y, rout);
-	    }
-	}
+    gaussianRows<RgbMap, unsigned char, 3>(me, *newGm, numThreads);
 
     return newGm;
 
@@ -148,41 +158,49 @@ RgbMap *rgbMapGaussian(RgbMap *me)
 #########################################################################*/
 
 
-static int sobelX[] =
-{
-    -1,  0,  1 ,
-    -2,  0,  2 ,
-    -1,  0,  1 
-};
-
-static int sobelY[] =
-{
-     1,  2,  1 ,
-     0,  0,  0 ,
-    -1, -2, -1 
-};
+/*
+ * Sobel kernels, applied as sums of differences:
+ *
+ *     X:  -1,  0,  1        Y:   1,  2,  1
+ *         -2,  0,  2             0,  0,  0
+ *         -1,  0,  1            -1, -2, -1
+ */
 
 
 
 /**
  * Perform Sobel convolution on a GrayMap
  */
-static GrayMap *grayMapSobel(GrayMap *gm, 
-               double dLowThreshold, double dHighThreshold)
+static std::unique_ptr<GrayMap> grayMapSobel(GrayMap const &gm,
+               double dLowThreshold, double dHighThreshold, int numThreads)
 {
-    int width  = gm->width;
-    int height = gm->height;
+    int width  = gm.width();
+    int height = gm.height();
     int firstX = 1;
     int lastX  = width-2;
     int firstY = 1;
     int lastY  = height-2;
 
-    GrayMap *newGm = GrayMapCreate(width, height);
+    auto newGm = GrayMapCreate(width, height);
     if (!newGm)
         return nullptr;
 
+    unsigned long highThreshold = (unsigned long)(dHighThreshold * 765.0);
+    unsigned long lowThreshold  = (unsigned long)(dLowThreshold * 765.0);
+
+    /* every output row only reads the input map */
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(static) num_threads(numThreads)
+#endif // HAVE_OPENMP
     for (int y = 0 ; y<height ; y++)
         {
+        /* rows above, at and below y; only used away from the boundaries */
+        bool inside = y >= firstY && y <= lastY;
+        unsigned short const *up   = inside ? gm.row(y-1) : nullptr;
+        unsigned short const *cur  = gm.row(y);
+        unsigned short const *down = inside ? gm.row(y+1) : nullptr;
+        unsigned short *out = newGm->row(y);
+
         for (int x = 0 ; x<width ; x++)
             {
             unsigned long sum = 0;
@@ -194,27 +212,11 @@ static GrayMap *grayMapSobel(GrayMap *gm,
             else
                 {
                 /* ### SOBEL FILTERING #### */
-                long sumX = 0;
-                long sumY = 0;
-                int sobelIndex = 0;
-                for (int i= y-1 ; i<=y+1 ; i++)
-                    {
-                    for (int j= x-1; j<=x+1 ; j++)
-                        {
-                        sumX += gm->getPixel(gm, j, i) * 
-                             sobelX[sobelIndex++];
-		        }
-	            }
-
-                sobelIndex = 0;
-                for (int i= y-1 ; i<=y+1 ; i++)
-                    {
-                    for (int j= x-1; j<=x+1 ; j++)
-                        {
-                        sumY += gm->getPixel(gm, j, i) * 
-                             sobelY[sobelIndex++];
-		        }
-	            }
+                long sumX = (long)(up[x+1] - up[x-1])
+                          + 2 * (long)(cur[x+1] - cur[x-1])
+                          + (long)(down[x+1] - down[x-1]);
+                long sumY = (long)(up[x-1] + 2 * up[x] + up[x+1])
+                          - (long)(down[x-1] + 2 * down[x] + down[x+1]);
                 /*###  GET VALUE ### */
                 sum = abs(sumX) + abs(sumY);
 
@@ -281,23 +283,23 @@ static GrayMap *grayMapSobel(GrayMap *gm,
                 unsigned long rightPixel;
                 if (edgeDirection == 0)
                     {
-                    leftPixel  = gm->getPixel(gm, x-1, y);
-                    rightPixel = gm->getPixel(gm, x+1, y);
+                    leftPixel  = cur[x-1];
+                    rightPixel = cur[x+1];
                     }
                 else if (edgeDirection == 45)
                     {
-                    leftPixel  = gm->getPixel(gm, x-1, y+1);
-                    rightPixel = gm->getPixel(gm, x+1, y-1);
+                    leftPixel  = down[x-1];
+                    rightPixel = up[x+1];
                     }
                 else if (edgeDirection == 90)
                     {
-                    leftPixel  = gm->getPixel(gm, x, y-1);
-                    rightPixel = gm->getPixel(gm, x, y+1);
+                    leftPixel  = up[x];
+                    rightPixel = down[x];
                     }
                 else /*135 */
                     {
-                    leftPixel  = gm->getPixel(gm, x-1, y-1);
-                    rightPixel = gm->getPixel(gm, x+1, y+1);
+                    leftPixel  = up[x-1];
+                    rightPixel = down[x+1];
                     }
 
                 /*### Compare current value to adjacent pixels ### */
@@ -306,24 +308,20 @@ static GrayMap *grayMapSobel(GrayMap *gm,
                     sum = 0;
                 else
                     {
-                    unsigned long highThreshold = 
-                          (unsigned long)(dHighThreshold * 765.0);
-                    unsigned long lowThreshold = 
-                          (unsigned long)(dLowThreshold * 765.0);
                     if (sum >= highThreshold)
                         sum = 765; /* EDGE.  3*255 this needs to be settable */
                     else if (sum < lowThreshold)
                         sum = 0; /* NONEDGE */
                     else
                         {
-                        if ( gm->getPixel(gm, x-1, y-1)> highThreshold ||
-                             gm->getPixel(gm, x  , y-1)> highThreshold ||
-                             gm->getPixel(gm, x+1, y-1)> highThreshold ||
-                             gm->getPixel(gm, x-1, y  )> highThreshold ||
-                             gm->getPixel(gm, x+1, y  )> highThreshold ||
-                             gm->getPixel(gm, x-1, y+1)> highThreshold ||
-                             gm->getPixel(gm, x  , y+1)> highThreshold ||
-                             gm->getPixel(gm, x+1, y+1)> highThreshold)
+                        if ( up[x-1]   > highThreshold ||
+                             up[x]     > highThreshold ||
+                             up[x+1]   > highThreshold ||
+                             cur[x-1]  > highThreshold ||
+                             cur[x+1]  > highThreshold ||
+                             down[x-1] > highThreshold ||
+                             down[x]   > highThreshold ||
+                             down[x+1] > highThreshold)
                             sum = 765; /* EDGE fix me too */
                         else
                             sum = 0; /* NONEDGE */
@@ -336,7 +334,7 @@ static GrayMap *grayMapSobel(GrayMap *gm,
                 sum = 765;
             else
                 sum = 0;
-            newGm->setPixel(newGm, x, y, sum);
+            out[x] = sum;
 	    }/* for (x) */
 	}/* for (y) */
 
@@ -350,16 +348,13 @@ static GrayMap *grayMapSobel(GrayMap *gm,
 /**
  *
  */
-GrayMap *
-grayMapCanny(GrayMap *gm, double lowThreshold, double highThreshold)
+std::unique_ptr<GrayMap>
+grayMapCanny(GrayMap const &gm, double lowThreshold, double highThreshold, int numThreads)
 {
-    if (!gm)
-        return nullptr;
-
-    GrayMap *cannyGm = grayMapSobel(gm, lowThreshold, highThreshold);
+    auto cannyGm = grayMapSobel(gm, lowThreshold, highThreshold, numThreads);
     if (!cannyGm)
         return nullptr;
-    /*cannyGm->writePPM(cannyGm, "canny.ppm");*/
+    /*writePPM(*cannyGm, "canny.ppm");*/
 
     return cannyGm;
 }
@@ -373,42 +368,42 @@ grayMapCanny(GrayMap *gm, double lowThreshold, double highThreshold)
 /**
  *  Experimental.  Work on this later
  */
-GrayMap *quantizeBand(RgbMap *rgbMap, int nrColors)
+std::unique_ptr<GrayMap> quantizeBand(RgbMap const &rgbMap, int nrColors, int numThreads)
 {
 
-    RgbMap *gaussMap = rgbMapGaussian(rgbMap);
+    auto gaussMap = rgbMapGaussian(rgbMap, numThreads);
     if (!gaussMap)
         return nullptr;
-    //gaussMap->writePPM(gaussMap, "rgbgauss.ppm");
+    //writePPM(*gaussMap, "rgbgauss.ppm");
 
-    IndexedMap *qMap = rgbMapQuantize(gaussMap, nrColors);
-    gaussMap->destroy(gaussMap);
+    auto qMap = rgbMapQuantize(*gaussMap, nrColors, numThreads);
+    gaussMap.reset();
     if (!qMap)
         return nullptr;
-    //qMap->writePPM(qMap, "rgbquant.ppm");
+    //writePPM(*qMap, "rgbquant.ppm");
 
-    GrayMap *gm = GrayMapCreate(rgbMap->width, rgbMap->height);
+    auto gm = GrayMapCreate(rgbMap.width(), rgbMap.height());
     if (!gm)
         return nullptr;
 
     // RGB is quantized.  There should now be a small set of (R+G+B)
-    for (int y=0 ; y<qMap->height ; y++)
+    for (int y=0 ; y<qMap->height() ; y++)
         {
-        for (int x=0 ; x<qMap->width ; x++)
+        unsigned char const *in = qMap->row(y);
+        unsigned short *out = gm->row(y);
+        for (int x=0 ; x<qMap->width() ; x++)
             {
-            RGB rgb = qMap->getPixelValue(qMap, x, y);
+            RGB rgb = qMap->clut[in[x]];
             int sum = rgb.r + rgb.g + rgb.b;
             if (sum & 1)
                 sum = 765;
             else
                 sum = 0;
-	    // printf("%d %d %d : %d\n", rgb.r, rgb.g, rgb.b, index);
-            gm->setPixel(gm, x, y, sum);
+            // printf("%d %d %d : %d\n", rgb.r, rgb.g, rgb.b, index);
+            out[x] = sum;
             }
         }
 
-    qMap->destroy(qMap);
-
     return gm;
 }
 
@@ -18,36 +18,31 @@
 
 #include <gdk-pixbuf/gdk-pixbuf.h>
 
-#ifdef __cplusplus
-extern "C" {
-#endif
+/*
+ * The filters work on numThreads threads, which callers read from the
+ * preferences beforehand: they may run on threads that must not.
+ */
 
 /**
  *  Apply gaussian blur to an GrayMap
  */
-GrayMap *grayMapGaussian(GrayMap *gmap);
+std::unique_ptr<GrayMap> grayMapGaussian(GrayMap const &gmap, int numThreads = 1);
 
 /**
  *  Apply gaussian bluf to an RgbMap
  */
-RgbMap *rgbMapGaussian(RgbMap *rgbmap);
+std::unique_ptr<RgbMap> rgbMapGaussian(RgbMap const &rgbmap, int numThreads = 1);
 
 /**
  *
  */
-GrayMap *grayMapCanny(GrayMap *gmap,
-             double lowThreshold, double highThreshold);
+std::unique_ptr<GrayMap> grayMapCanny(GrayMap const &gmap,
+             double lowThreshold, double highThreshold, int numThreads = 1);
 
 /**
  *
  */
-GrayMap *quantizeBand(RgbMap *rgbmap, int nrColors);
-
-
-
-#ifdef __cplusplus
-}
-#endif
+std::unique_ptr<GrayMap> quantizeBand(RgbMap const &rgbmap, int nrColors, int numThreads = 1);
 
 
 #endif /* __FILTERSET_H__ */
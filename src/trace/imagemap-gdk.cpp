@@ -12,11 +12,30 @@
 #include "imagemap-gdk.h"
 
 
+/**
+ * Allocate an RGB pixbuf of the given size, owning its pixel data.
+ */
+static GdkPixbuf *newRgbPixbuf(int width, int height, char const *caller)
+{
+    guchar *pixdata = (guchar *)
+          malloc(sizeof(guchar) * width * height * 3);
+    if (!pixdata)
+        {
+        g_warning("%s: can not allocate memory for conversion.", caller);
+        return nullptr;
+        }
+
+    return gdk_pixbuf_new_from_data(pixdata, GDK_COLORSPACE_RGB,
+                        0, 8, width, height,
+                        width * 3, (GdkPixbufDestroyNotify)g_free, nullptr);
+}
+
+
 /*#########################################################################
 ## G R A Y M A P
 #########################################################################*/
 
-GrayMap *gdkPixbufToGrayMap(GdkPixbuf *buf)
+std::unique_ptr<GrayMap> gdkPixbufToGrayMap(GdkPixbuf *buf)
 {
     if (!buf)
         return nullptr;
@@ -27,64 +46,49 @@ GrayMap *gdkPixbufToGrayMap(GdkPixbuf *buf)
     int rowstride   = gdk_pixbuf_get_rowstride(buf);
     int n_channels  = gdk_pixbuf_get_n_channels(buf);
 
-    GrayMap *grayMap = GrayMapCreate(width, height);
+    auto grayMap = GrayMapCreate(width, height);
     if (!grayMap)
         return nullptr;
 
     //### Fill in the odd cells with RGB values
-    int x,y;
-    int row  = 0;
-    for (y=0 ; y<height ; y++)
+    for (int y=0 ; y<height ; y++)
         {
-        guchar *p = pixdata + row;
-        for (x=0 ; x<width ; x++)
+        guchar const *p = pixdata + y * rowstride;
+        unsigned short *out = grayMap->row(y);
+        for (int x=0 ; x<width ; x++)
             {
             int alpha = (int)p[3];
             int white = 3 * (255-alpha);
             unsigned long sample = (int)p[0] + (int)p[1] +(int)p[2];
             unsigned long bright = sample * alpha / 256 + white;
-            grayMap->setPixel(grayMap, x, y, bright);
+            out[x] = bright;
             p += n_channels;
             }
-        row += rowstride;
         }
 
     return grayMap;
 }
 
-GdkPixbuf *grayMapToGdkPixbuf(GrayMap *grayMap)
+GdkPixbuf *grayMapToGdkPixbuf(GrayMap const &grayMap)
 {
-    if (!grayMap)
-        return nullptr;
-
-    guchar *pixdata = (guchar *)
-          malloc(sizeof(guchar) * grayMap->width * grayMap->height * 3);
-    if (!pixdata)
-        {
-        g_warning("grayMapToGdkPixbuf: can not allocate memory for conversion.");
+    GdkPixbuf *buf = newRgbPixbuf(grayMap.width(), grayMap.height(), "grayMapToGdkPixbuf");
+    if (!buf)
         return nullptr;
-        }
-
-    int n_channels = 3;
-    int rowstride  = grayMap->width * 3;
 
-    GdkPixbuf *buf = gdk_pixbuf_new_from_data(pixdata, GDK_COLORSPACE_RGB,
-                        0, 8, grayMap->width, grayMap->height,
-                        rowstride, (GdkPixbufDestroyNotify)g_free, nullptr);
+    guchar *pixdata = gdk_pixbuf_get_pixels(buf);
+    int rowstride   = gdk_pixbuf_get_rowstride(buf);
 
     //### Fill in the odd cells with RGB values
-    int x,y;
-    int row  = 0;
-    for (y=0 ; y<grayMap->height ; y++)
+    for (int y=0 ; y<grayMap.height() ; y++)
         {
-        guchar *p = pixdata + row;
-        for (x=0 ; x<grayMap->width ; x++)
+        guchar *p = pixdata + y * rowstride;
+        unsigned short const *in = grayMap.row(y);
+        for (int x=0 ; x<grayMap.width() ; x++)
             {
-            unsigned long pix = grayMap->getPixel(grayMap, x, y) / 3;
+            unsigned long pix = in[x] / 3;
             p[0] = p[1] = p[2] = (guchar)(pix & 0xff);
-            p += n_channels;
+            p += 3;
             }
-        row += rowstride;
         }
 
     return buf;
@@ -95,39 +99,46 @@ GdkPixbuf *grayMapToGdkPixbuf(GrayMap *grayMap)
 ## R G B   M A P
 #########################################################################*/
 
-RgbMap *gdkPixbufToRgbMap(GdkPixbuf *buf)
+std::unique_ptr<RgbMap> gdkPixbufToRgbMap(GdkPixbuf *buf)
+{
+    if (!buf)
+        return nullptr;
+
+    return gdkPixbufToRgbMap(buf, 0, gdk_pixbuf_get_height(buf));
+}
+
+/**
+ * Convert the rows y0 to y1 (excluded) of buf, for images that are
+ * processed in stripes.
+ */
+std::unique_ptr<RgbMap> gdkPixbufToRgbMap(GdkPixbuf *buf, int y0, int y1)
 {
     if (!buf)
         return nullptr;
 
     int width       = gdk_pixbuf_get_width(buf);
-    int height      = gdk_pixbuf_get_height(buf);
     guchar *pixdata = gdk_pixbuf_get_pixels(buf);
     int rowstride   = gdk_pixbuf_get_rowstride(buf);
     int n_channels  = gdk_pixbuf_get_n_channels(buf);
 
-    RgbMap *rgbMap = RgbMapCreate(width, height);
+    auto rgbMap = RgbMapCreate(width, y1 - y0);
     if (!rgbMap)
         return nullptr;
 
     //### Fill in the cells with RGB values
-    int x,y;
-    int row  = 0;
-    for (y=0 ; y<height ; y++)
+    for (int y=y0 ; y<y1 ; y++)
         {
-        guchar *p = pixdata + row;
-        for (x=0 ; x<width ; x++)
+        guchar const *p = pixdata + (gsize)y * rowstride;
+        RGB *out = rgbMap->row(y - y0);
+        for (int x=0 ; x<width ; x++)
             {
             int alpha = (int)p[3];
             int white = 255 - alpha;
-            int r     = (int)p[0];  r = r * alpha / 256 + white;
-            int g     = (int)p[1];  g = g * alpha / 256 + white;
-            int b     = (int)p[2];  b = b * alpha / 256 + white;
-
-            rgbMap->setPixel(rgbMap, x, y, r, g, b);
+            out[x].r = (int)p[0] * alpha / 256 + white;
+            out[x].g = (int)p[1] * alpha / 256 + white;
+            out[x].b = (int)p[2] * alpha / 256 + white;
             p += n_channels;
             }
-        row += rowstride;
         }
 
     return rgbMap;
@@ -140,41 +151,28 @@ RgbMap *gdkPixbufToRgbMap(GdkPixbuf *buf)
 #########################################################################*/
 
 
-GdkPixbuf *indexedMapToGdkPixbuf(IndexedMap *iMap)
+GdkPixbuf *indexedMapToGdkPixbuf(IndexedMap const &iMap)
 {
-    if (!iMap)
-        return nullptr;
-
-    guchar *pixdata = (guchar *)
-          malloc(sizeof(guchar) * iMap->width * iMap->height * 3);
-    if (!pixdata)
-        {
-        g_warning("indexedMapToGdkPixbuf: can not allocate memory for conversion.");
+    GdkPixbuf *buf = newRgbPixbuf(iMap.width(), iMap.height(), "indexedMapToGdkPixbuf");
+    if (!buf)
         return nullptr;
-        }
-
-    int n_channels = 3;
-    int rowstride  = iMap->width * 3;
 
-    GdkPixbuf *buf = gdk_pixbuf_new_from_data(pixdata, GDK_COLORSPACE_RGB,
-                        0, 8, iMap->width, iMap->height,
-                        rowstride, (GdkPixbufDestroyNotify)g_free, nullptr);
+    guchar *pixdata = gdk_pixbuf_get_pixels(buf);
+    int rowstride   = gdk_pixbuf_get_rowstride(buf);
 
     //### Fill in the cells with RGB values
-    int x,y;
-    int row  = 0;
-    for (y=0 ; y<iMap->height ; y++)
+    for (int y=0 ; y<iMap.height() ; y++)
         {
-        guchar *p = pixdata + row;
-        for (x=0 ; x<iMap->width ; x++)
+        guchar *p = pixdata + y * rowstride;
+        unsigned char const *in = iMap.row(y);
+        for (int x=0 ; x<iMap.width() ; x++)
             {
-            RGB rgb = iMap->getPixelValue(iMap, x, y);
-            p[0] = rgb.r & 0xff;
-            p[1] = rgb.g & 0xff;
-            p[2] = rgb.b & 0xff;
-            p += n_channels;
+            RGB rgb = iMap.clut[in[x]];
+            p[0] = rgb.r;
+            p[1] = rgb.g;
+            p[2] = rgb.b;
+            p += 3;
             }
-        row += rowstride;
         }
 
     return buf;
@@ -10,14 +10,6 @@
 #ifndef __GRAYMAP_GDK_H__
 #define __GRAYMAP_GDK_H__
 
-#ifndef TRUE
-#define TRUE  1
-#endif
-
-#ifndef FALSE
-#define FALSE 0
-#endif
-
 #include "imagemap.h"
 
 #include <gdk-pixbuf/gdk-pixbuf.h>
@@ -28,19 +20,11 @@
 
 
 
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-GrayMap *gdkPixbufToGrayMap(GdkPixbuf *buf);
-GdkPixbuf *grayMapToGdkPixbuf(GrayMap *grayMap);
-RgbMap *gdkPixbufToRgbMap(GdkPixbuf *buf);
-GdkPixbuf *indexedMapToGdkPixbuf(IndexedMap *iMap);
-
-
-#ifdef __cplusplus
-}
-#endif
+std::unique_ptr<GrayMap> gdkPixbufToGrayMap(GdkPixbuf *buf);
+GdkPixbuf *grayMapToGdkPixbuf(GrayMap const &grayMap);
+std::unique_ptr<RgbMap> gdkPixbufToRgbMap(GdkPixbuf *buf);
+std::unique_ptr<RgbMap> gdkPixbufToRgbMap(GdkPixbuf *buf, int y0, int y1);
+GdkPixbuf *indexedMapToGdkPixbuf(IndexedMap const &iMap);
 
 
 #endif /* __GRAYMAP_GDK_H__ */
@@ -1,353 +1,110 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 /** @file
- * TODO: insert short description here
+ * Image containers used by the bitmap tracers.
  *//*
  * Authors: see git history
  *
  * Copyright (C) 2018 Authors
  * Released under GNU GPL v2+, read the file 'COPYING' for more information.
  */
-#include <cstdlib>
+#include <cstdio>
+#include <glib.h>
 
 #include "imagemap.h"
 
-#include "io/sys.h"
-
-/*#########################################################################
-### G R A Y   M A P
-#########################################################################*/
-
-
-static void gSetPixel(GrayMap *me, int x, int y, unsigned long val)
-{
-    if (val>765)
-        val = 765;
-    unsigned long *pix = me->rows[y] + x;
-    *pix = val;
-}
-
-static unsigned long gGetPixel(GrayMap *me, int x, int y)
-{
-    unsigned long *pix = me->rows[y] + x;
-    return *pix;
-}
-
-
-static int gWritePPM(GrayMap *me, char *fileName)
-{
-    if (!fileName)
-        return FALSE;
-
-    FILE *f = fopen(fileName, "wb");
-    if (!f)
-        return FALSE;
-
-    fprintf(f, "P6 %d %d 255\n", me->width, me->height);
-
-    for (int y=0 ; y<me->height; y++)
-        {
-        for (int x=0 ; x<me->width ; x++)
-            {
-            unsigned long pix  = me->getPixel(me, x, y) / 3;
-            unsigned char pixb = (unsigned char) (pix & 0xff);
-            fputc(pixb, f);
-            fputc(pixb, f);
-            fputc(pixb, f);
-            }
-        }
-    fclose(f);
-    return TRUE;
-}
-
-
-static void gDestroy(GrayMap *me)
-{
-    if (me->pixels)
-        free(me->pixels);
-    if (me->rows)
-        free(me->rows);
-    free(me);
-}
-
-GrayMap *GrayMapCreate(int width, int height)
+/**
+ * Allocate a map, warning and returning nullptr if there is not
+ * enough memory for its pixels.
+ */
+template <typename Map>
+static std::unique_ptr<Map> createMap(char const *name, int width, int height)
 {
-
-    GrayMap *me = (GrayMap *)malloc(sizeof(GrayMap));
-    if (!me)
+    std::unique_ptr<Map> me(new (std::nothrow) Map(width, height));
+    if (!me || !me->valid()) {
+        g_warning("%s: can not allocate memory for %d x %d image.", name, width, height);
         return nullptr;
-
-    /** methods **/
-    me->setPixel    = gSetPixel;
-    me->getPixel    = gGetPixel;
-    me->writePPM    = gWritePPM;
-    me->destroy     = gDestroy;
-
-    /** fields **/
-    me->width  = width;
-    me->height = height;
-    me->pixels = (unsigned long *)
-              malloc(sizeof(unsigned long) * width * height);
-    if (!me->pixels)
-        {
-        g_warning("GrayMapCreate: can not allocate memory for %d x %d image.", width, height);
-        free(me);
-        return nullptr;
-        }
-    me->rows = (unsigned long **)
-              malloc(sizeof(unsigned long *) *  height);
-    if (!me->rows)
-        {
-        g_warning("GrayMapCreate: can not allocate memory for index of %d x %d image.", width, height);
-        free(me->pixels);
-        free(me);
-        return nullptr;
-        }
-
-    unsigned long *row = me->pixels;
-    for (int i=0 ; i<height ; i++)
-        {
-        me->rows[i] = row;
-        row += width;
-        }
-
+    }
     return me;
 }
 
-
-
-/*#########################################################################
-### R G B      M A P
-#########################################################################*/
-
-
-
-static void rSetPixel(RgbMap *me, int x, int y, int r, int g, int b)
-{
-    RGB *pix = me->rows[y] + x;
-    pix->r = r;
-    pix->g = g;
-    pix->b = b;
-}
-
-static void rSetPixelRGB(RgbMap *me, int x, int y, RGB rgb)
-{
-    RGB *pix = me->rows[y] + x;
-    *pix = rgb;
-}
-
-static RGB rGetPixel(RgbMap *me, int x, int y)
-{
-    RGB *pix = me->rows[y] + x;
-    return *pix;
-}
-
-
-
-static int rWritePPM(RgbMap *me, char *fileName)
+/**
+ * Write a map as a binary PPM file, using toRGB to get the color of
+ * each pixel.
+ */
+template <typename Map, typename ToRGB>
+static bool writeMapPPM(Map const &map, char const *fileName, ToRGB toRGB)
 {
     if (!fileName)
-        return FALSE;
+        return false;
 
     FILE *f = fopen(fileName, "wb");
     if (!f)
-        return FALSE;
+        return false;
 
-    fprintf(f, "P6 %d %d 255\n", me->width, me->height);
+    fprintf(f, "P6 %d %d 255\n", map.width(), map.height());
 
-    for (int y=0 ; y<me->height; y++)
-        {
-        for (int x=0 ; x<me->width ; x++)
-            {
-            RGB rgb = me->getPixel(me, x, y);
+    for (int y = 0; y < map.height(); y++) {
+        auto row = map.row(y);
+        for (int x = 0; x < map.width(); x++) {
+            RGB rgb = toRGB(row[x]);
             fputc(rgb.r, f);
             fputc(rgb.g, f);
             fputc(rgb.b, f);
-            }
         }
+    }
     fclose(f);
-    return TRUE;
+    return true;
 }
 
 
-static void rDestroy(RgbMap *me)
+/*#########################################################################
+### G R A Y   M A P
+#########################################################################*/
+
+std::unique_ptr<GrayMap> GrayMapCreate(int width, int height)
 {
-    if (me->pixels){
-        free(me->pixels);
-    }
-    if (me->rows){
-        free(me->rows);
-    }
-    free(me);
+    return createMap<GrayMap>("GrayMapCreate", width, height);
 }
 
-
-
-RgbMap *RgbMapCreate(int width, int height)
+bool writePPM(GrayMap const &map, char const *fileName)
 {
-
-    RgbMap *me = (RgbMap *)malloc(sizeof(RgbMap));
-    if (!me){
-        return nullptr;
-    }
-    
-    /** methods **/
-    me->setPixel    = rSetPixel;
-    me->setPixelRGB = rSetPixelRGB;
-    me->getPixel    = rGetPixel;
-    me->writePPM    = rWritePPM;
-    me->destroy     = rDestroy;
-
-
-    /** fields **/
-    me->width  = width;
-    me->height = height;
-    me->pixels = (RGB *) malloc(sizeof(RGB) * width * height);
-    if (!me->pixels){
-        g_warning("RgbMapCreate: can not allocate memory for %d x %d image.", width, height);
-        free(me);
-        return nullptr;
-    }
-    me->rows = (RGB **) malloc(sizeof(RGB *) * height);
-    if (!me->rows){
-        g_warning("RgbMapCreate: can not allocate memory for index of %d x %d image.", width, height);
-        free(me->pixels); //allocated as me->pixels is not NULL here: see previous check
-        free(me);
-        return nullptr;
-    }
-
-    RGB *row = me->pixels;
-    for (int i=0 ; i<height ; i++){
-        me->rows[i] = row;
-        row += width;
-    }
-
-    return me;
+    return writeMapPPM(map, fileName, [](unsigned short pix) {
+        unsigned char pixb = (unsigned char)((pix / 3) & 0xff);
+        return RGB{pixb, pixb, pixb};
+    });
 }
 
 
-
-
 /*#########################################################################
-### I N D E X E D      M A P
+### R G B      M A P
 #########################################################################*/
 
-
-
-static void iSetPixel(IndexedMap *me, int x, int y, unsigned int index)
+std::unique_ptr<RgbMap> RgbMapCreate(int width, int height)
 {
-    unsigned int *pix = me->rows[y] + x;
-    *pix = index;
+    return createMap<RgbMap>("RgbMapCreate", width, height);
 }
 
-
-static unsigned int iGetPixel(IndexedMap *me, int x, int y)
+bool writePPM(RgbMap const &map, char const *fileName)
 {
-    unsigned int *pix = me->rows[y] + x;
-    return *pix;
+    return writeMapPPM(map, fileName, [](RGB rgb) { return rgb; });
 }
 
-static RGB iGetPixelValue(IndexedMap *me, int x, int y)
-{
-    unsigned int *pix = me->rows[y] + x;
-    RGB rgb = me->clut[((*pix)&0xff)];
-    return rgb;
-}
-
-
-
-static int iWritePPM(IndexedMap *me, char *fileName)
-{
-    if (!fileName)
-        return FALSE;
-
-    FILE *f = fopen(fileName, "wb");
-    if (!f)
-        return FALSE;
-
-    fprintf(f, "P6 %d %d 255\n", me->width, me->height);
-
-    for (int y=0 ; y<me->height; y++)
-        {
-        for (int x=0 ; x<me->width ; x++)
-            {
-            RGB rgb = me->getPixelValue(me, x, y);
-            fputc(rgb.r, f);
-            fputc(rgb.g, f);
-            fputc(rgb.b, f);
-            }
-        }
-    fclose(f);
-    return TRUE;
-}
 
+/*#########################################################################
+### I N D E X E D      M A P
+#########################################################################*/
 
-static void iDestroy(IndexedMap *me)
+std::unique_ptr<IndexedMap> IndexedMapCreate(int width, int height)
 {
-    if (me->pixels){
-        free(me->pixels);
-    }
-    if (me->rows){
-        free(me->rows);
-    }
-    free(me);
+    return createMap<IndexedMap>("IndexedMapCreate", width, height);
 }
 
-
-
-IndexedMap *IndexedMapCreate(int width, int height)
+bool writePPM(IndexedMap const &map, char const *fileName)
 {
-
-    IndexedMap *me = (IndexedMap *)malloc(sizeof(IndexedMap));
-    if (!me)
-        return nullptr;
-
-    /** methods **/
-    me->setPixel      = iSetPixel;
-    me->getPixel      = iGetPixel;
-    me->getPixelValue = iGetPixelValue;
-    me->writePPM      = iWritePPM;
-    me->destroy       = iDestroy;
-
-
-    /** fields **/
-    me->width  = width;
-    me->height = height;
-    me->pixels = (unsigned int *) malloc(sizeof(unsigned int) * width * height);
-    if (!me->pixels){
-        g_warning("IndexedMapCreate: can not allocate memory for %d x %d image.", width, height);
-        free(me);
-        return nullptr;
-    }
-    me->rows = (unsigned int **) malloc(sizeof(unsigned int *) * height);
-    if (!me->rows){
-        g_warning("IndexedMapCreate: can not allocate memory for index of %d x %d image.", width, height);
-        free(me->pixels); //allocated as me->pixels is not NULL here: see previous check
-        free(me);
-        return nullptr;
-    }
-
-    unsigned int *row = me->pixels;
-    for (int i=0 ; i<height ; i++){
-        me->rows[i] = row;
-        row += width;
-    }
-
-    me->nrColors = 0;
-
-    RGB rgb;
-    rgb.r = rgb.g = rgb.b = 0;
-    for (auto & i : me->clut){
-        i = rgb;
-    }
-
-    return me;
+    return writeMapPPM(map, fileName, [&map](unsigned char index) { return map.clut[index]; });
 }
 
 
-
-
-
-
 /*#########################################################################
 ### E N D    O F    F I L E
 #########################################################################*/
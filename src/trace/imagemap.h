@@ -1,6 +1,6 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 /** @file
- * TODO: insert short description here
+ * Image containers used by the bitmap tracers.
  *//*
  * Authors: see git history
  *
@@ -10,95 +10,129 @@
 #ifndef __IMAGEMAP_H__
 #define __IMAGEMAP_H__
 
-#ifndef TRUE
-#define TRUE  1
-#endif
-
-#ifndef FALSE
-#define FALSE 0
-#endif
-
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <numeric>
 
 /*#########################################################################
-### G R A Y M A P
+### I M A G E   M A P
 #########################################################################*/
 
+/**
+ * A view on one row of an ImageMap, usable in range-based for loops.
+ */
+template <typename T>
+class ImageRow
+{
+public:
+    ImageRow(T *pixels, int width) : _pixels(pixels), _width(width) {}
 
-typedef struct GrayMap_def GrayMap;
+    T *begin() const { return _pixels; }
+    T *end() const { return _pixels + _width; }
+    int size() const { return _width; }
+    T &operator[](int x) const { return _pixels[x]; }
 
-#define GRAYMAP_BLACK 0
-#define GRAYMAP_WHITE 765
+private:
+    T *_pixels;
+    int _width;
+};
 
 /**
- *
+ * A row-major image with contiguous pixel storage.  Every row starts on
+ * an ALIGNMENT byte boundary, so that row loops can be vectorized.
+ * Pixel accessors are inline and do no bounds checking.
  */
-struct GrayMap_def
+template <typename T>
+class ImageMap
 {
+public:
+    typedef T value_type;
 
-    /*#################
-    ### METHODS
-    #################*/
+    static constexpr std::size_t ALIGNMENT = 32;
 
     /**
-     *
+     * Allocate a width x height map with uninitialized pixels.  Check
+     * valid() afterwards: on allocation failure the map has no pixels.
      */
-    void (*setPixel)(GrayMap *me, int x, int y, unsigned long val);
+    ImageMap(int width, int height)
+        : _width(width)
+        , _height(height)
+    {
+        std::size_t step = ALIGNMENT / std::gcd(ALIGNMENT, sizeof(T));
+        _stride = (width + step - 1) / step * step;
+        std::size_t bytes = sizeof(T) * _stride * height;
+        _pixels = static_cast<T *>(::operator new[](bytes ? bytes : ALIGNMENT, std::align_val_t(ALIGNMENT),
+                                                    std::nothrow));
+    }
 
-    /**
-     *
-     */
-    unsigned long (*getPixel)(GrayMap *me, int x, int y);
+    ~ImageMap()
+    {
+        ::operator delete[](_pixels, std::align_val_t(ALIGNMENT));
+    }
 
-    /**
-     *
-     */
-    int (*writePPM)(GrayMap *me, char *fileName);
+    ImageMap(ImageMap const &) = delete;
+    ImageMap &operator=(ImageMap const &) = delete;
 
+    bool valid() const { return _pixels != nullptr; }
 
+    int width() const { return _width; }
+    int height() const { return _height; }
 
     /**
-     *
+     * Distance, in pixels, between the starts of two consecutive rows.
      */
-    void (*destroy)(GrayMap *me);
+    std::size_t stride() const { return _stride; }
 
+    T *row(int y) { return _pixels + y * _stride; }
+    T const *row(int y) const { return _pixels + y * _stride; }
 
+    ImageRow<T> rowView(int y) { return ImageRow<T>(row(y), _width); }
+    ImageRow<T const> rowView(int y) const { return ImageRow<T const>(row(y), _width); }
 
-    /*#################
-    ### FIELDS
-    #################*/
+    T &operator()(int x, int y) { return row(y)[x]; }
+    T const &operator()(int x, int y) const { return row(y)[x]; }
 
-    /**
-     *
-     */
-    int width;
+    T getPixel(int x, int y) const { return row(y)[x]; }
+    void setPixel(int x, int y, T val) { row(y)[x] = val; }
 
     /**
-     *
+     * Set every pixel of the map to val.
      */
-    int height;
+    void fill(T val)
+    {
+        for (int y = 0; y < _height; y++) {
+            T *p = row(y);
+            for (int x = 0; x < _width; x++) {
+                p[x] = val;
+            }
+        }
+    }
 
-    /**
-     *  The pixel array
-     */
-    unsigned long *pixels;
+private:
+    int _width;
+    int _height;
+    std::size_t _stride;
+    T *_pixels;
+};
 
-    /**
-     *  Pointer to the beginning of each row
-     */
-    unsigned long **rows;
 
-};
+/*#########################################################################
+### G R A Y M A P
+#########################################################################*/
 
-#ifdef __cplusplus
-extern "C" {
-#endif
+#define GRAYMAP_BLACK 0
+#define GRAYMAP_WHITE 765
 
-GrayMap *GrayMapCreate(int width, int height);
+/**
+ * Brightness map, with values from GRAYMAP_BLACK to GRAYMAP_WHITE
+ * (the sum of the three color channels).
+ */
+typedef ImageMap<unsigned short> GrayMap;
 
-#ifdef __cplusplus
-}
-#endif
+std::unique_ptr<GrayMap> GrayMapCreate(int width, int height);
 
+bool writePPM(GrayMap const &map, char const *fileName);
 
 
 /*#########################################################################
@@ -112,187 +146,47 @@ struct RGB
     unsigned char b;
 };
 
+typedef ImageMap<RGB> RgbMap;
 
+std::unique_ptr<RgbMap> RgbMapCreate(int width, int height);
 
-typedef struct RgbMap_def RgbMap;
-
-/**
- *
- */
-struct RgbMap_def
-{
-
-    /*#################
-    ### METHODS
-    #################*/
-
-    /**
-     *
-     */
-    void (*setPixel)(RgbMap *me, int x, int y, int r, int g, int b);
-
-
-    /**
-     *
-     */
-    void (*setPixelRGB)(RgbMap *me, int x, int y, RGB rgb);
-
-    /**
-     *
-     */
-    RGB (*getPixel)(RgbMap *me, int x, int y);
-
-    /**
-     *
-     */
-    int (*writePPM)(RgbMap *me, char *fileName);
-
-
-
-    /**
-     *
-     */
-    void (*destroy)(RgbMap *me);
-
-
-
-    /*#################
-    ### FIELDS
-    #################*/
-
-    /**
-     *
-     */
-    int width;
-
-    /**
-     *
-     */
-    int height;
-
-    /**
-     * The allocated array of pixels
-     */
-    RGB *pixels;
-
-    /**
-     * Pointers to the beginning of each row of pixels
-     */
-    RGB **rows;
-
-};
-
-
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-RgbMap *RgbMapCreate(int width, int height);
-
-#ifdef __cplusplus
-}
-#endif
-
-
+bool writePPM(RgbMap const &map, char const *fileName);
 
 
 /*#########################################################################
 ### I N D E X E D     M A P
 #########################################################################*/
 
-
-typedef struct IndexedMap_def IndexedMap;
-
 /**
- *
+ * Map of indexes into a color look up table of at most 256 colors.
  */
-struct IndexedMap_def
+class IndexedMap : public ImageMap<unsigned char>
 {
-
-    /*#################
-    ### METHODS
-    #################*/
+public:
+    IndexedMap(int width, int height)
+        : ImageMap<unsigned char>(width, height)
+    {
+        for (auto &i : clut) {
+            i = {0, 0, 0};
+        }
+    }
 
     /**
-     *
+     * The color of the pixel at (x, y).
      */
-    void (*setPixel)(IndexedMap *me, int x, int y, unsigned int index);
+    RGB getPixelValue(int x, int y) const { return clut[getPixel(x, y)]; }
 
-
-    /**
-     *
-     */
-    unsigned int (*getPixel)(IndexedMap *me, int x, int y);
-
-    /**
-     *
-     */
-    RGB (*getPixelValue)(IndexedMap *me, int x, int y);
-
-    /**
-     *
-     */
-    int (*writePPM)(IndexedMap *me, char *fileName);
-
-
-
-    /**
-     *
-     */
-    void (*destroy)(IndexedMap *me);
-
-
-
-    /*#################
-    ### FIELDS
-    #################*/
-
-    /**
-     *
-     */
-    int width;
-
-    /**
-     *
-     */
-    int height;
-
-    /**
-     * The allocated array of pixels
-     */
-    unsigned int *pixels;
-
-    /**
-     * Pointers to the beginning of each row of pixels
-     */
-    unsigned int **rows;
-
-    /**
-     *
-     */
-    int nrColors;
+    int nrColors = 0;
 
     /**
      * Color look up table
      */
     RGB clut[256];
-
 };
 
+std::unique_ptr<IndexedMap> IndexedMapCreate(int width, int height);
 
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-IndexedMap *IndexedMapCreate(int width, int height);
-
-#ifdef __cplusplus
-}
-#endif
-
-
+bool writePPM(IndexedMap const &map, char const *fileName);
 
 
 #endif /* __IMAGEMAP_H__ */
@@ -15,19 +15,38 @@
  *
  */
 
+#ifdef HAVE_CONFIG_H
+# include "config.h"  // only include where actually required!
+#endif
+
 #include "inkscape-potrace.h"
 
+#if HAVE_OPENMP
+#include <omp.h>
+#endif // HAVE_OPENMP
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <future>
 #include <glibmm/i18n.h>
 #include <gtkmm/main.h>
 #include <iomanip>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <unordered_set>
 
 #include "trace/filterset.h"
 #include "trace/quantize.h"
 #include "trace/imagemap-gdk.h"
+#include "trace/trace-events.h"
 
 #include <inkscape.h>
 #include "desktop.h"
 #include "message-stack.h"
+#include "preferences.h"
 
 #include "object/sp-path.h"
 
@@ -39,6 +58,8 @@ using Glib::ustring;
 static void updateGui()
 {
    //## Allow the GUI to update
+   if (!Inkscape::Application::exists() || !INKSCAPE.use_gui())
+       return;
    Gtk::Main::iteration(false); //at least once, non-blocking
    while( Gtk::Main::events_pending() )
        Gtk::Main::iteration();
@@ -60,6 +81,18 @@ static void potraceStatusCallback(double /*progress*/, void *userData) /* callba
 }
 
 
+/**
+ * Whether this thread runs the GUI main loop, and so may update the GUI
+ * from the potrace progress callback.  Layers traced on other threads do
+ * without progress.  This holds whatever thread the trace was started on,
+ * and however the parallel regions are nested.
+ */
+static bool ownsGui()
+{
+    return g_main_context_is_owner(g_main_context_default());
+}
+
+
 namespace {
 ustring twohex( int value )
 {
@@ -68,6 +101,36 @@ ustring twohex( int value )
 } // namespace
 
 
+/**
+ * Make a private copy of the potrace parameters for one trace pass.
+ * The progress callback pumps the GTK main loop, so it is only kept
+ * when the pass runs on the thread that owns the GUI.
+ */
+static potrace_param_t *potraceParamCopy(potrace_param_t const *params, bool keepProgress)
+{
+    potrace_param_t *copy = potrace_param_default();
+    if (!copy)
+        return nullptr;
+    *copy = *params;
+    if (!keepProgress) {
+        copy->progress.callback = nullptr;
+        copy->progress.data = nullptr;
+    }
+    return copy;
+}
+
+
+/**
+ * Memory, in bytes, that the intermediate images of a trace may use, as
+ * set in the preferences.  Read when an engine is made.
+ */
+static size_t traceMemoryBudget()
+{
+    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+    return (size_t)prefs->getIntLimited("/options/tracing/memorybudget", 512, 16, 1 << 20) << 20;
+}
+
+
 //required by potrace
 namespace Inkscape {
 
@@ -90,7 +153,8 @@ PotraceTracingEngine::PotraceTracingEngine() :
     multiScanNrColors(8),
     multiScanStack(true),
     multiScanSmooth(false),
-    multiScanRemoveBackground(false)
+    multiScanRemoveBackground(false),
+    memoryBudget(traceMemoryBudget())
 {
     /* get default parameters */
     potraceParams = potrace_param_default();
@@ -99,7 +163,7 @@ PotraceTracingEngine::PotraceTracingEngine() :
 }
 
 PotraceTracingEngine::PotraceTracingEngine(TraceType traceType, bool invert, int quantizationNrColors, double brightnessThreshold, double brightnessFloor, double cannyHighThreshold, int multiScanNrColors, bool multiScanStack, bool multiScanSmooth, bool multiScanRemoveBackground) :
-  keepGoing(1), traceType(traceType), invert(invert), quantizationNrColors(quantizationNrColors), brightnessThreshold(brightnessThreshold), brightnessFloor(brightnessFloor), cannyHighThreshold(cannyHighThreshold), multiScanNrColors(multiScanNrColors) , multiScanStack(multiScanStack), multiScanSmooth(multiScanSmooth), multiScanRemoveBackground(multiScanRemoveBackground)
+  keepGoing(1), traceType(traceType), invert(invert), quantizationNrColors(quantizationNrColors), brightnessThreshold(brightnessThreshold), brightnessFloor(brightnessFloor), cannyHighThreshold(cannyHighThreshold), multiScanNrColors(multiScanNrColors) , multiScanStack(multiScanStack), multiScanSmooth(multiScanSmooth), multiScanRemoveBackground(multiScanRemoveBackground), memoryBudget(traceMemoryBudget())
 {
     potraceParams = potrace_param_default();
     potraceParams->progress.callback = potraceStatusCallback;
@@ -119,31 +183,42 @@ struct Point
 {
     double x;
     double y;
+
+    bool operator==(Point const &other) const
+        { return x == other.x && y == other.y; }
 };
 
 
 /**
- * Check a point against a list of points to see if it
- * has already occurred.
+ * Hash of a Point, consistent with its exact (==) comparison.
  */
-static bool hasPoint(std::vector<Point> &points, double x, double y)
+struct PointHash
 {
-    for (auto p : points)
+    std::size_t operator()(Point const &p) const
         {
-        if (p.x == x && p.y == y)
-            return true;
+        // adding 0.0 turns -0.0 into 0.0, which compares equal
+        std::size_t hx = std::hash<double>()(p.x + 0.0);
+        std::size_t hy = std::hash<double>()(p.y + 0.0);
+        return hx ^ (hy + 0x9e3779b9 + (hx << 6) + (hx >> 2));
         }
-    return false;
-}
+};
+
+
+/**
+ * The set of subpath start points that have already been written.
+ */
+typedef std::unordered_set<Point, PointHash> PointSet;
 
 
 /**
  *  Recursively descend the potrace_path_t node tree, writing paths in SVG
- *  format into the output stream.  The Point vector is used to prevent
- *  redundant paths.  Returns number of paths processed.
+ *  format into the output stream.  The Point set is used to prevent
+ *  redundant paths.  All coordinates are shifted by (dx, dy), the origin
+ *  of the traced bitmap in the image.  Returns number of paths processed.
  */
 static long writePaths(PotraceTracingEngine *engine, potrace_path_t *plist,
-           Inkscape::SVG::PathString& data, std::vector<Point> &points)
+           Inkscape::SVG::PathString& data, PointSet &points,
+           double dx, double dy)
 {
     long nodeCount = 0L;
 
@@ -159,20 +234,14 @@ static long writePaths(PotraceTracingEngine *engine, potrace_path_t *plist,
         double y0 = 0.0;
         double x1 = 0.0;
         double y1 = 0.0;
-        double x2 = pt[2].x;
-        double y2 = pt[2].y;
+        double x2 = pt[2].x + dx;
+        double y2 = pt[2].y + dy;
         //Have we been here already?
-        if (hasPoint(points, x2, y2))
+        if (!points.insert({x2, y2}).second)
             {
             //g_message("duplicate point: (%f,%f)\n", x2, y2);
             continue;
             }
-        else
-            {
-            Point p;
-            p.x = x2; p.y = y2;
-            points.push_back(p);
-            }
         data.moveTo(x2, y2);
         nodeCount++;
 
@@ -181,12 +250,12 @@ static long writePaths(PotraceTracingEngine *engine, potrace_path_t *plist,
             if (!engine->keepGoing)
                 return 0L;
             pt = curve->c[i];
-            x0 = pt[0].x;
-            y0 = pt[0].y;
-            x1 = pt[1].x;
-            y1 = pt[1].y;
-            x2 = pt[2].x;
-            y2 = pt[2].y;
+            x0 = pt[0].x + dx;
+            y0 = pt[0].y + dy;
+            x1 = pt[1].x + dx;
+            y1 = pt[1].y + dy;
+            x2 = pt[2].x + dx;
+            y2 = pt[2].y + dy;
             switch (curve->tag[i])
                 {
                 case POTRACE_CORNER:
@@ -204,7 +273,7 @@ static long writePaths(PotraceTracingEngine *engine, potrace_path_t *plist,
 
         for (potrace_path_t *child=node->childlist; child ; child=child->sibling)
             {
-            nodeCount += writePaths(engine, child, data, points);
+            nodeCount += writePaths(engine, child, data, points, dx, dy);
             }
         }
 
@@ -213,23 +282,113 @@ static long writePaths(PotraceTracingEngine *engine, potrace_path_t *plist,
 }
 
 
-static GrayMap *filter(PotraceTracingEngine &engine, GdkPixbuf * pixbuf)
+/**
+ * A horizontal run of pixels [x0, x1) on row y.
+ */
+struct PixelRun
+{
+    int y;
+    int x0;
+    int x1;
+};
+
+
+/**
+ * All pixels of one color of an IndexedMap, as runs in scanline order,
+ * together with their bounding box [x0, x1) x [y0, y1).
+ */
+struct ColorLayer
+{
+    std::vector<PixelRun> runs;
+    int x0 = INT_MAX;
+    int y0 = INT_MAX;
+    int x1 = 0;
+    int y1 = 0;
+
+    bool empty() const { return runs.empty(); }
+
+    long pixels() const
+    {
+        long count = 0;
+        for (auto const &run : runs)
+            count += run.x1 - run.x0;
+        return count;
+    }
+};
+
+
+/**
+ * Split an IndexedMap into one run list per color, in a single pass.
+ */
+static std::vector<ColorLayer> indexedMapLayers(IndexedMap const &iMap)
+{
+    std::vector<ColorLayer> layers(iMap.nrColors);
+
+    for (int y=0 ; y<iMap.height() ; y++)
+        {
+        unsigned char const *row = iMap.row(y);
+        int x = 0;
+        while (x < iMap.width())
+            {
+            unsigned int indx = row[x];
+            int start = x;
+            while (x < iMap.width() && row[x] == indx)
+                x++;
+            if (indx >= layers.size())
+                continue;
+            ColorLayer &layer = layers[indx];
+            layer.runs.push_back({y, start, x});
+            layer.x0 = std::min(layer.x0, start);
+            layer.x1 = std::max(layer.x1, x);
+            layer.y0 = std::min(layer.y0, y);
+            layer.y1 = y + 1;
+            }
+        }
+
+    return layers;
+}
+
+
+/**
+ * Set the pixels [x0, x1) of row y of a potrace bitmap, a word at a time.
+ */
+static void bmSetSpan(potrace_bitmap_t *bm, int y, int x0, int x1)
+{
+    if (x0 >= x1)
+        return;
+    potrace_word *line = bm_scanline(bm, y);
+    int w0 = x0 / BM_WORDBITS;
+    int w1 = (x1 - 1) / BM_WORDBITS;
+    potrace_word first = BM_ALLBITS >> (x0 % BM_WORDBITS);
+    potrace_word last  = BM_ALLBITS << (BM_WORDBITS - 1 - (x1 - 1) % BM_WORDBITS);
+    if (w0 == w1)
+        {
+        line[w0] |= first & last;
+        return;
+        }
+    line[w0] |= first;
+    for (int w = w0 + 1 ; w < w1 ; w++)
+        line[w] = BM_ALLBITS;
+    line[w1] |= last;
+}
+
+
+static std::unique_ptr<GrayMap> filter(PotraceTracingEngine &engine, GdkPixbuf * pixbuf)
 {
     if (!pixbuf)
         return nullptr;
 
-    GrayMap *newGm = nullptr;
+    std::unique_ptr<GrayMap> newGm;
 
     /*### Color quantization -- banding ###*/
     if (engine.traceType == TRACE_QUANT)
         {
-        RgbMap *rgbmap = gdkPixbufToRgbMap(pixbuf);
+        auto rgbmap = gdkPixbufToRgbMap(pixbuf);
         if (!rgbmap)
             return nullptr;
-        //rgbMap->writePPM(rgbMap, "rgb.ppm");
-        newGm = quantizeBand(rgbmap,
-                            engine.quantizationNrColors);
-        rgbmap->destroy(rgbmap);
+        //writePPM(*rgbmap, "rgb.ppm");
+        newGm = quantizeBand(*rgbmap,
+                            engine.quantizationNrColors, engine.threads);
         //return newGm;
         }
 
@@ -237,59 +396,54 @@ static GrayMap *filter(PotraceTracingEngine &engine, GdkPixbuf * pixbuf)
     else if ( engine.traceType == TRACE_BRIGHTNESS ||
               engine.traceType == TRACE_BRIGHTNESS_MULTI )
         {
-        GrayMap *gm = gdkPixbufToGrayMap(pixbuf);
+        auto gm = gdkPixbufToGrayMap(pixbuf);
         if (!gm)
             return nullptr;
 
-        newGm = GrayMapCreate(gm->width, gm->height);
+        newGm = GrayMapCreate(gm->width(), gm->height());
         if (!newGm)
-            {
-            gm->destroy(gm);
             return nullptr;
-            }
         double floor =  3.0 *
                ( engine.brightnessFloor * 256.0 );
         double cutoff =  3.0 *
                ( engine.brightnessThreshold * 256.0 );
-        for (int y=0 ; y<gm->height ; y++)
+        for (int y=0 ; y<gm->height() ; y++)
             {
-            for (int x=0 ; x<gm->width ; x++)
+            unsigned short const *in = gm->row(y);
+            unsigned short *out = newGm->row(y);
+            for (int x=0 ; x<gm->width() ; x++)
                 {
-                double brightness = (double)gm->getPixel(gm, x, y);
+                double brightness = (double)in[x];
                 if (brightness >= floor && brightness < cutoff)
-                    newGm->setPixel(newGm, x, y, GRAYMAP_BLACK);  //black pixel
+                    out[x] = GRAYMAP_BLACK;  //black pixel
                 else
-                    newGm->setPixel(newGm, x, y, GRAYMAP_WHITE); //white pixel
+                    out[x] = GRAYMAP_WHITE; //white pixel
                 }
             }
 
-        gm->destroy(gm);
-        //newGm->writePPM(newGm, "brightness.ppm");
+        //writePPM(*newGm, "brightness.ppm");
         //return newGm;
         }
 
     /*### Canny edge detection ###*/
     else if (engine.traceType == TRACE_CANNY)
         {
-        GrayMap *gm = gdkPixbufToGrayMap(pixbuf);
+        auto gm = gdkPixbufToGrayMap(pixbuf);
         if (!gm)
             return nullptr;
-        newGm = grayMapCanny(gm, 0.1, engine.cannyHighThreshold);
-        gm->destroy(gm);
-        //newGm->writePPM(newGm, "canny.ppm");
+        newGm = grayMapCanny(*gm, 0.1, engine.cannyHighThreshold, engine.threads);
+        //writePPM(*newGm, "canny.ppm");
         //return newGm;
         }
 
     /*### Do I invert the image? ###*/
     if (newGm && engine.invert)
         {
-        for (int y=0 ; y<newGm->height ; y++)
+        for (int y=0 ; y<newGm->height() ; y++)
             {
-            for (int x=0 ; x<newGm->width ; x++)
+            for (auto &brightness : newGm->rowView(y))
                 {
-                unsigned long brightness = newGm->getPixel(newGm, x, y);
                 brightness = 765 - brightness;
-                newGm->setPixel(newGm, x, y, brightness);
                 }
             }
         }
@@ -298,27 +452,121 @@ static GrayMap *filter(PotraceTracingEngine &engine, GdkPixbuf * pixbuf)
 }
 
 
-static IndexedMap *filterIndexed(PotraceTracingEngine &engine, GdkPixbuf * pixbuf)
+/**
+ * Convert, and smooth if requested, the rows y0 to y1 (excluded) of
+ * pixbuf.  The stripe also holds the rows the blur needs around them;
+ * *top is set to the stripe row of y0.
+ */
+static std::unique_ptr<RgbMap> filterStripe(PotraceTracingEngine &engine, GdkPixbuf *pixbuf,
+                                            int y0, int y1, int *top)
 {
-    if (!pixbuf)
+    int halo = engine.multiScanSmooth ? 2 : 0;
+    int sy0 = std::max(y0 - halo, 0);
+    int sy1 = std::min(y1 + halo, gdk_pixbuf_get_height(pixbuf));
+    *top = y0 - sy0;
+
+    auto gm = gdkPixbufToRgbMap(pixbuf, sy0, sy1);
+    if (!gm || !engine.multiScanSmooth)
+        return gm;
+    return rgbMapGaussian(*gm, engine.threads);
+}
+
+
+/**
+ * Number of rows of pixbuf whose intermediate maps fit in the memory
+ * budget: the whole image, or the height of a stripe.
+ */
+static int stripeHeightFor(PotraceTracingEngine &engine, GdkPixbuf *pixbuf)
+{
+    //## The RGB map, and its smoothed copy, are the largest intermediates
+    size_t rowBytes = gdk_pixbuf_get_width(pixbuf) * sizeof(RGB) * (engine.multiScanSmooth ? 2 : 1);
+    size_t budget = engine.memoryBudget;
+    int height = gdk_pixbuf_get_height(pixbuf);
+    if (rowBytes * height <= budget)
+        return height;
+    return (int)std::max<size_t>(budget / rowBytes, 16);
+}
+
+
+/**
+ * Add the colors of pixbuf, one stripe at a time, to the quantizer.
+ */
+static bool quantizerAddStripes(PotraceTracingEngine &engine, GdkPixbuf *pixbuf,
+                                RgbQuantizer &quantizer, int stripeHeight)
+{
+    int height = gdk_pixbuf_get_height(pixbuf);
+    for (int y0 = 0; y0 < height; y0 += stripeHeight)
+        {
+        int y1 = std::min(y0 + stripeHeight, height);
+        int top = 0;
+        auto stripe = filterStripe(engine, pixbuf, y0, y1, &top);
+        if (!stripe || !quantizer.addRows(*stripe, top, top + y1 - y0))
+            return false;
+        }
+    return true;
+}
+
+
+/**
+ * Map pixbuf, one stripe at a time, to the given palette.
+ */
+static std::unique_ptr<IndexedMap> indexStripes(PotraceTracingEngine &engine, GdkPixbuf *pixbuf,
+                                                std::vector<RGB> const &palette, int stripeHeight)
+{
+    int width  = gdk_pixbuf_get_width(pixbuf);
+    int height = gdk_pixbuf_get_height(pixbuf);
+
+    auto newGm = IndexedMapCreate(width, height);
+    if (!newGm)
         return nullptr;
+    std::copy(palette.begin(), palette.end(), newGm->clut);
+    newGm->nrColors = palette.size();
+    PaletteLookup lookup(newGm->clut, newGm->nrColors);
+
+    for (int y0 = 0; y0 < height; y0 += stripeHeight)
+        {
+        int y1 = std::min(y0 + stripeHeight, height);
+        int top = 0;
+        auto stripe = filterStripe(engine, pixbuf, y0, y1, &top);
+        if (!stripe)
+            return nullptr;
+        rgbMapIndexRows(*stripe, top, top + y1 - y0, lookup, *newGm, y0, engine.threads);
+        }
+
+    return newGm;
+}
 
-    IndexedMap *newGm = nullptr;
 
-    RgbMap *gm = gdkPixbufToRgbMap(pixbuf);
-    if (!gm)
+static std::unique_ptr<IndexedMap> filterIndexed(PotraceTracingEngine &engine, GdkPixbuf * pixbuf)
+{
+    if (!pixbuf)
         return nullptr;
-    if (engine.multiScanSmooth)
+
+    std::unique_ptr<IndexedMap> newGm;
+
+    int stripeHeight = stripeHeightFor(engine, pixbuf);
+    if (!engine.sharedPalette.empty())
         {
-        RgbMap *gaussMap = rgbMapGaussian(gm);
-        newGm = rgbMapQuantize(gaussMap, engine.multiScanNrColors);
-        gaussMap->destroy(gaussMap);
+        newGm = indexStripes(engine, pixbuf, engine.sharedPalette, stripeHeight);
+        }
+    else if (stripeHeight < gdk_pixbuf_get_height(pixbuf))
+        {
+        //## Too large for the budget: the palette is built from all the
+        //## stripes in a first pass, then every stripe is mapped to it.
+        //## Only the resulting index map covers the whole image.
+        RgbQuantizer quantizer(engine.multiScanNrColors);
+        if (!quantizerAddStripes(engine, pixbuf, quantizer, stripeHeight))
+            return nullptr;
+        newGm = indexStripes(engine, pixbuf, quantizer.palette(), stripeHeight);
         }
     else
         {
-        newGm = rgbMapQuantize(gm, engine.multiScanNrColors);
+        int top = 0;
+        auto gm = filterStripe(engine, pixbuf, 0, gdk_pixbuf_get_height(pixbuf), &top);
+        if (!gm)
+            return nullptr;
+        newGm = rgbMapQuantize(*gm, engine.multiScanNrColors, engine.threads);
         }
-    gm->destroy(gm);
 
     if (newGm && engine.traceType == TRACE_QUANT_MONO)
         {
@@ -338,6 +586,285 @@ static IndexedMap *filterIndexed(PotraceTracingEngine &engine, GdkPixbuf * pixbu
 
 
 
+/*#########################################################################
+### S T A G E   C A C H E
+#########################################################################*/
+
+/**
+ * Identity of an image: the pixbuf and a serial number given to it the
+ * first time it is traced.  The serial tells apart a pixbuf created at
+ * the address of a freed one.  Pixbufs are not changed once traced, and
+ * callers hand over the same pixbuf to trace an image again.
+ */
+struct ImageKey
+{
+    GdkPixbuf const *pixbuf = nullptr;
+    unsigned long serial = 0;
+
+    bool operator==(ImageKey const &other) const
+    {
+        return pixbuf == other.pixbuf && serial == other.serial;
+    }
+};
+
+static long imagePixels(GdkPixbuf *pixbuf)
+{
+    return (long)gdk_pixbuf_get_width(pixbuf) * gdk_pixbuf_get_height(pixbuf);
+}
+
+
+/**
+ * The result of the pre-potrace stage of a recent trace, together with
+ * the image and the filter settings it was made from.  A trace that only
+ * changes potraceParams (speckles, smoothing, optimization) starts from
+ * it instead of redoing the conversion, blurring and quantization.
+ * Concurrent traces that need a stage which is still being made wait for
+ * it instead of making it again.
+ */
+struct StageCacheEntry
+{
+    ImageKey image;
+    std::string settings;
+    std::shared_future<std::shared_ptr<void const>> data;
+    size_t bytes; // 0 while the stage is being made
+    unsigned long id;
+};
+
+//## Most recently used first
+static std::mutex stageCacheMutex;
+static std::list<StageCacheEntry> stageCache;
+static unsigned long stageCacheLastId = 0;
+//## Stages are only kept while somebody holds the cache
+static int stageCacheHolders = 0;
+static unsigned long stageCacheLastSerial = 0;
+
+static size_t const STAGE_CACHE_MAX_ENTRIES = 8;
+
+/**
+ * The key of pixbuf.  Must be called with stageCacheMutex held, so that
+ * concurrent traces of a new image agree on its serial number.
+ */
+static ImageKey imageKey(GdkPixbuf *pixbuf)
+{
+    static GQuark const serialQuark = g_quark_from_static_string("inkscape-trace-serial");
+
+    ImageKey key;
+    key.pixbuf = pixbuf;
+    key.serial = GPOINTER_TO_SIZE(g_object_get_qdata(G_OBJECT(pixbuf), serialQuark));
+    if (!key.serial)
+        {
+        key.serial = ++stageCacheLastSerial;
+        g_object_set_qdata(G_OBJECT(pixbuf), serialQuark, GSIZE_TO_POINTER(key.serial));
+        }
+    return key;
+}
+
+/**
+ * Return the cached stage of pixbuf for these settings, or make it.  It
+ * is kept for next time while the cached stages fit in the memory budget.
+ */
+template <typename T, typename Make>
+static std::shared_ptr<T const> cachedStage(GdkPixbuf *pixbuf, std::string const &settings, size_t budget,
+                                            size_t (*bytes)(T const &), Make make)
+{
+    std::promise<std::shared_ptr<void const>> promise;
+    unsigned long id = 0;
+    {
+        std::unique_lock<std::mutex> lock(stageCacheMutex);
+        if (stageCacheHolders == 0)
+            {
+            lock.unlock();
+            return make();
+            }
+        ImageKey image = imageKey(pixbuf);
+        for (auto it = stageCache.begin() ; it != stageCache.end() ; ++it)
+            {
+            if (it->image == image && it->settings == settings)
+                {
+                stageCache.splice(stageCache.begin(), stageCache, it);
+                auto data = it->data;
+                lock.unlock();
+                return std::static_pointer_cast<T const>(data.get());
+                }
+            }
+        id = ++stageCacheLastId;
+        stageCache.push_front({image, settings, promise.get_future().share(), 0, id});
+    }
+
+    std::shared_ptr<T const> data;
+    try
+        {
+        data = make();
+        }
+    catch (...)
+        {
+        //## Hand the error to the traces waiting on the stage, and let the
+        //## next trace make it again
+        promise.set_exception(std::current_exception());
+        std::lock_guard<std::mutex> lock(stageCacheMutex);
+        stageCache.remove_if([id](StageCacheEntry const &entry) { return entry.id == id; });
+        throw;
+        }
+    promise.set_value(data);
+
+    std::lock_guard<std::mutex> lock(stageCacheMutex);
+    size_t total = 0;
+    size_t count = 0;
+    for (auto it = stageCache.begin() ; it != stageCache.end() ; )
+        {
+        if (it->id == id)
+            it->bytes = data ? bytes(*data) : budget + 1;
+        total += it->bytes;
+        count++;
+        //## Failed stages are dropped, and the oldest ones once over budget
+        if (it->bytes > budget || (it->bytes && (total > budget || count > STAGE_CACHE_MAX_ENTRIES)))
+            {
+            total -= it->bytes;
+            count--;
+            it = stageCache.erase(it);
+            }
+        else
+            ++it;
+        }
+    return data;
+}
+
+void PotraceTracingEngine::clearStageCache()
+{
+    std::lock_guard<std::mutex> lock(stageCacheMutex);
+    //## Stages still being made are kept for the traces waiting on them
+    stageCache.remove_if([](StageCacheEntry const &entry) { return entry.bytes != 0; });
+}
+
+size_t PotraceTracingEngine::stageCacheSize()
+{
+    std::lock_guard<std::mutex> lock(stageCacheMutex);
+    return stageCache.size();
+}
+
+std::shared_ptr<void> PotraceTracingEngine::holdStageCache()
+{
+    std::lock_guard<std::mutex> lock(stageCacheMutex);
+    stageCacheHolders++;
+    return std::shared_ptr<void>(nullptr, [](void *) {
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(stageCacheMutex);
+            last = --stageCacheHolders == 0;
+        }
+        if (last)
+            clearStageCache();
+    });
+}
+
+/**
+ * The settings that the filtered map of a single scan depends on.
+ */
+static std::string filterSettings(PotraceTracingEngine const &engine)
+{
+    std::ostringstream settings;
+    settings << std::hexfloat << "filter " << engine.traceType << ' ' << engine.invert << ' '
+             << engine.quantizationNrColors << ' ' << engine.brightnessThreshold << ' '
+             << engine.brightnessFloor << ' ' << engine.cannyHighThreshold;
+    return settings.str();
+}
+
+/**
+ * The settings that the indexed map of a color quantization depends on.
+ */
+static std::string quantSettings(PotraceTracingEngine const &engine)
+{
+    std::ostringstream settings;
+    settings << "quant " << engine.traceType << ' ' << engine.multiScanNrColors << ' ' << engine.multiScanSmooth;
+    for (auto const &rgb : engine.sharedPalette)
+        settings << ' ' << (int)rgb.r << ',' << (int)rgb.g << ',' << (int)rgb.b;
+    return settings.str();
+}
+
+static size_t grayMapBytes(GrayMap const &map)
+{
+    return map.stride() * map.height() * sizeof(GrayMap::value_type);
+}
+
+/**
+ * A quantized image, split into its color layers.
+ */
+struct QuantStage
+{
+    std::unique_ptr<IndexedMap> map;
+    std::vector<ColorLayer> layers;
+};
+
+static size_t quantStageBytes(QuantStage const &stage)
+{
+    size_t bytes = stage.map->stride() * stage.map->height();
+    for (auto const &layer : stage.layers)
+        bytes += layer.runs.size() * sizeof(PixelRun);
+    return bytes;
+}
+
+/**
+ * The filtered map of a single scan of pixbuf.
+ */
+static std::shared_ptr<GrayMap const> cachedFilter(PotraceTracingEngine &engine, GdkPixbuf *pixbuf)
+{
+    return cachedStage<GrayMap>(pixbuf, filterSettings(engine), engine.memoryBudget, grayMapBytes, [&]() {
+        TraceStage stage("trace-filter", "pixels", imagePixels(pixbuf));
+        return std::shared_ptr<GrayMap const>(filter(engine, pixbuf));
+    });
+}
+
+/**
+ * The plain brightness map of pixbuf.
+ */
+static std::shared_ptr<GrayMap const> cachedGrayMap(PotraceTracingEngine &engine, GdkPixbuf *pixbuf)
+{
+    return cachedStage<GrayMap>(pixbuf, "gray", engine.memoryBudget, grayMapBytes, [&]() {
+        TraceStage stage("trace-gray-map", "pixels", imagePixels(pixbuf));
+        return std::shared_ptr<GrayMap const>(gdkPixbufToGrayMap(pixbuf));
+    });
+}
+
+/**
+ * The indexed map of pixbuf, and its color layers.
+ */
+static std::shared_ptr<QuantStage const> cachedQuant(PotraceTracingEngine &engine, GdkPixbuf *pixbuf)
+{
+    return cachedStage<QuantStage>(pixbuf, quantSettings(engine), engine.memoryBudget, quantStageBytes,
+                                   [&]() -> std::shared_ptr<QuantStage const> {
+                                       TraceStage event("trace-quantize", "pixels", imagePixels(pixbuf));
+                                       auto stage = std::make_shared<QuantStage>();
+                                       stage->map = filterIndexed(engine, pixbuf);
+                                       if (!stage->map)
+                                           return nullptr;
+                                       // Bucket the pixels by color once, instead of
+                                       // rescanning the whole map for every layer.
+                                       stage->layers = indexedMapLayers(*stage->map);
+                                       event.result("colors", stage->map->nrColors);
+                                       return stage;
+                                   });
+}
+
+
+void PotraceTracingEngine::setSharedPalette(std::vector<Glib::RefPtr<Gdk::Pixbuf>> const &samples)
+{
+    sharedPalette.clear();
+    if (samples.empty())
+        return;
+
+    RgbQuantizer quantizer(multiScanNrColors);
+    for (auto const &sample : samples)
+        {
+        if (!sample || !quantizerAddStripes(*this, sample->gobj(), quantizer, stripeHeightFor(*this, sample->gobj())))
+            {
+            g_warning("setSharedPalette: Could not add the colors of a sample image");
+            return;
+            }
+        }
+    sharedPalette = quantizer.palette();
+}
+
+
 Glib::RefPtr<Gdk::Pixbuf> 
 PotraceTracingEngine::preview(Glib::RefPtr<Gdk::Pixbuf> thePixbuf)
 {
@@ -346,35 +873,81 @@ PotraceTracingEngine::preview(Glib::RefPtr<Gdk::Pixbuf> thePixbuf)
     if ( traceType == TRACE_QUANT_COLOR ||
          traceType == TRACE_QUANT_MONO   )
         {
-        IndexedMap *gm = filterIndexed(*this, pixbuf);
-        if (!gm)
+        auto quant = cachedQuant(*this, pixbuf);
+        if (!quant)
             return Glib::RefPtr<Gdk::Pixbuf>(nullptr);
 
-        Glib::RefPtr<Gdk::Pixbuf> newBuf =
-             Glib::wrap(indexedMapToGdkPixbuf(gm), false);
-
-        gm->destroy(gm);
-
-        return newBuf;
+        return Glib::wrap(indexedMapToGdkPixbuf(*quant->map), false);
         }
     else
         {
-        GrayMap *gm = filter(*this, pixbuf);
+        auto gm = cachedFilter(*this, pixbuf);
         if (!gm)
             return Glib::RefPtr<Gdk::Pixbuf>(nullptr);
 
-        Glib::RefPtr<Gdk::Pixbuf> newBuf =
-            Glib::wrap(grayMapToGdkPixbuf(gm), false);
+        return Glib::wrap(grayMapToGdkPixbuf(*gm), false);
+        }
+}
+
+
+std::string PotraceTracingEngine::grayMapToPath(GrayMap const &grayMap, long *nodeCount)
+{
+    return grayMapToPath(grayMap, nodeCount, potraceParams);
+}
+
 
-        gm->destroy(gm);
+std::string PotraceTracingEngine::grayMapToPath(GrayMap const &grayMap, long *nodeCount, potrace_param_t *params)
+{
+    if (!keepGoing)
+    {
+        g_warning("aborted");
+        return "";
+    }
 
-        return newBuf;
+    potrace_bitmap_t *potraceBitmap = bm_new(grayMap.width(), grayMap.height());
+    if (!potraceBitmap)
+    {
+        return "";
+    }
+
+    //##Read the data out of the GrayMap, packing a word at a time
+    for (int y=0 ; y<grayMap.height() ; y++)
+        {
+        unsigned short const *row = grayMap.row(y);
+        potrace_word *line = bm_scanline(potraceBitmap, y);
+        for (int w=0 ; w<potraceBitmap->dy ; w++)
+            {
+            int xStart = w * BM_WORDBITS;
+            int xEnd   = std::min(xStart + BM_WORDBITS, grayMap.width());
+            potrace_word word = 0;
+            for (int x=xStart ; x<xEnd ; x++)
+                word = (word << 1) | (row[x] ? 0 : 1);
+            line[w] = word << (BM_WORDBITS - (xEnd - xStart));
+            }
         }
+
+    std::string d = bitmapToPath(potraceBitmap, 0, 0, nodeCount, params);
+
+    //## Free the Potrace bitmap
+    bm_free(potraceBitmap);
+
+    return d;
 }
 
 
-//*This is the core inkscape-to-potrace binding
-std::string PotraceTracingEngine::grayMapToPath(GrayMap *grayMap, long *nodeCount)
+/**
+ * The first brightness value at or above a threshold, as used by the
+ * brightness filter: pixels from floor to threshold (excluded) are black.
+ */
+static int brightnessBound(double threshold)
+{
+    double bound = std::ceil(3.0 * (threshold * 256.0));
+    return (int)std::min(std::max(bound, 0.0), (double)GRAYMAP_WHITE + 1);
+}
+
+
+std::string PotraceTracingEngine::brightnessToPath(GrayMap const &grayMap, double floor, double threshold,
+                                                   long *nodeCount, potrace_param_t *params)
 {
     if (!keepGoing)
     {
@@ -382,23 +955,50 @@ std::string PotraceTracingEngine::grayMapToPath(GrayMap *grayMap, long *nodeCoun
         return "";
     }
 
-    potrace_bitmap_t *potraceBitmap = bm_new(grayMap->width, grayMap->height);
+    potrace_bitmap_t *potraceBitmap = bm_new(grayMap.width(), grayMap.height());
     if (!potraceBitmap)
     {
         return "";
     }
-    bm_clear(potraceBitmap, 0);
 
-    //##Read the data out of the GrayMap
-    for (int y=0 ; y<grayMap->height ; y++)
+    //##Threshold the GrayMap straight into the bitmap, a word at a time
+    unsigned lo    = brightnessBound(floor);
+    unsigned range = std::max(brightnessBound(threshold) - (int)lo, 0);
+    potrace_word outside = invert ? 1 : 0;
+    for (int y=0 ; y<grayMap.height() ; y++)
         {
-        for (int x=0 ; x<grayMap->width ; x++)
+        unsigned short const *row = grayMap.row(y);
+        potrace_word *line = bm_scanline(potraceBitmap, y);
+        for (int w=0 ; w<potraceBitmap->dy ; w++)
             {
-            BM_UPUT(potraceBitmap, x, y,
-                  grayMap->getPixel(grayMap, x, y) ? 0 : 1);
+            int xStart = w * BM_WORDBITS;
+            int xEnd   = std::min(xStart + BM_WORDBITS, grayMap.width());
+            potrace_word word = 0;
+            for (int x=xStart ; x<xEnd ; x++)
+                word = (word << 1) | ((potrace_word)(row[x] - lo < range) ^ outside);
+            line[w] = word << (BM_WORDBITS - (xEnd - xStart));
             }
         }
 
+    std::string d = bitmapToPath(potraceBitmap, 0, 0, nodeCount, params);
+
+    //## Free the Potrace bitmap
+    bm_free(potraceBitmap);
+
+    return d;
+}
+
+
+//*This is the core inkscape-to-potrace binding
+std::string PotraceTracingEngine::bitmapToPath(potrace_bitmap_t *potraceBitmap, int x0, int y0,
+                                               long *nodeCount, potrace_param_t *params)
+{
+    if (!keepGoing)
+    {
+        g_warning("aborted");
+        return "";
+    }
+
     //##Debug
     /*
     FILE *f = fopen("poimage.pbm", "wb");
@@ -406,25 +1006,28 @@ std::string PotraceTracingEngine::grayMapToPath(GrayMap *grayMap, long *nodeCoun
     fclose(f);
     */
 
-    /* trace a bitmap*/
-    potrace_state_t *potraceState = potrace_trace(potraceParams,
-                                                  potraceBitmap);
+    TraceStage stage("trace-bitmap", "pixels", (long)potraceBitmap->w * potraceBitmap->h);
 
-    //## Free the Potrace bitmap
-    bm_free(potraceBitmap);
+    /* trace a bitmap*/
+    potrace_state_t *potraceState = potrace_trace(params, potraceBitmap);
+    if (!potraceState)
+        {
+        return "";
+        }
 
-    if (!keepGoing)
+    if (!keepGoing || potraceState->status != POTRACE_STATUS_OK)
         {
-        g_warning("aborted");
+        if (!keepGoing)
+            g_warning("aborted");
         potrace_state_free(potraceState);
         return "";
         }
 
-    Inkscape::SVG::PathString data;
+    Inkscape::SVG::PathString data(pathStringSettings);
 
     //## copy the path information into our d="" attribute string
-    std::vector<Point> points;
-    long thisNodeCount = writePaths(this, potraceState->plist, data, points);
+    PointSet points;
+    long thisNodeCount = writePaths(this, potraceState->plist, data, points, x0, y0);
 
     /* free a potrace items */
     potrace_state_free(potraceState);
@@ -435,40 +1038,81 @@ std::string PotraceTracingEngine::grayMapToPath(GrayMap *grayMap, long *nodeCoun
     if ( nodeCount)
         *nodeCount = thisNodeCount;
 
-    return data.string();
+    std::string d = data.release();
+    stage.result("nodes", thisNodeCount, "bytes", d.size());
+    return d;
 }
 
 
 
 /**
- *  This is called for a single scan
+ * Hands traced layers on to a sink.  When the background is to be
+ * removed, the latest layer is held back until the next one arrives, so
+ * that the bottom-most scan can still be dropped at the end.
  */
-std::vector<TracingEngineResult> PotraceTracingEngine::traceSingle(GdkPixbuf * thePixbuf)
+class LayerEmitter
 {
+public:
+    LayerEmitter(TracingEngine::ResultSink const &sink, bool removeBackground)
+        : _sink(sink)
+        , _removeBackground(removeBackground)
+    {}
+
+    void emit(TracingEngineResult &&result)
+    {
+        if (!_removeBackground) {
+            _sink(std::move(result));
+            return;
+        }
+        if (_held) {
+            _sink(std::move(*_held));
+        }
+        _held.emplace(std::move(result));
+        _count++;
+    }
+
+    /**
+     * Pass on the held layer, unless it is the bottom one of several.
+     */
+    void finish()
+    {
+        if (_held && _count == 1) {
+            _sink(std::move(*_held));
+        }
+        _held.reset();
+    }
+
+private:
+    TracingEngine::ResultSink const &_sink;
+    bool _removeBackground;
+    std::optional<TracingEngineResult> _held;
+    int _count = 0;
+};
 
-    std::vector<TracingEngineResult> results;
 
+/**
+ *  This is called for a single scan
+ */
+void PotraceTracingEngine::traceSingle(GdkPixbuf * thePixbuf, ResultSink const &sink)
+{
     if (!thePixbuf)
-        return results;
+        return;
 
     brightnessFloor = 0.0; //important to set this
 
-    GrayMap *grayMap = filter(*this, thePixbuf);
+    auto grayMap = cachedFilter(*this, thePixbuf);
     if (!grayMap)
-        return results;
+        return;
 
     long nodeCount = 0L;
-    std::string d = grayMapToPath(grayMap, &nodeCount);
+    std::string d = grayMapToPath(*grayMap, &nodeCount);
 
-    grayMap->destroy(grayMap);
+    grayMap.reset();
 
     char const *style = "fill:#000000";
 
     //g_message("### GOT '%s' \n", d);
-    TracingEngineResult result(style, d, nodeCount);
-    results.push_back(result);
-
-    return results;
+    sink(TracingEngineResult(style, std::move(d), nodeCount));
 }
 
 
@@ -476,7 +1120,7 @@ std::vector<TracingEngineResult> PotraceTracingEngine::traceSingle(GdkPixbuf * t
  *  This allows routines that already generate GrayMaps to skip image filtering,
  *  increasing performance.
  */
-std::vector<TracingEngineResult> PotraceTracingEngine::traceGrayMap(GrayMap *grayMap)
+std::vector<TracingEngineResult> PotraceTracingEngine::traceGrayMap(GrayMap const &grayMap)
 {
 
     std::vector<TracingEngineResult> results;
@@ -489,8 +1133,7 @@ std::vector<TracingEngineResult> PotraceTracingEngine::traceGrayMap(GrayMap *gra
     char const *style = "fill:#000000";
 
     //g_message("### GOT '%s' \n", d);
-    TracingEngineResult result(style, d, nodeCount);
-    results.push_back(result);
+    results.emplace_back(style, std::move(d), nodeCount);
 
     return results;
 }
@@ -498,124 +1141,238 @@ std::vector<TracingEngineResult> PotraceTracingEngine::traceGrayMap(GrayMap *gra
 /**
  *  Called for multiple-scanning algorithms
  */
-std::vector<TracingEngineResult> PotraceTracingEngine::traceBrightnessMulti(GdkPixbuf * thePixbuf)
+void PotraceTracingEngine::traceBrightnessMulti(GdkPixbuf * thePixbuf, ResultSink const &sink)
 {
-    std::vector<TracingEngineResult> results;
+    if ( !thePixbuf ) {
+        return;
+    }
+
+    double low     = 0.2; //bottom of range
+    double high    = 0.9; //top of range
+    double delta   = (high - low ) / ((double)multiScanNrColors);
+
+    std::vector<double> thresholds;
+    for (double threshold = low ; threshold <= high ; threshold += delta) {
+        thresholds.push_back(threshold);
+    }
+    int nrScans = thresholds.size();
 
-    if ( thePixbuf ) {
-        double low     = 0.2; //bottom of range
-        double high    = 0.9; //top of range
-        double delta   = (high - low ) / ((double)multiScanNrColors);
+    //## The brightness of the image is only computed once
+    auto grayMap = cachedGrayMap(*this, thePixbuf);
+    if ( !grayMap ) {
+        return;
+    }
 
-        brightnessFloor = 0.0; //Set bottom to black
+    //## Pixels below each brightness, to know which scans are empty
+    std::vector<long> below(GRAYMAP_WHITE + 2, 0L);
+    for (int y=0 ; y<grayMap->height() ; y++) {
+        for (auto brightness : grayMap->rowView(y)) {
+            below[std::min<int>(brightness, GRAYMAP_WHITE) + 1]++;
+        }
+    }
+    for (int v=1 ; v<=GRAYMAP_WHITE + 1 ; v++) {
+        below[v] += below[v - 1];
+    }
+    auto scanPixels = [&](double floor, double threshold) {
+        long count = below[brightnessBound(threshold)] - below[brightnessBound(floor)];
+        return invert ? below[GRAYMAP_WHITE + 1] - count : count;
+    };
+
+    //## Without stacking, a scan starts at the threshold of the last
+    //## scan below it that has a path.  Predict that from the pixel
+    //## counts, so that the scans can be traced concurrently.
+    std::vector<double> floors(nrScans);
+    double floor = 0.0; //Set bottom to black
+    for (int i=0 ; i<nrScans ; i++) {
+        floors[i] = floor;
+        if (!multiScanStack && scanPixels(floor, thresholds[i]) > 0) {
+            floor = thresholds[i];
+        }
+    }
 
-        int traceCount = 0;
+    std::vector<std::string> paths(nrScans);
+    std::vector<long> nodeCounts(nrScans, 0L);
+
+    int numThreads = 1;
+#if HAVE_OPENMP
+    // Every concurrent scan holds a bitmap of the whole image
+    size_t bitmapBytes = (size_t)grayMap->width() * grayMap->height() / 8 + 1;
+    numThreads = std::min<size_t>(threads, std::max<size_t>(memoryBudget / bitmapBytes, 1));
+#endif // HAVE_OPENMP
+
+    //## The scans are traced a batch at a time, and each batch is handed
+    //## on before the next one starts.
+    int batchSize = 2 * numThreads;
+
+    LayerEmitter emitter(sink, multiScanRemoveBackground);
+    int traceCount = 0;
+
+    floor = 0.0;
+    for (int first=0 ; first<nrScans && keepGoing ; first+=batchSize) {
+        int last = std::min(nrScans, first + batchSize);
+
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(numThreads)
+#endif // HAVE_OPENMP
+        for (int i=first ; i<last ; i++) {
+            if (!keepGoing || scanPixels(floors[i], thresholds[i]) == 0) {
+                continue;
+            }
+            TraceStage stage("trace-layer", "layer", i, "pixels", scanPixels(floors[i], thresholds[i]));
 
-        for ( brightnessThreshold = low ;
-              brightnessThreshold <= high ;
-              brightnessThreshold += delta) {
-            GrayMap *grayMap = filter(*this, thePixbuf);
-            if ( grayMap ) {
-                long nodeCount = 0L;
-                std::string d = grayMapToPath(grayMap, &nodeCount);
+            potrace_param_t *params = potraceParamCopy(potraceParams, ownsGui());
+            if (!params) {
+                continue;
+            }
+            paths[i] = brightnessToPath(*grayMap, floors[i], thresholds[i], &nodeCounts[i], params);
+            potrace_param_free(params);
+        }
 
-                grayMap->destroy(grayMap);
+        for (int i=first ; i<last && keepGoing ; i++) {
+            //## A scan that had pixels, but no path, was mispredicted
+            if (floors[i] != floor) {
+                nodeCounts[i] = 0L;
+                paths[i] = brightnessToPath(*grayMap, floor, thresholds[i], &nodeCounts[i], potraceParams);
+            }
 
-                if ( !d.empty() ) {
-                    //### get style info
-                    int grayVal = (int)(256.0 * brightnessThreshold);
-                    ustring style = ustring::compose("fill-opacity:1.0;fill:#%1%2%3", twohex(grayVal), twohex(grayVal), twohex(grayVal) );
+            if ( !paths[i].empty() ) {
+                //### get style info
+                int grayVal = (int)(256.0 * thresholds[i]);
+                ustring style = ustring::compose("fill-opacity:1.0;fill:#%1%2%3", twohex(grayVal), twohex(grayVal), twohex(grayVal) );
 
-                    //g_message("### GOT '%s' \n", style.c_str());
-                    TracingEngineResult result(style.raw(), d, nodeCount);
-                    results.push_back(result);
+                //g_message("### GOT '%s' \n", style.c_str());
+                emitter.emit(TracingEngineResult(style.raw(), std::move(paths[i]), nodeCounts[i]));
 
-                    if (!multiScanStack) {
-                        brightnessFloor = brightnessThreshold;
-                    }
+                if (!multiScanStack) {
+                    floor = thresholds[i];
+                }
 
-                    SPDesktop *desktop = SP_ACTIVE_DESKTOP;
-                    if (desktop) {
-                        ustring msg = ustring::compose(_("Trace: %1.  %2 nodes"), traceCount++, nodeCount);
-                        desktop->getMessageStack()->flash(Inkscape::NORMAL_MESSAGE, msg);
-                    }
+                SPDesktop *desktop = SP_ACTIVE_DESKTOP;
+                if (desktop) {
+                    ustring msg = ustring::compose(_("Trace: %1.  %2 nodes"), traceCount++, nodeCounts[i]);
+                    desktop->getMessageStack()->flash(Inkscape::NORMAL_MESSAGE, msg);
                 }
             }
         }
-
-        //# Remove the bottom-most scan, if requested
-        if (results.size() > 1 && multiScanRemoveBackground) {
-            results.erase(results.end() - 1);
-        }
     }
 
-    return results;
+    //# Remove the bottom-most scan, if requested
+    emitter.finish();
 }
 
 
 /**
  *  Quantization
  */
-std::vector<TracingEngineResult> PotraceTracingEngine::traceQuant(GdkPixbuf * thePixbuf)
+void PotraceTracingEngine::traceQuant(GdkPixbuf * thePixbuf, ResultSink const &sink)
 {
-    std::vector<TracingEngineResult> results;
+    if (!thePixbuf) {
+        return;
+    }
 
-    if (thePixbuf) {
-        IndexedMap *iMap = filterIndexed(*this, thePixbuf);
-        if ( iMap ) {
-            //Create and clear a gray map
-            GrayMap *gm = GrayMapCreate(iMap->width, iMap->height);
-            for (int row=0 ; row<gm->height ; row++) {
-                for (int col=0 ; col<gm->width ; col++) {
-                    gm->setPixel(gm, col, row, GRAYMAP_WHITE);
+    auto quant = cachedQuant(*this, thePixbuf);
+    if ( !quant ) {
+        return;
+    }
+    IndexedMap const *iMap = quant->map.get();
+    std::vector<ColorLayer> const &layers = quant->layers;
+
+    int nrColors = iMap->nrColors;
+    std::vector<std::string> paths(nrColors);
+    std::vector<long> nodeCounts(nrColors, 0L);
+
+    int numThreads = 1;
+#if HAVE_OPENMP
+    // Every concurrent layer holds a bitmap of up to the whole image
+    size_t bitmapBytes = (size_t)iMap->width() * iMap->height() / 8 + 1;
+    numThreads = std::min<size_t>(threads, std::max<size_t>(memoryBudget / bitmapBytes, 1));
+#endif // HAVE_OPENMP
+
+    // Each color layer only depends on the indexed map, so the layers of
+    // a batch are traced concurrently, and then handed on in color order.
+    int batchSize = 2 * numThreads;
+
+    LayerEmitter emitter(sink, multiScanRemoveBackground);
+
+    for (int first=0 ; first<nrColors && keepGoing ; first+=batchSize) {
+        int last = std::min(nrColors, first + batchSize);
+
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(numThreads)
+#endif // HAVE_OPENMP
+        for (int colorIndex=first ; colorIndex<last ; colorIndex++) {
+            if (!keepGoing) {
+                continue;
+            }
+
+            // When stacking, every darker color is part of the layer too
+            int firstIndex = multiScanStack ? 0 : colorIndex;
+
+            // Only the bounding box of the layer is handed to potrace
+            int x0 = INT_MAX, y0 = INT_MAX, x1 = 0, y1 = 0;
+            for (int k=firstIndex ; k<=colorIndex ; k++) {
+                if (layers[k].empty()) {
+                    continue;
                 }
+                x0 = std::min(x0, layers[k].x0);
+                y0 = std::min(y0, layers[k].y0);
+                x1 = std::max(x1, layers[k].x1);
+                y1 = std::max(y1, layers[k].y1);
+            }
+            if (x0 >= x1 || y0 >= y1) {
+                continue;
+            }
+            RGB rgb = iMap->clut[colorIndex];
+            TraceStage stage("trace-layer", "layer", colorIndex,
+                             "color", ustring::compose("#%1%2%3", twohex(rgb.r), twohex(rgb.g), twohex(rgb.b)).raw(),
+                             "pixels", layers[colorIndex].pixels());
+
+            potrace_param_t *params = potraceParamCopy(potraceParams, ownsGui());
+            potrace_bitmap_t *bm = bm_new(x1 - x0, y1 - y0);
+            if (!params || !bm) {
+                if (params)
+                    potrace_param_free(params);
+                if (bm)
+                    bm_free(bm);
+                continue;
             }
 
-            for (int colorIndex=0 ; colorIndex<iMap->nrColors ; colorIndex++) {
-                // Make a gray map for each color index
-                for (int row=0 ; row<iMap->height ; row++) {
-                    for (int col=0 ; col<iMap->width ; col++) {
-                        int indx = (int) iMap->getPixel(iMap, col, row);
-                        if (indx == colorIndex) {
-                            gm->setPixel(gm, col, row, GRAYMAP_BLACK); //black
-                        } else if (!multiScanStack) {
-                            gm->setPixel(gm, col, row, GRAYMAP_WHITE); //white
-                        }
-                    }
+            bm_clear(bm, 0);
+            for (int k=firstIndex ; k<=colorIndex ; k++) {
+                for (auto const &run : layers[k].runs) {
+                    bmSetSpan(bm, run.y - y0, run.x0 - x0, run.x1 - x0);
                 }
+            }
 
-                //## Now we have a traceable graymap
-                long nodeCount = 0L;
-                std::string d = grayMapToPath(gm, &nodeCount);
+            //## Now we have a traceable bitmap
+            paths[colorIndex] = bitmapToPath(bm, x0, y0, &nodeCounts[colorIndex], params);
 
-                if ( !d.empty() ) {
-                    //### get style info
-                    RGB rgb = iMap->clut[colorIndex];
-                    ustring style = ustring::compose("fill:#%1%2%3", twohex(rgb.r), twohex(rgb.g), twohex(rgb.b) );
+            bm_free(bm);
+            potrace_param_free(params);
+        }// for colorIndex
 
-                    //g_message("### GOT '%s' \n", style.c_str());
-                    TracingEngineResult result(style.raw(), d, nodeCount);
-                    results.push_back(result);
+        for (int colorIndex=first ; colorIndex<last && keepGoing ; colorIndex++) {
+            if ( paths[colorIndex].empty() ) {
+                continue;
+            }
 
-                    SPDesktop *desktop = SP_ACTIVE_DESKTOP;
-                    if (desktop) {
-                        ustring msg = ustring::compose(_("Trace: %1.  %2 nodes"), colorIndex, nodeCount);
-                        desktop->getMessageStack()->flash(Inkscape::NORMAL_MESSAGE, msg);
-                    }
-                }
-            }// for colorIndex
+            //### get style info
+            RGB rgb = iMap->clut[colorIndex];
+            ustring style = ustring::compose("fill:#%1%2%3", twohex(rgb.r), twohex(rgb.g), twohex(rgb.b) );
 
-            gm->destroy(gm);
-            iMap->destroy(iMap);
-        }
+            //g_message("### GOT '%s' \n", style.c_str());
+            emitter.emit(TracingEngineResult(style.raw(), std::move(paths[colorIndex]), nodeCounts[colorIndex]));
 
-        //# Remove the bottom-most scan, if requested
-        if (results.size() > 1 && multiScanRemoveBackground) {
-            results.erase(results.end() - 1);
+            SPDesktop *desktop = SP_ACTIVE_DESKTOP;
+            if (desktop) {
+                ustring msg = ustring::compose(_("Trace: %1.  %2 nodes"), colorIndex, nodeCounts[colorIndex]);
+                desktop->getMessageStack()->flash(Inkscape::NORMAL_MESSAGE, msg);
+            }
         }
     }
 
-    return results;
+    //# Remove the bottom-most scan, if requested
+    emitter.finish();
 }
 
 
@@ -627,6 +1384,16 @@ std::vector<TracingEngineResult> PotraceTracingEngine::traceQuant(GdkPixbuf * th
  */
 std::vector<TracingEngineResult>
 PotraceTracingEngine::trace(Glib::RefPtr<Gdk::Pixbuf> pixbuf)
+{
+    std::vector<TracingEngineResult> results;
+    traceTo(pixbuf, [&results](TracingEngineResult &&result) {
+        results.push_back(std::move(result));
+    });
+    return results;
+}
+
+
+void PotraceTracingEngine::traceTo(Glib::RefPtr<Gdk::Pixbuf> pixbuf, ResultSink const &sink)
 {
 
     GdkPixbuf *thePixbuf = pixbuf->gobj();
@@ -634,19 +1401,30 @@ PotraceTracingEngine::trace(Glib::RefPtr<Gdk::Pixbuf> pixbuf)
     //Set up for messages
     keepGoing             = 1;
 
+    TraceStage stage("potrace", "pixels", imagePixels(thePixbuf));
+    long paths = 0, nodes = 0, bytes = 0;
+    ResultSink counted = [&](TracingEngineResult &&result) {
+        paths++;
+        nodes += result.getNodeCount();
+        bytes += result.getPathData().size();
+        sink(std::move(result));
+    };
+
     if ( traceType == TRACE_QUANT_COLOR ||
          traceType == TRACE_QUANT_MONO   )
         {
-        return traceQuant(thePixbuf);
+        traceQuant(thePixbuf, counted);
         }
     else if ( traceType == TRACE_BRIGHTNESS_MULTI )
         {
-        return traceBrightnessMulti(thePixbuf);
+        traceBrightnessMulti(thePixbuf, counted);
         }
     else
         {
-        return traceSingle(thePixbuf);
+        traceSingle(thePixbuf, counted);
         }
+
+    stage.result("paths", paths, "nodes", nodes, "bytes", bytes);
 }
 
 
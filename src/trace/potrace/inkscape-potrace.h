@@ -19,11 +19,10 @@
 #define __INKSCAPE_POTRACE_H__
 
 #include <trace/trace.h>
+#include <trace/imagemap.h>
+#include <svg/path-string.h>
 #include <potracelib.h>
 
-struct GrayMap_def;
-typedef GrayMap_def GrayMap;
-
 namespace Inkscape {
 
 namespace Trace {
@@ -70,6 +69,11 @@ class PotraceTracingEngine : public TracingEngine
     std::vector<TracingEngineResult> trace(
                         Glib::RefPtr<Gdk::Pixbuf> pixbuf) override;
 
+    /**
+     *  Trace, handing every layer to sink as soon as it is traced.
+     */
+    void traceTo(Glib::RefPtr<Gdk::Pixbuf> pixbuf, ResultSink const &sink) override;
+
     /**
      *  Abort the thread that is executing getPathDataFromPixbuf()
      */
@@ -85,7 +89,7 @@ class PotraceTracingEngine : public TracingEngine
      */
     int keepGoing;
 
-    std::vector<TracingEngineResult>traceGrayMap(GrayMap *grayMap);
+    std::vector<TracingEngineResult>traceGrayMap(GrayMap const &grayMap);
 
     potrace_param_t *potraceParams;
     TraceType traceType;
@@ -108,17 +112,71 @@ class PotraceTracingEngine : public TracingEngine
     bool multiScanStack; //do we tile or stack?
     bool multiScanSmooth;//do we use gaussian filter?
     bool multiScanRemoveBackground; //do we remove the bottom trace?
+
+    //## Memory, in bytes, that the intermediate images of a trace may
+    //## use, from the preferences.  Larger images are processed in stripes.
+    size_t memoryBudget;
+
+    /**
+     * Compute one palette from the colors of all the sample images and
+     * use it to quantize every image traced afterwards, instead of a
+     * palette per image: the frames of an animation then get the same
+     * colors.  An empty list of samples goes back to a palette per image.
+     */
+    void setSharedPalette(std::vector<Glib::RefPtr<Gdk::Pixbuf>> const &samples);
+
+    //## The palette set by setSharedPalette(), if any
+    std::vector<RGB> sharedPalette;
+
+    /**
+     * Forget the filtered and quantized images kept from recent traces,
+     * to free their memory or to time the next trace from scratch.
+     */
+    static void clearStageCache();
+
+    /**
+     * Number of stages in the cache, including those still being made.
+     */
+    static size_t stageCacheSize();
+
+    /**
+     * Keep the filtered and quantized images of traces for as long as
+     * the returned handle, or a copy of it, lives.  Without a holder,
+     * nothing is kept; once the last holder is gone, the cache is
+     * cleared.
+     */
+    static std::shared_ptr<void> holdStageCache();
     
     private:
     /**
      * This is the actual wrapper of the call to Potrace.  nodeCount
      * returns the count of nodes created.  May be NULL if ignored.
      */
-    std::string grayMapToPath(GrayMap *gm, long *nodeCount);
+    std::string grayMapToPath(GrayMap const &gm, long *nodeCount);
+
+    /**
+     * Same as above, but using the given potrace parameters instead of
+     * potraceParams, so that several passes can run concurrently.
+     */
+    std::string grayMapToPath(GrayMap const &gm, long *nodeCount, potrace_param_t *params);
+
+    /**
+     * Trace the pixels of grayMap whose brightness lies from floor to
+     * threshold (excluded), or outside of that range when inverting.
+     */
+    std::string brightnessToPath(GrayMap const &grayMap, double floor, double threshold,
+                                 long *nodeCount, potrace_param_t *params);
+
+    /**
+     * Trace a potrace bitmap whose top-left corner lies at (x0, y0) in
+     * the image.  The bitmap is left untouched.
+     */
+    std::string bitmapToPath(potrace_bitmap_t *bm, int x0, int y0,
+                             long *nodeCount, potrace_param_t *params);
 
-    std::vector<TracingEngineResult>traceBrightnessMulti(GdkPixbuf *pixbuf);
-    std::vector<TracingEngineResult>traceQuant(GdkPixbuf *pixbuf);
-    std::vector<TracingEngineResult>traceSingle(GdkPixbuf *pixbuf);
+    void traceBrightnessMulti(GdkPixbuf *pixbuf, ResultSink const &sink);
+    void traceQuant(GdkPixbuf *pixbuf, ResultSink const &sink);
+    void traceSingle(GdkPixbuf *pixbuf, ResultSink const &sink);
 
 
 };//class PotraceTracingEngine
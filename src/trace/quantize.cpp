@@ -10,10 +10,22 @@
  * Released under GNU GPL v2+, read the file 'COPYING' for more information.
  */
 
+#ifdef HAVE_CONFIG_H
+# include "config.h"  // only include where actually required!
+#endif
+
+#if HAVE_OPENMP
+#include <omp.h>
+#endif // HAVE_OPENMP
+
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <climits>
 #include <cstdio>
 #include <cstdlib>
 #include <new>
+#include <vector>
 #include <glib.h>
 
 #include "pool.h"
@@ -441,7 +453,7 @@ static void octreePrune(pool<Ocnode> *pool, Ocnode **ref, int ncolor)
  * build an octree associated to the area of a color map <rgbmap>,
  * included in the specified (x1,y1)--(x2,y2) rectangle.
  */
-static void octreeBuildArea(pool<Ocnode> *pool, RgbMap *rgbmap, Ocnode **ref,
+static void octreeBuildArea(pool<Ocnode> *pool, RgbMap const &rgbmap, Ocnode **ref,
                             int x1, int y1, int x2, int y2, int ncolor)
 {
     int dx = x2 - x1, dy = y2 - y1;
@@ -449,7 +461,7 @@ static void octreeBuildArea(pool<Ocnode> *pool, RgbMap *rgbmap, Ocnode **ref,
     Ocnode *ref1 = nullptr;
     Ocnode *ref2 = nullptr;
     if (dx == 1 && dy == 1)
-        ocnodeLeaf(pool, ref, rgbmap->getPixel(rgbmap, x1, y1));
+        ocnodeLeaf(pool, ref, rgbmap(x1, y1));
     else if (dx > dy)
         {
 	octreeBuildArea(pool, rgbmap, &ref1, x1, y1, xm, y2, ncolor);
@@ -470,18 +482,53 @@ static void octreeBuildArea(pool<Ocnode> *pool, RgbMap *rgbmap, Ocnode **ref,
 /**
  * build an octree associated to the <rgbmap> color map,
  * pruned to <ncolor> colors.
+ *
+ * the trees of horizontal bands of the map are built concurrently, one
+ * per pool, then merged.  the unpruned tree only depends on the set of
+ * colors, so the result is the same as a single pass.  nodes move from
+ * pool to pool when merged or freed: all the pools must outlive the tree.
  */
-static Ocnode *octreeBuild(pool<Ocnode> *pool, RgbMap *rgbmap, int ncolor)
+static Ocnode *octreeBuild(std::vector<pool<Ocnode>> &pools, RgbMap const &rgbmap, int ncolor)
 {
-    //create the octree
+    int nparts = std::max(std::min((int)pools.size(), rgbmap.height()), 1);
+    std::vector<Ocnode *> parts(nparts, nullptr);
+    std::atomic<bool> failed(false);
+
+    //create the octrees
+#if HAVE_OPENMP
+#pragma omp parallel for num_threads(nparts)
+#endif // HAVE_OPENMP
+    for (int i = 0; i < nparts; i++)
+        {
+        int y1 = (int)((long)rgbmap.height() * i / nparts);
+        int y2 = (int)((long)rgbmap.height() * (i + 1) / nparts);
+        try {
+            octreeBuildArea(&pools[i],
+                            rgbmap, &parts[i],
+                            0, y1, rgbmap.width(), y2, ncolor
+                            );
+        }
+        catch (std::bad_alloc &ex) {
+            failed = true;
+        }
+        }
+
     Ocnode *node = nullptr;
-    octreeBuildArea(pool,
-                    rgbmap, &node,
-                    0, 0, rgbmap->width, rgbmap->height, ncolor
-                    );
+    for (auto part : parts)
+        {
+        Ocnode *whole = node;
+        node = nullptr;
+        octreeMerge(&pools[0], nullptr, &node, whole, part);
+        }
+
+    if (failed)
+        {
+        octreeDelete(&pools[0], node);
+        throw std::bad_alloc();
+        }
 
     //prune the octree
-    octreePrune(pool, &node, ncolor);
+    octreePrune(&pools[0], &node, ncolor);
 
     //octreePrint(node);//debug
 
@@ -507,31 +554,36 @@ static void octreeIndex(Ocnode *node, RGB *rgbpal, int *index)
                 octreeIndex(i, rgbpal, index);
 }
 
-/**
- * compute the squared distance between two colors
- */
-static int distRGB(RGB rgb1, RGB rgb2)
+PaletteLookup::PaletteLookup(RGB const *rgbpal, int ncolor)
+    : rgbpal(rgbpal)
 {
-    return
-      (rgb1.r - rgb2.r) * (rgb1.r - rgb2.r)
-    + (rgb1.g - rgb2.g) * (rgb1.g - rgb2.g)
-    + (rgb1.b - rgb2.b) * (rgb1.b - rgb2.b);
-}
+    // squared distances from a value to the nearest and farthest of [lo, hi]
+    auto nearest = [](int v, int lo, int hi) { int d = v < lo ? lo - v : v > hi ? v - hi : 0; return d * d; };
+    auto farthest = [](int v, int lo, int hi) { int d = std::max(std::abs(v - lo), std::abs(v - hi)); return d * d; };
 
-/**
- * find the index of closest color in a palette
- */
-static int findRGB(RGB *rgbpal, int ncolor, RGB rgb)
-{
-    //assert(ncolor > 0);
-    //assert(rgbpal);
-    int index = -1, dist = 0;
-    for (int k = 0; k < ncolor; k++)
-        {
-        int d = distRGB(rgbpal[k], rgb);
-        if (index == -1 || d < dist) { dist = d; index = k; }
-        }
-    return index;
+    for (int r = 0; r < CELL_SIDE; r++)
+        for (int g = 0; g < CELL_SIDE; g++)
+            for (int b = 0; b < CELL_SIDE; b++)
+                {
+                int rlo = r << CELL_SHIFT, glo = g << CELL_SHIFT, blo = b << CELL_SHIFT;
+                int rhi = rlo + (1 << CELL_SHIFT) - 1, ghi = glo + (1 << CELL_SHIFT) - 1, bhi = blo + (1 << CELL_SHIFT) - 1;
+
+                int bound = INT_MAX;
+                for (int k = 0; k < ncolor; k++)
+                    {
+                    RGB c = rgbpal[k];
+                    bound = std::min(bound, farthest(c.r, rlo, rhi) + farthest(c.g, glo, ghi) + farthest(c.b, blo, bhi));
+                    }
+
+                first[cellIndex(r, g, b)] = candidates.size();
+                for (int k = 0; k < ncolor; k++)
+                    {
+                    RGB c = rgbpal[k];
+                    if (nearest(c.r, rlo, rhi) + nearest(c.g, glo, ghi) + nearest(c.b, blo, bhi) <= bound)
+                        candidates.push_back(k);
+                    }
+                }
+    first[CELL_SIDE * CELL_SIDE * CELL_SIDE] = candidates.size();
 }
 
 /**
@@ -546,18 +598,21 @@ static int compRGB(const void *a, const void *b)
 /**
  * quantize an RGB image to a reduced number of colors.
  */
-IndexedMap *rgbMapQuantize(RgbMap *rgbmap, int ncolor)
+std::unique_ptr<IndexedMap> rgbMapQuantize(RgbMap const &rgbmap, int ncolor, int numThreads)
 {
-    assert(rgbmap);
     assert(ncolor > 0);
 
-    IndexedMap *newmap = nullptr;
+    // the color look up table of an IndexedMap is limited to 256 entries
+    if (ncolor > 256)
+        ncolor = 256;
+
+    std::unique_ptr<IndexedMap> newmap;
 
-    pool<Ocnode> pool;
+    std::vector<pool<Ocnode>> pools(std::max(numThreads, 1));
 
     Ocnode *tree = nullptr;
     try {
-        tree = octreeBuild(&pool, rgbmap, ncolor);
+        tree = octreeBuild(pools, rgbmap, ncolor);
     }
     catch (std::bad_alloc &ex) {
         //should do smthg else?
@@ -565,35 +620,128 @@ IndexedMap *rgbMapQuantize(RgbMap *rgbmap, int ncolor)
     }
 
     if (tree) {
-        RGB *rgbpal = new RGB[ncolor];
+        RGB rgbpal[256];
         int indexes = 0;
         octreeIndex(tree, rgbpal, &indexes);
 
-        octreeDelete(&pool, tree);
+        octreeDelete(&pools[0], tree);
 
         // stacking with increasing contrasts
         qsort((void *)rgbpal, indexes, sizeof(RGB), compRGB);
 
         // make the new map
-        newmap = IndexedMapCreate(rgbmap->width, rgbmap->height);
-        if (newmap) {
-            // fill in the color lookup table
-            for (int i = 0; i < indexes; i++) {
-                newmap->clut[i] = rgbpal[i];
-            }
-            newmap->nrColors = indexes;
-
-            // fill in new map pixels
-            for (int y = 0; y < rgbmap->height; y++) {
-                for (int x = 0; x < rgbmap->width; x++) {
-                    RGB rgb = rgbmap->getPixel(rgbmap, x, y);
-                    int index = findRGB(rgbpal, ncolor, rgb);
-                    newmap->setPixel(newmap, x, y, index);
-                }
-            }
-        }
-        delete[] rgbpal;
+        newmap = rgbMapQuantize(rgbmap, rgbpal, indexes);
     }
 
     return newmap;
 }
+
+/**
+ * quantize an RGB image to a given palette.
+ */
+std::unique_ptr<IndexedMap> rgbMapQuantize(RgbMap const &rgbmap, RGB const *palette, int ncolor)
+{
+    assert(ncolor > 0);
+
+    // the color look up table of an IndexedMap is limited to 256 entries
+    if (ncolor > 256)
+        ncolor = 256;
+
+    auto newmap = IndexedMapCreate(rgbmap.width(), rgbmap.height());
+    if (newmap) {
+        // fill in the color lookup table
+        std::copy(palette, palette + ncolor, newmap->clut);
+        newmap->nrColors = ncolor;
+
+        // fill in new map pixels
+        PaletteLookup lookup(newmap->clut, newmap->nrColors);
+        rgbMapIndexRows(rgbmap, 0, rgbmap.height(), lookup, *newmap, 0);
+    }
+
+    return newmap;
+}
+
+
+/*#########################################################################
+### Q U A N T I Z E   B Y   P A R T S
+#########################################################################*/
+
+/**
+ * While parts are being added, the tree is pruned down to this number of
+ * leaves, which bounds its memory whatever the size of the image.
+ */
+static const int PARTIAL_LEAVES = 4096;
+
+struct RgbQuantizer::Octree
+{
+    pool<Ocnode> nodes;
+    Ocnode *root = nullptr;
+};
+
+RgbQuantizer::RgbQuantizer(int nrColors)
+    : tree(new Octree)
+    , nrColors(nrColors > 256 ? 256 : nrColors)
+{
+    assert(nrColors > 0);
+}
+
+RgbQuantizer::~RgbQuantizer()
+{
+    octreeDelete(&tree->nodes, tree->root);
+}
+
+bool RgbQuantizer::addRows(RgbMap const &rgbmap, int y0, int y1)
+{
+    if (y0 >= y1 || rgbmap.width() < 1)
+        return true;
+
+    try {
+        Ocnode *part = nullptr;
+        octreeBuildArea(&tree->nodes, rgbmap, &part, 0, y0, rgbmap.width(), y1, nrColors);
+
+        // the merged tree keeps a reference to its root
+        Ocnode *whole = tree->root;
+        tree->root = nullptr;
+        octreeMerge(&tree->nodes, nullptr, &tree->root, whole, part);
+
+        octreePrune(&tree->nodes, &tree->root, std::max(nrColors, PARTIAL_LEAVES));
+    }
+    catch (std::bad_alloc &ex) {
+        g_warning("RgbQuantizer: Failed to allocate enough memory to add rows");
+        return false;
+    }
+    return true;
+}
+
+std::vector<RGB> RgbQuantizer::palette()
+{
+    if (!tree->root)
+        return {};
+
+    octreePrune(&tree->nodes, &tree->root, nrColors);
+
+    RGB rgbpal[256];
+    int indexes = 0;
+    octreeIndex(tree->root, rgbpal, &indexes);
+
+    // stacking with increasing contrasts
+    qsort((void *)rgbpal, indexes, sizeof(RGB), compRGB);
+
+    return std::vector<RGB>(rgbpal, rgbpal + indexes);
+}
+
+void rgbMapIndexRows(RgbMap const &rgbmap, int y0, int y1, PaletteLookup const &lookup, IndexedMap &iMap, int iy,
+                     int numThreads)
+{
+    // rows are independent
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(static) num_threads(numThreads)
+#endif // HAVE_OPENMP
+    for (int y = y0; y < y1; y++) {
+        RGB const *in = rgbmap.row(y);
+        unsigned char *out = iMap.row(iy + y - y0);
+        for (int x = 0; x < rgbmap.width(); x++) {
+            out[x] = lookup.find(in[x]);
+        }
+    }
+}
@@ -13,11 +13,112 @@
 #ifndef __QUANTIZE_H__
 #define __QUANTIZE_H__
 
+#include <vector>
+
 #include "imagemap.h"
 
 /**
- * Quantize an RGB image to a reduced number of colors.
+ * Quantize an RGB image to a reduced number of colors, on numThreads
+ * threads.  The result does not depend on their number.
+ */
+std::unique_ptr<IndexedMap> rgbMapQuantize(RgbMap const &rgbmap, int nrColors, int numThreads = 1);
+
+/**
+ * Quantize an RGB image to the given palette, for instance one made by
+ * an RgbQuantizer from several images.
+ */
+std::unique_ptr<IndexedMap> rgbMapQuantize(RgbMap const &rgbmap, RGB const *palette, int nrColors);
+
+/**
+ * Quantization by parts: of an image that is too large to be held in
+ * memory at once, or of a set of images that should share one palette.
+ * The colors are added part by part, then the palette is shared by all
+ * the parts when mapping them to indexes.
+ */
+class RgbQuantizer
+{
+public:
+    RgbQuantizer(int nrColors);
+    ~RgbQuantizer();
+
+    RgbQuantizer(RgbQuantizer const &) = delete;
+    RgbQuantizer &operator=(RgbQuantizer const &) = delete;
+
+    /**
+     * Add the colors of the rows y0 to y1 (excluded) of rgbmap.
+     * Returns false when out of memory.
+     */
+    bool addRows(RgbMap const &rgbmap, int y0, int y1);
+
+    /**
+     * The palette of all the colors added so far, sorted by brightness.
+     */
+    std::vector<RGB> palette();
+
+private:
+    struct Octree;
+    std::unique_ptr<Octree> tree;
+    int nrColors;
+};
+
+/**
+ * find the index of closest color in a palette.
+ *
+ * the rgb cube is divided into cells, and each cell only keeps the
+ * palette colors that may be the closest to one of its colors: a color
+ * whose smallest distance to the cell is larger than the largest distance
+ * of another color can never win.  candidates are kept in palette order,
+ * so ties go to the lowest index, as in a search of the whole palette.
+ *
+ * building the cells is costly, so a lookup is made once per palette and
+ * shared by all the rows mapped to it.  the palette is not copied.
+ */
+class PaletteLookup
+{
+public:
+    PaletteLookup(RGB const *rgbpal, int ncolor);
+
+    int find(RGB rgb) const
+    {
+        int cell = cellIndex(rgb.r >> CELL_SHIFT, rgb.g >> CELL_SHIFT, rgb.b >> CELL_SHIFT);
+        int index = -1, dist = 0;
+        for (int i = first[cell]; i < first[cell + 1]; i++)
+            {
+            int k = candidates[i];
+            int d = distRGB(rgbpal[k], rgb);
+            if (index == -1 || d < dist) { dist = d; index = k; }
+            }
+        return index;
+    }
+
+private:
+    static const int CELL_SHIFT = 5;
+    static const int CELL_SIDE = 256 >> CELL_SHIFT;
+
+    static int cellIndex(int r, int g, int b) { return (r * CELL_SIDE + g) * CELL_SIDE + b; }
+
+    /**
+     * compute the squared distance between two colors
+     */
+    static int distRGB(RGB rgb1, RGB rgb2)
+    {
+        return
+          (rgb1.r - rgb2.r) * (rgb1.r - rgb2.r)
+        + (rgb1.g - rgb2.g) * (rgb1.g - rgb2.g)
+        + (rgb1.b - rgb2.b) * (rgb1.b - rgb2.b);
+    }
+
+    RGB const *rgbpal;
+    std::vector<unsigned char> candidates;
+    int first[CELL_SIDE * CELL_SIDE * CELL_SIDE + 1];
+};
+
+/**
+ * Map the rows y0 to y1 (excluded) of rgbmap to the closest colors of
+ * lookup, into the rows of iMap starting at iy, on numThreads threads.
+ * The lookup is made from the look up table of iMap.
  */
-IndexedMap *rgbMapQuantize(RgbMap *rgbmap, int nrColors);
+void rgbMapIndexRows(RgbMap const &rgbmap, int y0, int y1, PaletteLookup const &lookup, IndexedMap &iMap, int iy,
+                     int numThreads = 1);
 
 #endif /* __QUANTIZE_H__ */
@@ -6,14 +6,22 @@
 
    Released under GNU GPL v2+, read the file 'COPYING' for more information.
  */
+#ifdef HAVE_CONFIG_H
+# include "config.h"  // only include where actually required!
+#endif
+
 #include "siox.h"
 
 #include <cmath>
 #include <cstdarg>
-#include <map>
+#include <unordered_map>
 #include <algorithm>
 #include <cstdlib>
 
+#if HAVE_OPENMP
+#include <omp.h>
+#endif
+
 
 namespace org
 {
@@ -68,8 +76,14 @@ static unsigned long getRGB(float a, float r, float g, float b)
 //#########################################
 static const int ROOT_TAB_SIZE = 16;
 static float cbrt_table[ROOT_TAB_SIZE +1];
+static float qn_table[ROOT_TAB_SIZE +1];
 
-double CieLab::cbrt(double x)
+/**
+ * sRGB channel value (0-255) to linear intensity.
+ */
+static float linear_table[256];
+
+static double approxCbrt(double x)
 {
     double y = cbrt_table[int(x*ROOT_TAB_SIZE )]; // assuming x \in [0, 1]
     y = (2.0 * y + x/(y*y))/3.0;
@@ -77,9 +91,7 @@ double CieLab::cbrt(double x)
     return y;
 }
 
-static float qn_table[ROOT_TAB_SIZE +1];
-
-double CieLab::qnrt(double x)
+static double approxQnrt(double x)
 {
     double y = qn_table[int(x*ROOT_TAB_SIZE )]; // assuming x \in [0, 1]
     double Y = y*y;
@@ -89,27 +101,56 @@ double CieLab::qnrt(double x)
     return y;
 }
 
-double CieLab::pow24(double x)
+static double approxPow24(double x)
 {
-    double onetwo = x*qnrt(x);
+    double onetwo = x*approxQnrt(x);
     return onetwo*onetwo;
 }
 
-
-static bool _clab_inited_ = false;
-void CieLab::init()
+static bool initTables()
 {
-    if (!_clab_inited_)
+    cbrt_table[0] = pow(float(1)/float(ROOT_TAB_SIZE*2), 0.3333);
+    qn_table[0]   = pow(float(1)/float(ROOT_TAB_SIZE*2), 0.2);
+    for(int i = 1; i < ROOT_TAB_SIZE +1; i++)
         {
-        cbrt_table[0] = pow(float(1)/float(ROOT_TAB_SIZE*2), 0.3333);
-        qn_table[0]   = pow(float(1)/float(ROOT_TAB_SIZE*2), 0.2);
-        for(int i = 1; i < ROOT_TAB_SIZE +1; i++)
-            {
-            cbrt_table[i] = pow(float(i)/float(ROOT_TAB_SIZE), 0.3333);
-            qn_table[i] = pow(float(i)/float(ROOT_TAB_SIZE), 0.2);
-            }
-        _clab_inited_ = true;
+        cbrt_table[i] = pow(float(i)/float(ROOT_TAB_SIZE), 0.3333);
+        qn_table[i] = pow(float(i)/float(ROOT_TAB_SIZE), 0.2);
         }
+
+    for (int i = 0; i < 256; i++)
+        {
+        float f = ((float)i) / 255.0;
+        if (f > 0.04045)
+            //f = (float) pow((f + 0.055) / 1.055, 2.4);
+            f = (float) approxPow24((f + 0.055) / 1.055);
+        else
+            f = f / 12.92;
+        linear_table[i] = f;
+        }
+    return true;
+}
+
+double CieLab::cbrt(double x)
+{
+    return approxCbrt(x);
+}
+
+double CieLab::qnrt(double x)
+{
+    return approxQnrt(x);
+}
+
+double CieLab::pow24(double x)
+{
+    return approxPow24(x);
+}
+
+
+void CieLab::init()
+{
+    // Thread safe, CieLabs are created on several threads
+    static bool inited = initTables();
+    (void)inited;
 }
 
 
@@ -121,32 +162,9 @@ CieLab::CieLab(unsigned long rgb)
 {
     init();
 
-    int ir  = (rgb>>16) & 0xff;
-    int ig  = (rgb>> 8) & 0xff;
-    int ib  = (rgb    ) & 0xff;
-
-    float fr = ((float)ir) / 255.0;
-    float fg = ((float)ig) / 255.0;
-    float fb = ((float)ib) / 255.0;
-
-    //printf("fr:%f fg:%f fb:%f\n", fr, fg, fb);
-    if (fr > 0.04045)
-        //fr = (float) pow((fr + 0.055) / 1.055, 2.4);
-        fr = (float) pow24((fr + 0.055) / 1.055);
-    else
-        fr = fr / 12.92;
-
-    if (fg > 0.04045)
-        //fg = (float) pow((fg + 0.055) / 1.055, 2.4);
-        fg = (float) pow24((fg + 0.055) / 1.055);
-    else
-        fg = fg / 12.92;
-
-    if (fb > 0.04045)
-        //fb = (float) pow((fb + 0.055) / 1.055, 2.4);
-        fb = (float) pow24((fb + 0.055) / 1.055);
-    else
-        fb = fb / 12.92;
+    float fr = linear_table[(rgb>>16) & 0xff];
+    float fg = linear_table[(rgb>> 8) & 0xff];
+    float fb = linear_table[(rgb    ) & 0xff];
 
     // Use white = D65
     const float x = fr * 0.4124 + fg * 0.3576 + fb * 0.1805;
@@ -160,19 +178,19 @@ CieLab::CieLab(unsigned long rgb)
     //printf("vx:%f vy:%f vz:%f\n", vx, vy, vz);
     if (vx > 0.008856)
         //vx = (float) pow(vx, 0.3333);
-        vx = (float) cbrt(vx);
+        vx = (float) approxCbrt(vx);
     else
         vx = (7.787 * vx) + (16.0 / 116.0);
 
     if (vy > 0.008856)
         //vy = (float) pow(vy, 0.3333);
-        vy = (float) cbrt(vy);
+        vy = (float) approxCbrt(vy);
     else
         vy = (7.787 * vy) + (16.0 / 116.0);
 
     if (vz > 0.008856)
         //vz = (float) pow(vz, 0.3333);
-        vz = (float) cbrt(vz);
+        vz = (float) approxCbrt(vz);
     else
         vz = (7.787 * vz) + (16.0 / 116.0);
 
@@ -241,7 +259,7 @@ unsigned long CieLab::toRGB()
 /**
  * Squared Euclidian distance between this and another color
  */
-float CieLab::diffSq(const CieLab &other)
+float CieLab::diffSq(const CieLab &other) const
 {
     float sum=0.0;
     sum += (L - other.L) * (L - other.L);
@@ -274,54 +292,6 @@ float CieLab::diff(unsigned int rgb0, unsigned int rgb1)
 
 
 
-//########################################################################
-//#  T U P E L
-//########################################################################
-
-/**
- * Helper class for storing the minimum distances to a cluster centroid
- * in background and foreground and the index to the centroids in each
- * signature for a given color.
- */
-class Tupel {
-public:
-
-    Tupel()
-        {
-        minBgDist  = 0.0f;
-        indexMinBg = 0;
-        minFgDist  = 0.0f;
-        indexMinFg = 0;
-        }
-    Tupel(float minBgDistArg, long indexMinBgArg,
-          float minFgDistArg, long indexMinFgArg)
-        {
-        minBgDist  = minBgDistArg;
-        indexMinBg = indexMinBgArg;
-        minFgDist  = minFgDistArg;
-        indexMinFg = indexMinFgArg;
-        }
-    Tupel(const Tupel &other)
-        {
-        minBgDist  = other.minBgDist;
-        indexMinBg = other.indexMinBg;
-        minFgDist  = other.minFgDist;
-        indexMinFg = other.indexMinFg;
-        }
-    Tupel &operator=(const Tupel &other)
-        = default;
-    virtual ~Tupel()
-        = default;
-
-    float minBgDist;
-    long  indexMinBg;
-    float minFgDist;
-    long  indexMinFg;
-
- };
-
-
-
 //########################################################################
 //#  S I O X    I M A G E
 //########################################################################
@@ -732,7 +702,8 @@ Siox::Siox() :
     pixelCount(0),
     image(nullptr),
     cm(nullptr),
-    labelField(nullptr)
+    labelField(nullptr),
+    numThreads(1)
 {
     init();
 }
@@ -748,7 +719,8 @@ Siox::Siox(SioxObserver *observer) :
     pixelCount(0),
     image(nullptr),
     cm(nullptr),
-    labelField(nullptr)
+    labelField(nullptr),
+    numThreads(1)
 {
     init();
 }
@@ -846,42 +818,29 @@ SioxImage Siox::extractForeground(const SioxImage &originalImage,
     trace("### Creating signatures");
 
     //#### create color signatures
+    std::vector<CieLab> imageClab(pixelCount);
+    long const count = pixelCount;
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(static) num_threads(numThreads)
+#endif
+    for (long i = 0 ; i < count ; i++)
+        imageClab[i] = CieLab(image[i]);
+
     std::vector<CieLab> knownBg;
     std::vector<CieLab> knownFg;
-    CieLab *imageClab = new CieLab[pixelCount];
     for (unsigned long i=0 ; i<pixelCount ; i++)
         {
         float conf = cm[i];
-        unsigned int pix = image[i];
-        CieLab lab(pix);
-        imageClab[i] = lab;
         if (conf <= BACKGROUND_CONFIDENCE)
-            knownBg.push_back(lab);
+            knownBg.push_back(imageClab[i]);
         else if (conf >= FOREGROUND_CONFIDENCE)
-            knownFg.push_back(lab);
+            knownFg.push_back(imageClab[i]);
         }
 
-    /*
-    std::vector<CieLab> imageClab;
-    for (int y = 0 ; y < workImage.getHeight() ; y++)
-        for (int x = 0 ; x < workImage.getWidth() ; x++)
-            {
-            float cm = workImage.getConfidence(x, y);
-            unsigned int pix = workImage.getPixel(x, y);
-            CieLab lab(pix);
-            imageClab.push_back(lab);
-            if (cm <= BACKGROUND_CONFIDENCE)
-                knownBg.push_back(lab); //note: uses CieLab(rgb)
-            else if (cm >= FOREGROUND_CONFIDENCE)
-                knownFg.push_back(lab);
-            }
-    */
-
     if (!progressReport(10.0))
         {
         error("User aborted");
         workImage.setValid(false);
-        delete[] imageClab;
         delete[] labelField;
         return workImage;
         }
@@ -894,7 +853,6 @@ SioxImage Siox::extractForeground(const SioxImage &originalImage,
         {
         error("Could not create background signature");
         workImage.setValid(false);
-        delete[] imageClab;
         delete[] labelField;
         return workImage;
         }
@@ -903,7 +861,6 @@ SioxImage Siox::extractForeground(const SioxImage &originalImage,
         {
         error("User aborted");
         workImage.setValid(false);
-        delete[] imageClab;
         delete[] labelField;
         return workImage;
         }
@@ -914,7 +871,6 @@ SioxImage Siox::extractForeground(const SioxImage &originalImage,
         {
         error("Could not create foreground signature");
         workImage.setValid(false);
-        delete[] imageClab;
         delete[] labelField;
         return workImage;
         }
@@ -926,7 +882,6 @@ SioxImage Siox::extractForeground(const SioxImage &originalImage,
         // segmentation impossible
         error("Signature size is < 1.  Segmentation is impossible");
         workImage.setValid(false);
-        delete[] imageClab;
         delete[] labelField;
         return workImage;
         }
@@ -935,98 +890,64 @@ SioxImage Siox::extractForeground(const SioxImage &originalImage,
         {
         error("User aborted");
         workImage.setValid(false);
-        delete[] imageClab;
         delete[] labelField;
         return workImage;
         }
 
 
-    // classify using color signatures,
-    // classification cached in hashmap for drb and speedup purposes
+    // classify using color signatures, in ten steps so that progress
+    // can be reported between them.  Each thread caches the
+    // classification of the colors it has seen.
     trace("### Analyzing image");
 
-    std::map<unsigned int, Tupel> hs;
-
-    unsigned int progressResolution = pixelCount / 10;
+    std::vector<std::unordered_map<unsigned int, bool>> memos(numThreads);
 
-    for (unsigned int i=0; i<pixelCount; i++)
+    long const step = count / 10 + 1;
+    for (long first = 0 ; first < count ; first += step)
         {
-        if (i % progressResolution == 0)
+        float progress = 30.0 + 60.0 * (float)first / (float)count;
+        //trace("### progress:%f", progress);
+        if (!progressReport(progress))
             {
-            float progress =
-                30.0 + 60.0 * (float)i / (float)pixelCount;
-            //trace("### progress:%f", progress);
-            if (!progressReport(progress))
-                {
-                error("User aborted");
-                delete[] imageClab;
-                delete[] labelField;
-                workImage.setValid(false);
-                return workImage;
-                }
+            error("User aborted");
+            delete[] labelField;
+            workImage.setValid(false);
+            return workImage;
             }
 
-        if (cm[i] >= FOREGROUND_CONFIDENCE)
-            {
-            cm[i] = CERTAIN_FOREGROUND_CONFIDENCE;
-            }
-        else if (cm[i] <= BACKGROUND_CONFIDENCE)
-            {
-            cm[i] = CERTAIN_BACKGROUND_CONFIDENCE;
-            }
-        else // somewhere in between
+        long const last = std::min(count, first + step);
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(static) num_threads(numThreads)
+#endif
+        for (long i = first ; i < last ; i++)
             {
-            bool isBackground = true;
-            std::map<unsigned int, Tupel>::iterator iter = hs.find(i);
-            if (iter != hs.end()) //found
+            if (cm[i] >= FOREGROUND_CONFIDENCE)
+                {
+                cm[i] = CERTAIN_FOREGROUND_CONFIDENCE;
+                continue;
+                }
+            else if (cm[i] <= BACKGROUND_CONFIDENCE)
                 {
-                Tupel tupel  = iter->second;
-                isBackground = tupel.minBgDist <= tupel.minFgDist;
+                cm[i] = CERTAIN_BACKGROUND_CONFIDENCE;
+                continue;
+                }
+
+            // somewhere in between
+#if HAVE_OPENMP
+            auto &memo = memos[omp_get_thread_num()];
+#else
+            auto &memo = memos[0];
+#endif
+            bool isBackground;
+            auto iter = memo.find(image[i]);
+            if (iter != memo.end()) //found
+                {
+                isBackground = iter->second;
                 }
             else
                 {
-                CieLab lab   = imageClab[i];
-                float minBg  = lab.diffSq(bgSignature[0]);
-                int minIndex = 0;
-                for (unsigned int j=1; j<bgSignature.size() ; j++)
-                    {
-                    float d = lab.diffSq(bgSignature[j]);
-                    if (d<minBg)
-                        {
-                        minBg    = d;
-                        minIndex = j;
-                        }
-                    }
-                Tupel tupel(0.0f, 0,  0.0f, 0);
-                tupel.minBgDist  = minBg;
-                tupel.indexMinBg = minIndex;
-                float minFg      = 1.0e6f;
-                minIndex         = -1;
-                for (unsigned int j = 0 ; j < fgSignature.size() ; j++)
-                    {
-                    float d = lab.diffSq(fgSignature[j]);
-                    if (d < minFg)
-                        {
-                        minFg    = d;
-                        minIndex = j;
-                        }
-                    }
-                tupel.minFgDist  = minFg;
-                tupel.indexMinFg = minIndex;
-                if (fgSignature.empty())
-                    {
-                    isBackground = (minBg <= clusterSize);
-                    // remove next line to force behaviour of old algorithm
-                    //error("foreground signature does not exist");
-                    //delete[] labelField;
-                    //workImage.setValid(false);
-                    //return workImage;
-                    }
-                else
-                    {
-                    isBackground = minBg < minFg;
-                    }
-                hs[image[i]] = tupel;
+                isBackground = classify(imageClab[i], bgSignature, fgSignature);
+                memo.emplace(image[i], isBackground);
                 }
 
             if (isBackground)
@@ -1036,8 +957,7 @@ SioxImage Siox::extractForeground(const SioxImage &originalImage,
             }
         }
 
-
-    delete[] imageClab;
+    memos.clear();
 
     trace("### postProcessing");
 
@@ -1053,7 +973,10 @@ SioxImage Siox::extractForeground(const SioxImage &originalImage,
 
     normalizeMatrix(cm, pixelCount);
 
-    for (unsigned int i=0; i < pixelCount; i++)
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(static) num_threads(numThreads)
+#endif
+    for (long i = 0 ; i < count ; i++)
         {
         if (cm[i] >= UNKNOWN_REGION_CONFIDENCE)
             cm[i] = CERTAIN_FOREGROUND_CONFIDENCE;
@@ -1062,7 +985,7 @@ SioxImage Siox::extractForeground(const SioxImage &originalImage,
         }
 
     keepOnlyLargeComponents(UNKNOWN_REGION_CONFIDENCE, 1.5/*sizeFactorToKeep*/);
-    fillColorRegions();
+    fillColorRegions(imageClab);
     dilate(cm, width, height);
 
     if (!progressReport(100.0))
@@ -1075,7 +998,10 @@ SioxImage Siox::extractForeground(const SioxImage &originalImage,
 
 
     //#### We are done.  Now clear everything but the background
-    for (unsigned long i = 0; i<pixelCount ; i++)
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(static) num_threads(numThreads)
+#endif
+    for (long i = 0 ; i < count ; i++)
         {
         float conf = cm[i];
         if (conf < FOREGROUND_CONFIDENCE)
@@ -1349,6 +1275,39 @@ bool Siox::colorSignature(const std::vector<CieLab> &inputVec,
 
 
 
+/**
+ *  Decide whether a color of the unknown region is background
+ */
+bool Siox::classify(const CieLab &lab,
+                    const std::vector<CieLab> &bgSignature,
+                    const std::vector<CieLab> &fgSignature) const
+{
+    float minBg = lab.diffSq(bgSignature[0]);
+    for (unsigned int j=1; j<bgSignature.size() ; j++)
+        {
+        float d = lab.diffSq(bgSignature[j]);
+        if (d<minBg)
+            minBg = d;
+        }
+
+    if (fgSignature.empty())
+        {
+        // remove next line to force behaviour of old algorithm
+        return minBg <= clusterSize;
+        }
+
+    float minFg = 1.0e6f;
+    for (unsigned int j = 0 ; j < fgSignature.size() ; j++)
+        {
+        float d = lab.diffSq(fgSignature[j]);
+        if (d < minFg)
+            minFg = d;
+        }
+    return minBg < minFg;
+}
+
+
+
 /**
  *
  */
@@ -1468,7 +1427,7 @@ int Siox::depthFirstSearch(int startPos,
 /**
  *
  */
-void Siox::fillColorRegions()
+void Siox::fillColorRegions(const std::vector<CieLab> &imageClab)
 {
     for (unsigned long idx = 0 ; idx<pixelCount ; idx++)
         labelField[idx] = -1;
@@ -1482,7 +1441,7 @@ void Siox::fillColorRegions()
             continue; // already visited or bg
             }
 
-        unsigned int  origColor = image[i];
+        const CieLab &origColor = imageClab[i];
         unsigned long curLabel  = i+1;
         labelField[i]           = curLabel;
         cm[i]                   = CERTAIN_FOREGROUND_CONFIDENCE;
@@ -1499,7 +1458,7 @@ void Siox::fillColorRegions()
             // check all four neighbours
             int left = pos-1;
             if (((int)x)-1 >= 0 && labelField[left] == -1
-                        && CieLab::diff(image[left], origColor)<1.0)
+                        && imageClab[left].diffSq(origColor)<1.0f)
                 {
                 labelField[left]=curLabel;
                 cm[left]=CERTAIN_FOREGROUND_CONFIDENCE;
@@ -1508,7 +1467,7 @@ void Siox::fillColorRegions()
                 }
             int right = pos+1;
             if (x+1 < width && labelField[right]==-1
-                        && CieLab::diff(image[right], origColor)<1.0)
+                        && imageClab[right].diffSq(origColor)<1.0f)
                 {
                 labelField[right]=curLabel;
                 cm[right]=CERTAIN_FOREGROUND_CONFIDENCE;
@@ -1517,7 +1476,7 @@ void Siox::fillColorRegions()
                 }
             int top = pos - width;
             if (((int)y)-1>=0 && labelField[top]==-1
-                        && CieLab::diff(image[top], origColor)<1.0)
+                        && imageClab[top].diffSq(origColor)<1.0f)
                 {
                 labelField[top]=curLabel;
                 cm[top]=CERTAIN_FOREGROUND_CONFIDENCE;
@@ -1526,7 +1485,7 @@ void Siox::fillColorRegions()
                 }
             int bottom = pos + width;
             if (y+1 < height && labelField[bottom]==-1
-                        && CieLab::diff(image[bottom], origColor)<1.0)
+                        && imageClab[bottom].diffSq(origColor)<1.0f)
                 {
                 labelField[bottom]=curLabel;
                 cm[bottom]=CERTAIN_FOREGROUND_CONFIDENCE;
@@ -1543,6 +1502,37 @@ void Siox::fillColorRegions()
 
 
 
+/**
+ * Width of the column strips that the vertical passes of the matrix
+ * operators below are split into.
+ */
+static const int STRIP_WIDTH = 64;
+
+/**
+ * Run a matrix operator as rowPass(y) on every row, followed by
+ * columnPass(x0, x1) on every strip of columns, on numThreads threads.
+ * Each pass of the operators only reads and writes within one row, or
+ * one column, so the result is the same as running them serially.
+ */
+template <typename RowPass, typename ColumnPass>
+static void separablePasses(int xres, int yres, int numThreads,
+                            RowPass rowPass, ColumnPass columnPass)
+{
+    (void)numThreads;
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(static) num_threads(numThreads)
+#endif
+    for (int y=0; y<yres; y++)
+        rowPass(y);
+
+    int strips = (xres + STRIP_WIDTH - 1) / STRIP_WIDTH;
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(static) num_threads(numThreads)
+#endif
+    for (int s=0; s<strips; s++)
+        columnPass(s * STRIP_WIDTH, std::min(xres, (s + 1) * STRIP_WIDTH));
+}
+
 /**
  * Applies the morphological dilate operator.
  *
@@ -1550,46 +1540,44 @@ void Siox::fillColorRegions()
  */
 void Siox::dilate(float *cm, int xres, int yres)
 {
-
-    for (int y=0; y<yres; y++)
+    auto rowPass = [=](int y)
         {
+        float *row = cm + y*xres;
         for (int x=0; x<xres-1; x++)
-             {
-             int idx=(y*xres)+x;
-             if (cm[idx+1]>cm[idx])
-                 cm[idx]=cm[idx+1];
-             }
-        }
-
-    for (int y=0; y<yres; y++)
-        {
+            {
+            if (row[x+1]>row[x])
+                row[x]=row[x+1];
+            }
         for (int x=xres-1; x>=1; x--)
             {
-            int idx=(y*xres)+x;
-            if (cm[idx-1]>cm[idx])
-                cm[idx]=cm[idx-1];
+            if (row[x-1]>row[x])
+                row[x]=row[x-1];
             }
-        }
+        };
 
-    for (int y=0; y<yres-1; y++)
+    auto columnPass = [=](int x0, int x1)
         {
-        for (int x=0; x<xres; x++)
+        for (int y=0; y<yres-1; y++)
             {
-            int idx=(y*xres)+x;
-            if (cm[((y+1)*xres)+x] > cm[idx])
-                cm[idx]=cm[((y+1)*xres)+x];
+            for (int x=x0; x<x1; x++)
+                {
+                int idx=(y*xres)+x;
+                if (cm[((y+1)*xres)+x] > cm[idx])
+                    cm[idx]=cm[((y+1)*xres)+x];
+                }
             }
-        }
-
-    for (int y=yres-1; y>=1; y--)
-        {
-        for (int x=0; x<xres; x++)
+        for (int y=yres-1; y>=1; y--)
             {
-            int idx=(y*xres)+x;
-            if (cm[((y-1)*xres)+x] > cm[idx])
-                cm[idx]=cm[((y-1)*xres)+x];
+            for (int x=x0; x<x1; x++)
+                {
+                int idx=(y*xres)+x;
+                if (cm[((y-1)*xres)+x] > cm[idx])
+                    cm[idx]=cm[((y-1)*xres)+x];
+                }
             }
-        }
+        };
+
+    separablePasses(xres, yres, numThreads, rowPass, columnPass);
 }
 
 /**
@@ -1597,42 +1585,44 @@ void Siox::dilate(float *cm, int xres, int yres)
  */
 void Siox::erode(float *cm, int xres, int yres)
 {
-    for (int y=0; y<yres; y++)
+    auto rowPass = [=](int y)
         {
+        float *row = cm + y*xres;
         for (int x=0; x<xres-1; x++)
             {
-            int idx=(y*xres)+x;
-            if (cm[idx+1] < cm[idx])
-                cm[idx]=cm[idx+1];
+            if (row[x+1] < row[x])
+                row[x]=row[x+1];
             }
-        }
-    for (int y=0; y<yres; y++)
-        {
         for (int x=xres-1; x>=1; x--)
             {
-            int idx=(y*xres)+x;
-            if (cm[idx-1] < cm[idx])
-                cm[idx]=cm[idx-1];
+            if (row[x-1] < row[x])
+                row[x]=row[x-1];
             }
-        }
-    for (int y=0; y<yres-1; y++)
+        };
+
+    auto columnPass = [=](int x0, int x1)
         {
-        for (int x=0; x<xres; x++)
+        for (int y=0; y<yres-1; y++)
             {
-            int idx=(y*xres)+x;
-            if (cm[((y+1)*xres)+x] < cm[idx])
-                cm[idx]=cm[((y+1)*xres)+x];
+            for (int x=x0; x<x1; x++)
+                {
+                int idx=(y*xres)+x;
+                if (cm[((y+1)*xres)+x] < cm[idx])
+                    cm[idx]=cm[((y+1)*xres)+x];
+                }
             }
-        }
-    for (int y=yres-1; y>=1; y--)
-        {
-        for (int x=0; x<xres; x++)
+        for (int y=yres-1; y>=1; y--)
             {
-            int idx=(y*xres)+x;
-            if (cm[((y-1)*xres)+x] < cm[idx])
-                cm[idx]=cm[((y-1)*xres)+x];
+            for (int x=x0; x<x1; x++)
+                {
+                int idx=(y*xres)+x;
+                if (cm[((y-1)*xres)+x] < cm[idx])
+                    cm[idx]=cm[((y-1)*xres)+x];
+                }
             }
-        }
+        };
+
+    separablePasses(xres, yres, numThreads, rowPass, columnPass);
 }
 
 
@@ -1643,6 +1633,9 @@ void Siox::erode(float *cm, int xres, int yres)
 void Siox::normalizeMatrix(float *cm, int cmSize)
 {
     float max= -1000000.0f;
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(static) reduction(max:max) num_threads(numThreads)
+#endif
     for (int i=0; i<cmSize; i++)
         if (cm[i] > max) max=cm[i];
 
@@ -1661,6 +1654,9 @@ void Siox::normalizeMatrix(float *cm, int cmSize)
  */
 void Siox::premultiplyMatrix(float alpha, float *cm, int cmSize)
 {
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(static) num_threads(numThreads)
+#endif
     for (int i=0; i<cmSize; i++)
         cm[i]=alpha*cm[i];
 }
@@ -1674,38 +1670,36 @@ void Siox::premultiplyMatrix(float alpha, float *cm, int cmSize)
 void Siox::smooth(float *cm, int xres, int yres,
                   float f1, float f2, float f3)
 {
-    for (int y=0; y<yres; y++)
+    auto rowPass = [=](int y)
         {
+        float *row = cm + y*xres;
         for (int x=0; x<xres-2; x++)
-            {
-            int idx=(y*xres)+x;
-            cm[idx]=f1*cm[idx]+f2*cm[idx+1]+f3*cm[idx+2];
-            }
-        }
-    for (int y=0; y<yres; y++)
-        {
+            row[x]=f1*row[x]+f2*row[x+1]+f3*row[x+2];
         for (int x=xres-1; x>=2; x--)
-            {
-            int idx=(y*xres)+x;
-            cm[idx]=f3*cm[idx-2]+f2*cm[idx-1]+f1*cm[idx];
-            }
-        }
-    for (int y=0; y<yres-2; y++)
+            row[x]=f3*row[x-2]+f2*row[x-1]+f1*row[x];
+        };
+
+    auto columnPass = [=](int x0, int x1)
         {
-        for (int x=0; x<xres; x++)
+        for (int y=0; y<yres-2; y++)
             {
-            int idx=(y*xres)+x;
-            cm[idx]=f1*cm[idx]+f2*cm[((y+1)*xres)+x]+f3*cm[((y+2)*xres)+x];
+            for (int x=x0; x<x1; x++)
+                {
+                int idx=(y*xres)+x;
+                cm[idx]=f1*cm[idx]+f2*cm[((y+1)*xres)+x]+f3*cm[((y+2)*xres)+x];
+                }
             }
-        }
-    for (int y=yres-1; y>=2; y--)
-        {
-        for (int x=0; x<xres; x++)
+        for (int y=yres-1; y>=2; y--)
             {
-            int idx=(y*xres)+x;
-            cm[idx]=f3*cm[((y-2)*xres)+x]+f2*cm[((y-1)*xres)+x]+f1*cm[idx];
+            for (int x=x0; x<x1; x++)
+                {
+                int idx=(y*xres)+x;
+                cm[idx]=f3*cm[((y-2)*xres)+x]+f2*cm[((y-1)*xres)+x]+f1*cm[idx];
+                }
             }
-        }
+        };
+
+    separablePasses(xres, yres, numThreads, rowPass, columnPass);
 }
 
 /**
@@ -20,6 +20,7 @@
  * Many thanks to the fine people at siox.org.
  */
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -169,7 +170,7 @@ public:
     /**
      * Squared Euclidian distance between this and another color
      */
-    float diffSq(const CieLab &other);
+    float diffSq(const CieLab &other) const;
 
     /**
      * Computes squared euclidian distance in CieLab space for two colors
@@ -484,6 +485,12 @@ public:
     virtual SioxImage extractForeground(const SioxImage &originalImage,
                                         unsigned int backgroundFillColor);
 
+    /**
+     *  Set the number of threads that extractForeground() may use.
+     *  The default is one.
+     */
+    void setThreadCount(int threads) { numThreads = std::max(threads, 1); }
+
 private:
 
     SioxObserver *sioxObserver;
@@ -528,6 +535,11 @@ private:
      */
     int *labelField;
 
+    /**
+     * Number of threads to process the image with
+     */
+    int numThreads;
+
 
     /**
      * Our signature limits
@@ -589,6 +601,13 @@ private:
                         std::vector<CieLab> &result,
                         const unsigned int dims);
 
+    /**
+     *  Decide whether a color of the unknown region is background
+     */
+    bool classify(const CieLab &lab,
+                  const std::vector<CieLab> &bgSignature,
+                  const std::vector<CieLab> &fgSignature) const;
+
 
     /**
      *
@@ -605,7 +624,7 @@ private:
     /**
      *
      */
-    void fillColorRegions();
+    void fillColorRegions(const std::vector<CieLab> &imageClab);
 
     /**
      * Applies the morphological dilate operator.
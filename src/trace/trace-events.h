@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/** @file
+ * Debug log events for the stages of bitmap tracing.
+ *//*
+ * Authors: see git history
+ *
+ * Copyright (C) 2020 Authors
+ * Released under GNU GPL v2+, read the file 'COPYING' for more information.
+ */
+#ifndef SEEN_TRACE_EVENTS_H
+#define SEEN_TRACE_EVENTS_H
+
+#include <string>
+#include <glib.h>
+
+#include "debug/logger.h"
+#include "debug/simple-event.h"
+
+namespace Inkscape {
+
+namespace Trace {
+
+/**
+ * An event of the TRACE category, with any number of name/value
+ * properties.  Values may be integers or strings.
+ */
+class TraceEvent : public Debug::SimpleEvent<Debug::Event::TRACE>
+{
+public:
+    template <typename... Properties>
+    explicit TraceEvent(char const *name, Properties const &...properties)
+        : Debug::SimpleEvent<Debug::Event::TRACE>(name)
+    {
+        _addProperties(properties...);
+    }
+
+private:
+    void _addProperties() {}
+
+    template <typename Value, typename... Properties>
+    void _addProperties(char const *name, Value const &value, Properties const &...properties)
+    {
+        _addValue(name, value);
+        _addProperties(properties...);
+    }
+
+    void _addValue(char const *name, char const *value) { _addProperty(name, value); }
+    void _addValue(char const *name, std::string const &value) { _addProperty(name, value.c_str()); }
+    template <typename Value>
+    void _addValue(char const *name, Value value) { _addProperty(name, static_cast<long>(value)); }
+};
+
+/**
+ * Logs one stage of tracing, from construction to destruction.
+ *
+ * Unlike Debug::EventTracker, this is not compiled out of release builds,
+ * so that tracing can be profiled where it matters; with logging off it
+ * costs a flag test.  The Chrome trace format times the stage itself,
+ * and result() records the elapsed time for the XML log.
+ */
+class TraceStage
+{
+public:
+    template <typename... Properties>
+    explicit TraceStage(char const *name, Properties const &...properties)
+        : _start(g_get_monotonic_time())
+    {
+        Debug::Logger::start<TraceEvent>(name, properties...);
+    }
+
+    ~TraceStage() { Debug::Logger::finish(); }
+
+    TraceStage(TraceStage const &) = delete;
+    TraceStage &operator=(TraceStage const &) = delete;
+
+    /**
+     * Record what the stage produced, such as paths, nodes or bytes.
+     */
+    template <typename... Properties>
+    void result(Properties const &...properties)
+    {
+        Debug::Logger::write<TraceEvent>("result", "us", g_get_monotonic_time() - _start, properties...);
+    }
+
+private:
+    gint64 _start;
+};
+
+} // namespace Trace
+} // namespace Inkscape
+
+#endif // SEEN_TRACE_EVENTS_H
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
@@ -13,14 +13,27 @@
  * Released under GNU GPL v2+, read the file 'COPYING' for more information.
  */
 
+#ifdef HAVE_CONFIG_H
+# include "config.h"  // only include where actually required!
+#endif
+
 #include "trace/potrace/inkscape-potrace.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+
 #include "inkscape.h"
+#include "inkscape-application.h"
 #include "desktop.h"
 
 #include "document.h"
 #include "document-undo.h"
 #include "message-stack.h"
+#include "preferences.h"
 #include <glibmm/i18n.h>
 #include <gtkmm/main.h>
 #include "selection.h"
@@ -31,6 +44,8 @@
 
 #include "display/cairo-utils.h"
 #include "display/drawing.h"
+#include "display/drawing-context.h"
+#include "display/drawing-group.h"
 #include "display/drawing-shape.h"
 
 #include "object/sp-item.h"
@@ -38,27 +53,79 @@
 #include "object/sp-image.h"
 
 #include "siox.h"
+#include "trace-events.h"
+
+#if HAVE_OPENMP
+#include <omp.h>
+#endif
 
 namespace Inkscape {
 namespace Trace {
 
-SPImage *Tracer::getSelectedSPImage()
+int threadCount()
+{
+    return Inkscape::Preferences::get()->getIntLimited("/options/threading/numthreads",
+#if HAVE_OPENMP
+                                                       omp_get_num_procs(),
+#else
+                                                       1,
+#endif
+                                                       1, 256);
+}
+
+
+Tracer::Tracer()
+    : engine(nullptr)
+    , sioxEnabled(false)
+    , stageCacheHold(Potrace::PotraceTracingEngine::holdStageCache())
 {
+}
+
 
+Inkscape::Selection *Tracer::getSelection()
+{
     SPDesktop *desktop = SP_ACTIVE_DESKTOP;
-    if (!desktop)
+    if (desktop)
+        return desktop->getSelection();
+
+    InkscapeApplication *app = InkscapeApplication::instance();
+    if (app)
+        return app->get_active_selection();
+
+    return nullptr;
+}
+
+
+void Tracer::flash(Inkscape::MessageType type, Glib::ustring const &msg)
+{
+    if (messageCallback)
         {
-        g_warning("Trace: No active desktop");
-        return nullptr;
+        messageCallback(type, msg);
+        return;
         }
 
-    Inkscape::MessageStack *msgStack = desktop->getMessageStack();
+    SPDesktop *desktop = SP_ACTIVE_DESKTOP;
+    if (desktop)
+        desktop->getMessageStack()->flash(type, msg);
+    else
+        std::cerr << msg << std::endl;
+}
+
+
+void Tracer::setMessageCallback(MessageCallback callback)
+{
+    messageCallback = std::move(callback);
+}
+
 
-    Inkscape::Selection *sel = desktop->getSelection();
+SPImage *Tracer::getSelectedSPImage()
+{
+
+    Inkscape::Selection *sel = getSelection();
     if (!sel)
         {
         char *msg = _("Select an <b>image</b> to trace");
-        msgStack->flash(Inkscape::ERROR_MESSAGE, msg);
+        flash(Inkscape::ERROR_MESSAGE, msg);
         //g_warning(msg);
         return nullptr;
         }
@@ -93,7 +160,7 @@ SPImage *Tracer::getSelectedSPImage()
                 if (img) //we want only one
                     {
                     char *msg = _("Select only one <b>image</b> to trace");
-                    msgStack->flash(Inkscape::ERROR_MESSAGE, msg);
+                    flash(Inkscape::ERROR_MESSAGE, msg);
                     return nullptr;
                     }
                 img = SP_IMAGE(item);
@@ -111,7 +178,7 @@ SPImage *Tracer::getSelectedSPImage()
         if (!img || sioxShapes.size() < 1)
             {
             char *msg = _("Select one image and one or more shapes above it");
-            msgStack->flash(Inkscape::ERROR_MESSAGE, msg);
+            flash(Inkscape::ERROR_MESSAGE, msg);
             return nullptr;
             }
         return img;
@@ -123,7 +190,7 @@ SPImage *Tracer::getSelectedSPImage()
         if (!item)
             {
             char *msg = _("Select an <b>image</b> to trace");  //same as above
-            msgStack->flash(Inkscape::ERROR_MESSAGE, msg);
+            flash(Inkscape::ERROR_MESSAGE, msg);
             //g_warning(msg);
             return nullptr;
             }
@@ -131,7 +198,7 @@ SPImage *Tracer::getSelectedSPImage()
         if (!SP_IS_IMAGE(item))
             {
             char *msg = _("Select an <b>image</b> to trace");
-            msgStack->flash(Inkscape::ERROR_MESSAGE, msg);
+            flash(Inkscape::ERROR_MESSAGE, msg);
             //g_warning(msg);
             return nullptr;
             }
@@ -175,9 +242,12 @@ public:
         {
         //Tracer *tracer = (Tracer *)context;
         //## Allow the GUI to update
-        Gtk::Main::iteration(false); //at least once, non-blocking
-        while( Gtk::Main::events_pending() )
-            Gtk::Main::iteration();
+        if (Inkscape::Application::exists() && INKSCAPE.use_gui())
+            {
+            Gtk::Main::iteration(false); //at least once, non-blocking
+            while( Gtk::Main::events_pending() )
+                Gtk::Main::iteration();
+            }
         return true;
         }
 
@@ -197,100 +267,92 @@ public:
 
 
 
-Glib::RefPtr<Gdk::Pixbuf> Tracer::sioxProcessImage(SPImage *img, Glib::RefPtr<Gdk::Pixbuf>origPixbuf)
+bool Tracer::sioxMask(SPImage *img, std::vector<SPShape *> const &shapes, SioxImage &simage)
 {
-    if (!sioxEnabled)
-        return origPixbuf;
-
-    if (origPixbuf == lastOrigPixbuf)
-        return lastSioxPixbuf;
+    Geom::OptRect bounds = img->bbox(Geom::identity(), SPItem::GEOMETRIC_BBOX);
+    int width  = simage.getWidth();
+    int height = simage.getHeight();
+    if (!bounds || width <= 0 || height <= 0)
+        return false;
+
+    // Pixel (col, row) of the image covers this area of the document
+    Geom::Affine pixelToDoc = Geom::Scale(bounds->width() / width, bounds->height() / height)
+                            * Geom::Translate(bounds->min())
+                            * img->i2doc_affine();
+    if (!pixelToDoc.isInvertible())
+        return false;
+    Geom::Affine docToPixel = pixelToDoc.inverse();
+
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_A8, width, height);
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS)
+        {
+        cairo_surface_destroy(surface);
+        return false;
+        }
 
-    //g_message("siox: start");
+    {
+        Inkscape::Drawing drawing;
+        unsigned dkey = SPItem::display_key_new(1);
+        auto group = new Inkscape::DrawingGroup(drawing);
+        drawing.setRoot(group);
 
-    SioxImage simage(origPixbuf->gobj());
+        std::vector<SPShape *> shown;
+        for (auto shape : shapes)
+            {
+            Inkscape::DrawingItem *ai = shape->invoke_show(drawing, dkey, SP_ITEM_SHOW_DISPLAY);
+            if (!ai)
+                continue;
+            // Any coverage counts, like a pick would
+            ai->setTransform(shape->i2doc_affine() * docToPixel);
+            ai->setOpacity(1.0);
+            group->appendChild(ai);
+            shown.push_back(shape);
+            }
 
-    SPDesktop *desktop = SP_ACTIVE_DESKTOP;
-    if (!desktop)
-        {
-        g_warning("%s", _("Trace: No active desktop"));
-        return Glib::RefPtr<Gdk::Pixbuf>(nullptr);
-        }
+        Geom::IntRect area = Geom::IntRect::from_xywh(0, 0, width, height);
+        drawing.update(area);
+        Inkscape::DrawingContext dc(surface, Geom::Point(0, 0));
+        drawing.render(dc, area, Inkscape::DrawingItem::RENDER_BYPASS_CACHE);
 
-    Inkscape::MessageStack *msgStack = desktop->getMessageStack();
+        for (auto shape : shown)
+            shape->invoke_hide(dkey);
+    }
 
-    Inkscape::Selection *sel = desktop->getSelection();
-    if (!sel)
+    cairo_surface_flush(surface);
+    unsigned char const *mask = cairo_image_surface_get_data(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    for (int row = 0; row < height; row++)
         {
-        char *msg = _("Select an <b>image</b> to trace");
-        msgStack->flash(Inkscape::ERROR_MESSAGE, msg);
-        //g_warning(msg);
-        return Glib::RefPtr<Gdk::Pixbuf>(nullptr);
+        unsigned char const *p = mask + row * stride;
+        for (int col = 0; col < width; col++)
+            {
+            simage.setConfidence(col, row, p[col] ? Siox::UNKNOWN_REGION_CONFIDENCE
+                                                  : Siox::CERTAIN_BACKGROUND_CONFIDENCE);
+            }
         }
 
-    Inkscape::DrawingItem *aImg = img->get_arenaitem(desktop->dkey);
-    //g_message("img: %d %d %d %d\n", aImg->bbox.x0, aImg->bbox.y0,
-    //                                aImg->bbox.x1, aImg->bbox.y1);
-
-    double width  = aImg->geometricBounds()->width();
-    double height = aImg->geometricBounds()->height();
+    cairo_surface_destroy(surface);
+    return true;
+}
 
-    double iwidth  = simage.getWidth();
-    double iheight = simage.getHeight();
 
-    double iwscale = width  / iwidth;
-    double ihscale = height / iheight;
+Glib::RefPtr<Gdk::Pixbuf> Tracer::sioxProcessImage(SPImage *img, Glib::RefPtr<Gdk::Pixbuf>origPixbuf)
+{
+    if (!sioxEnabled)
+        return origPixbuf;
 
-    std::vector<Inkscape::DrawingItem *> arenaItems;
-    std::vector<SPShape *>::iterator iter;
-    for (iter = sioxShapes.begin() ; iter!=sioxShapes.end() ; ++iter)
-        {
-        SPItem *item = *iter;
-        Inkscape::DrawingItem *aItem = item->get_arenaitem(desktop->dkey);
-        arenaItems.push_back(aItem);
-        }
+    if (origPixbuf == lastOrigPixbuf)
+        return lastSioxPixbuf;
 
-    //g_message("%d arena items\n", arenaItems.size());
+    //g_message("siox: start");
+    TraceStage stage("siox", "pixels", (long)origPixbuf->get_width() * origPixbuf->get_height());
 
-    //g_message("siox: start selection");
+    SioxImage simage(origPixbuf->gobj());
 
-    for (int row=0 ; row<iheight ; row++)
+    if (!sioxMask(img, sioxShapes, simage))
         {
-        double ypos = aImg->geometricBounds()->top() + ihscale * (double) row;
-        for (int col=0 ; col<simage.getWidth() ; col++)
-            {
-            //Get absolute X,Y position
-            double xpos = aImg->geometricBounds()->left() + iwscale * (double)col;
-            Geom::Point point(xpos, ypos);
-            point *= aImg->transform();
-            //point *= imgMat;
-            //point = desktop->doc2dt(point);
-            //g_message("x:%f    y:%f\n", point[0], point[1]);
-            bool weHaveAHit = false;
-            std::vector<Inkscape::DrawingItem *>::iterator aIter;
-            for (aIter = arenaItems.begin() ; aIter!=arenaItems.end() ; ++aIter)
-                {
-                Inkscape::DrawingItem *arenaItem = *aIter;
-                arenaItem->drawing().update();
-                if (arenaItem->pick(point, 1.0f, 1))
-                    {
-                    weHaveAHit = true;
-                    break;
-                    }
-                }
-
-            if (weHaveAHit)
-                {
-                //g_message("hit!\n");
-                simage.setConfidence(col, row,
-                        Siox::UNKNOWN_REGION_CONFIDENCE);
-                }
-            else
-                {
-                //g_message("miss!\n");
-                simage.setConfidence(col, row,
-                        Siox::CERTAIN_BACKGROUND_CONFIDENCE);
-                }
-            }
+        g_warning("%s", _("Trace: Could not rasterize the SIOX selection"));
+        return Glib::RefPtr<Gdk::Pixbuf>(nullptr);
         }
 
     //g_message("siox: selection done");
@@ -298,6 +360,7 @@ Glib::RefPtr<Gdk::Pixbuf> Tracer::sioxProcessImage(SPImage *img, Glib::RefPtr<Gd
     //## ok we have our pixel buf
     TraceSioxObserver observer(this);
     Siox sengine(&observer);
+    sengine.setThreadCount(threadCount());
     SioxImage result = sengine.extractForeground(simage, 0xffffff);
     if (!result.isValid())
         {
@@ -317,6 +380,64 @@ Glib::RefPtr<Gdk::Pixbuf> Tracer::sioxProcessImage(SPImage *img, Glib::RefPtr<Gd
 }
 
 
+Glib::RefPtr<Gdk::Pixbuf> Tracer::getImagePixbuf(SPImage *img)
+{
+    Inkscape::Pixbuf *pb = img->pixbuf;
+    if (!pb)
+        return Glib::RefPtr<Gdk::Pixbuf>(nullptr);
+
+    GdkPixbuf *raw_pb = pb->getPixbufRaw(false);
+
+    //## Rendering converts the pixels of the image to Cairo's format in
+    //## place, so they are only shared when no canvas can draw them
+    if (pb->pixelFormat() == Inkscape::Pixbuf::PF_GDK && !SP_ACTIVE_DESKTOP)
+        return Glib::wrap(raw_pb, true);
+
+    //## Otherwise the copy made for the previous trace of the same image
+    //## is handed over again, which also lets the engines find what they
+    //## cached from that trace
+    if (lastImageSource && lastImageSource->gobj() == raw_pb)
+        return lastImagePixbuf;
+
+    Glib::RefPtr<Gdk::Pixbuf> copy = copyImagePixbuf(pb);
+    if (copy)
+        {
+        lastImageSource = Glib::wrap(raw_pb, true);
+        lastImagePixbuf = copy;
+        }
+    return copy;
+}
+
+
+Glib::RefPtr<Gdk::Pixbuf> Tracer::copyImagePixbuf(Inkscape::Pixbuf *pb)
+{
+    GdkPixbuf *raw_pb = pb->getPixbufRaw(false);
+    if (pb->pixelFormat() == Inkscape::Pixbuf::PF_GDK)
+        return Glib::wrap(gdk_pixbuf_copy(raw_pb), false);
+
+    //## Convert from Cairo's format while copying, in a single pass
+    int width  = pb->width();
+    int height = pb->height();
+    GdkPixbuf *trace_pb = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, width, height);
+    if (!trace_pb)
+        return Glib::RefPtr<Gdk::Pixbuf>(nullptr);
+
+    guchar const *in = pb->pixels();
+    guchar *out      = gdk_pixbuf_get_pixels(trace_pb);
+    int inStride     = pb->rowstride();
+    int outStride    = gdk_pixbuf_get_rowstride(trace_pb);
+    for (int y = 0; y < height; y++)
+        {
+        guint32 const *src = reinterpret_cast<guint32 const *>(in + (gsize)y * inStride);
+        guint32 *dst = reinterpret_cast<guint32 *>(out + (gsize)y * outStride);
+        for (int x = 0; x < width; x++)
+            dst[x] = pixbuf_from_argb32(src[x]);
+        }
+
+    return Glib::wrap(trace_pb, false);
+}
+
+
 Glib::RefPtr<Gdk::Pixbuf> Tracer::getSelectedImage()
 {
 
@@ -325,21 +446,10 @@ Glib::RefPtr<Gdk::Pixbuf> Tracer::getSelectedImage()
     if (!img)
         return Glib::RefPtr<Gdk::Pixbuf>(nullptr);
 
-    if (!img->pixbuf)
+    Glib::RefPtr<Gdk::Pixbuf> pixbuf = getImagePixbuf(img);
+    if (!pixbuf)
         return Glib::RefPtr<Gdk::Pixbuf>(nullptr);
 
-    GdkPixbuf *raw_pb = img->pixbuf->getPixbufRaw(false);
-    GdkPixbuf *trace_pb = gdk_pixbuf_copy(raw_pb);
-    if (img->pixbuf->pixelFormat() == Inkscape::Pixbuf::PF_CAIRO) {
-        convert_pixels_argb32_to_pixbuf(
-            gdk_pixbuf_get_pixels(trace_pb),
-            gdk_pixbuf_get_width(trace_pb),
-            gdk_pixbuf_get_height(trace_pb),
-            gdk_pixbuf_get_rowstride(trace_pb));
-    }
-
-    Glib::RefPtr<Gdk::Pixbuf> pixbuf = Glib::wrap(trace_pb, false);
-
     if (sioxEnabled)
         {
         Glib::RefPtr<Gdk::Pixbuf> sioxPixbuf =
@@ -381,28 +491,21 @@ void Tracer::traceThread()
     //## see if the main thread wants us to stop
     keepGoing = true;
 
-    SPDesktop *desktop = SP_ACTIVE_DESKTOP;
-    if (!desktop)
-        {
-        g_warning("Trace: No active desktop\n");
-        return;
-        }
-
-    Inkscape::MessageStack *msgStack = desktop->getMessageStack();
-
-    Inkscape::Selection *selection = desktop->getSelection();
-
-    if (!SP_ACTIVE_DOCUMENT)
+    Inkscape::Selection *selection = getSelection();
+    SPDocument *doc = selection ? selection->document() : nullptr;
+    if (!doc)
         {
         char *msg = _("Trace: No active document");
-        msgStack->flash(Inkscape::ERROR_MESSAGE, msg);
+        flash(Inkscape::ERROR_MESSAGE, msg);
         //g_warning(msg);
         engine = nullptr;
         return;
         }
-    SPDocument *doc = SP_ACTIVE_DOCUMENT;
     doc->ensureUpToDate();
 
+    // Only set when tracing from the GUI
+    SPDesktop *desktop = selection->desktop();
+
 
     SPImage *img = getSelectedSPImage();
     if (!img)
@@ -411,42 +514,23 @@ void Tracer::traceThread()
         return;
         }
 
-    GdkPixbuf *trace_pb = gdk_pixbuf_copy(img->pixbuf->getPixbufRaw(false));
-    if (img->pixbuf->pixelFormat() == Inkscape::Pixbuf::PF_CAIRO) {
-        convert_pixels_argb32_to_pixbuf(
-            gdk_pixbuf_get_pixels(trace_pb),
-            gdk_pixbuf_get_width(trace_pb),
-            gdk_pixbuf_get_height(trace_pb),
-            gdk_pixbuf_get_rowstride(trace_pb));
-    }
-
-    Glib::RefPtr<Gdk::Pixbuf> pixbuf = Glib::wrap(trace_pb, false);
-
-    pixbuf = sioxProcessImage(img, pixbuf);
+    Glib::RefPtr<Gdk::Pixbuf> pixbuf = getImagePixbuf(img);
+    TraceStage stage("trace", "pixels", pixbuf ? (long)pixbuf->get_width() * pixbuf->get_height() : 0L);
+    if (pixbuf)
+        pixbuf = sioxProcessImage(img, pixbuf);
 
     if (!pixbuf)
         {
         char *msg = _("Trace: Image has no bitmap data");
-        msgStack->flash(Inkscape::ERROR_MESSAGE, msg);
+        flash(Inkscape::ERROR_MESSAGE, msg);
         //g_warning(msg);
         engine = nullptr;
         return;
         }
 
-    msgStack->flash(Inkscape::NORMAL_MESSAGE, _("Trace: Starting trace..."));
-    desktop->updateCanvasNow();
-
-    std::vector<TracingEngineResult> results =
-                engine->trace(pixbuf);
-    //printf("nrPaths:%d\n", results.size());
-    int nrPaths = results.size();
-
-    //### Check if we should stop
-    if (!keepGoing || nrPaths<1)
-        {
-        engine = nullptr;
-        return;
-        }
+    flash(Inkscape::NORMAL_MESSAGE, _("Trace: Starting trace..."));
+    if (desktop)
+        desktop->updateCanvasNow();
 
     //### Get pointers to the <image> and its parent
     //XML Tree being used directly here while it shouldn't be.
@@ -486,28 +570,18 @@ void Tracer::traceThread()
 
     //#OK.  Now let's start making new nodes
 
-    Inkscape::XML::Document *xml_doc = desktop->doc()->getReprDoc();
+    Inkscape::XML::Document *xml_doc = doc->getReprDoc();
     Inkscape::XML::Node *groupRepr = nullptr;
 
-    //# if more than 1, make a <g>roup of <path>s
-    if (nrPaths > 1)
-        {
-        groupRepr = xml_doc->createElement("svg:g");
-        par->addChild(groupRepr, imgRepr);
-        }
-
-    long totalNodeCount = 0L;
-
-    for (auto result : results)
+    auto addPath = [&](TracingEngineResult const &result, Inkscape::XML::Node *parent)
         {
-        totalNodeCount += result.getNodeCount();
-
+        TraceStage insert("trace-insert", "bytes", result.getPathData().size());
         Inkscape::XML::Node *pathRepr = xml_doc->createElement("svg:path");
         pathRepr->setAttributeOrRemoveIfEmpty("style", result.getStyle());
         pathRepr->setAttributeOrRemoveIfEmpty("d",     result.getPathData());
 
-        if (nrPaths > 1)
-            groupRepr->addChild(pathRepr, nullptr);
+        if (parent)
+            parent->addChild(pathRepr, nullptr);
         else
             par->addChild(pathRepr, imgRepr);
 
@@ -518,16 +592,64 @@ void Tracer::traceThread()
             SPItem *newItem = SP_ITEM(reprobj);
             newItem->doWriteTransform(tf);
             }
+        return pathRepr;
+        };
+
+    //## Every path goes into the document as soon as it is traced.  The
+    //## first one is held until we know whether a <g>roup is needed.
+    std::optional<TracingEngineResult> firstResult;
+    int nrPaths = 0;
+    long totalNodeCount = 0L;
+
+    engine->traceTo(pixbuf, [&](TracingEngineResult &&result)
+        {
+        if (!keepGoing)
+            return;
+
+        nrPaths++;
+        totalNodeCount += result.getNodeCount();
+
         if (nrPaths == 1)
             {
-            selection->clear();
-            selection->add(pathRepr);
+            firstResult.emplace(std::move(result));
+            return;
             }
+
+        //# if more than 1, make a <g>roup of <path>s
+        if (!groupRepr)
+            {
+            groupRepr = xml_doc->createElement("svg:g");
+            par->addChild(groupRepr, imgRepr);
+            Inkscape::GC::release(addPath(*firstResult, groupRepr));
+            firstResult.reset();
+            }
+        Inkscape::GC::release(addPath(result, groupRepr));
+        });
+    //printf("nrPaths:%d\n", nrPaths);
+
+    //### Check if we should stop
+    if (!keepGoing || nrPaths<1)
+        {
+        //# Drop what has been added so far
+        if (groupRepr)
+            {
+            Inkscape::GC::release(groupRepr);
+            DocumentUndo::cancel(doc);
+            }
+        engine = nullptr;
+        return;
+        }
+
+    if (firstResult)
+        {
+        Inkscape::XML::Node *pathRepr = addPath(*firstResult, nullptr);
+        selection->clear();
+        selection->add(pathRepr);
         Inkscape::GC::release(pathRepr);
         }
 
     // If we have a group, then focus on, then forget it
-    if (nrPaths > 1)
+    if (groupRepr)
         {
         selection->clear();
         selection->add(groupRepr);
@@ -539,8 +661,10 @@ void Tracer::traceThread()
 
     engine = nullptr;
 
+    stage.result("paths", nrPaths, "nodes", totalNodeCount);
+
     char *msg = g_strdup_printf(_("Trace: Done. %ld nodes created"), totalNodeCount);
-    msgStack->flash(Inkscape::NORMAL_MESSAGE, msg);
+    flash(Inkscape::NORMAL_MESSAGE, msg);
     g_free(msg);
 
 }
@@ -575,6 +699,216 @@ void Tracer::trace(TracingEngine *theEngine)
 
 
 
+/**
+ * Read an image file for tracing.  The engines want GdkPixbuf byte
+ * order; the returned pixbuf shares the pixels of pb, which keeps them.
+ */
+static Glib::RefPtr<Gdk::Pixbuf> readImageFile(std::string const &fileName, std::unique_ptr<Inkscape::Pixbuf> &pb)
+{
+    pb.reset(Inkscape::Pixbuf::create_from_file(fileName));
+    if (!pb)
+        return Glib::RefPtr<Gdk::Pixbuf>(nullptr);
+    return Glib::wrap(pb->getPixbufRaw(), true);
+}
+
+
+bool Tracer::writeTraceFile(TracingEngine *theEngine, Glib::RefPtr<Gdk::Pixbuf> pixbuf, std::string const &outputName,
+                            long *nodeCount, Glib::ustring *error)
+{
+    std::ofstream out(outputName, std::ios::out | std::ios::binary);
+    if (!out)
+        {
+        *error = Glib::ustring::compose(_("Trace: Could not open '%1' for writing"), outputName);
+        return false;
+        }
+
+    //## Paths are in pixel units, so the image size is the SVG size
+    int width  = pixbuf->get_width();
+    int height = pixbuf->get_height();
+
+    TraceStage stage("trace-file", "pixels", (long)width * height);
+    long nrPaths = 0L;
+    long bytes = 0L;
+
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n"
+        << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\""
+        << " width=\"" << width << "\" height=\"" << height << "\""
+        << " viewBox=\"0 0 " << width << " " << height << "\">\n";
+
+    auto writePath = [&out](TracingEngineResult const &result)
+        {
+        out << "<path style=\"" << result.getStyle() << "\" d=\"" << result.getPathData() << "\"/>\n";
+        };
+
+    //## Every path is written as soon as it is traced.  The first one is
+    //## held until we know whether a <g>roup is needed.
+    std::optional<TracingEngineResult> firstResult;
+    bool group = false;
+    long totalNodeCount = 0L;
+
+    theEngine->traceTo(pixbuf, [&](TracingEngineResult &&result)
+        {
+        nrPaths++;
+        totalNodeCount += result.getNodeCount();
+        bytes += result.getPathData().size();
+        if (!firstResult && !group)
+            {
+            firstResult.emplace(std::move(result));
+            return;
+            }
+
+        //# if more than 1, make a <g>roup of <path>s
+        if (!group)
+            {
+            out << "<g>\n";
+            writePath(*firstResult);
+            firstResult.reset();
+            group = true;
+            }
+        writePath(result);
+        });
+
+    if (!keepGoing)
+        {
+        out.close();
+        std::remove(outputName.c_str());
+        return false;
+        }
+
+    if (firstResult)
+        writePath(*firstResult);
+
+    if (group)
+        out << "</g>\n";
+    out << "</svg>\n";
+    out.close();
+
+    if (!out)
+        {
+        *error = Glib::ustring::compose(_("Trace: Could not write '%1'"), outputName);
+        return false;
+        }
+
+    stage.result("paths", nrPaths, "nodes", totalNodeCount, "bytes", bytes);
+    *nodeCount = totalNodeCount;
+    return true;
+}
+
+
+bool Tracer::traceFile(TracingEngine *theEngine, std::string const &inputName, std::string const &outputName)
+{
+    //Check if we are already running
+    if (engine)
+        return false;
+
+    std::unique_ptr<Inkscape::Pixbuf> pb;
+    Glib::RefPtr<Gdk::Pixbuf> pixbuf = readImageFile(inputName, pb);
+    if (!pixbuf)
+        {
+        flash(Inkscape::ERROR_MESSAGE, Glib::ustring::compose(_("Trace: Could not read image '%1'"), inputName));
+        return false;
+        }
+
+    keepGoing = true;
+    engine = theEngine;
+    long totalNodeCount = 0L;
+    Glib::ustring error;
+    bool written = writeTraceFile(theEngine, pixbuf, outputName, &totalNodeCount, &error);
+    engine = nullptr;
+
+    if (!written)
+        {
+        if (!error.empty())
+            flash(Inkscape::ERROR_MESSAGE, error);
+        return false;
+        }
+
+    char *msg = g_strdup_printf(_("Trace: Done. %ld nodes created"), totalNodeCount);
+    flash(Inkscape::NORMAL_MESSAGE, msg);
+    g_free(msg);
+
+    return true;
+}
+
+
+std::vector<long> Tracer::traceFileVariants(std::vector<TracingEngine *> const &engines, std::string const &inputName,
+                                            std::vector<std::string> const &outputNames)
+{
+    int nrVariants = std::min(engines.size(), outputNames.size());
+    std::vector<long> nodeCounts(nrVariants, -1L);
+
+    //Check if we are already running
+    if (engine || nrVariants < 1)
+        return nodeCounts;
+
+    std::unique_ptr<Inkscape::Pixbuf> pb;
+    Glib::RefPtr<Gdk::Pixbuf> pixbuf = readImageFile(inputName, pb);
+    if (!pixbuf)
+        {
+        flash(Inkscape::ERROR_MESSAGE, Glib::ustring::compose(_("Trace: Could not read image '%1'"), inputName));
+        return nodeCounts;
+        }
+
+    keepGoing = true;
+    std::vector<Glib::ustring> errors(nrVariants);
+
+#if HAVE_OPENMP
+    //## The engines report to the desktop when there is one, which may
+    //## only be done from the GUI thread.  Without one, variants run
+    //## concurrently; those that share their filter settings also share
+    //## the quantization, which the first of them makes.
+    //## The engines read their preferences when they were made, since
+    //## they must not be read on these threads.
+    bool concurrent = !(Inkscape::Application::exists() && SP_ACTIVE_DESKTOP);
+    int nrThreads = std::min(threadCount(), nrVariants);
+
+    //## The threads left over are shared by the loops of the variants,
+    //## which need one more level of active parallelism to use them.
+    std::vector<int> engineThreads;
+    int maxActiveLevels = omp_get_max_active_levels();
+    if (concurrent && nrThreads > 1)
+        {
+        int innerThreads = std::max(threadCount() / nrThreads, 1);
+        for (int i=0 ; i<nrVariants ; i++)
+            {
+            engineThreads.push_back(engines[i]->threads);
+            engines[i]->threads = std::min(engines[i]->threads, innerThreads);
+            }
+        if (innerThreads > 1)
+            omp_set_max_active_levels(std::max(maxActiveLevels, 2));
+        }
+
+#pragma omp parallel for schedule(dynamic) num_threads(nrThreads) if(concurrent)
+#endif
+    for (int i=0 ; i<nrVariants ; i++)
+        {
+        long nodeCount = 0L;
+        if (keepGoing && writeTraceFile(engines[i], pixbuf, outputNames[i], &nodeCount, &errors[i]))
+            nodeCounts[i] = nodeCount;
+        }
+
+#if HAVE_OPENMP
+    omp_set_max_active_levels(maxActiveLevels);
+    for (size_t i=0 ; i<engineThreads.size() ; i++)
+        engines[i]->threads = engineThreads[i];
+#endif
+
+    for (int i=0 ; i<nrVariants ; i++)
+        {
+        if (!errors[i].empty())
+            flash(Inkscape::ERROR_MESSAGE, errors[i]);
+        else if (nodeCounts[i] >= 0)
+            flash(Inkscape::NORMAL_MESSAGE,
+                  Glib::ustring::compose(_("Trace: %1: %2 nodes"), outputNames[i], nodeCounts[i]));
+        }
+
+    return nodeCounts;
+}
+
+
+
+
+
 void Tracer::abort()
 {
 
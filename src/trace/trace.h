@@ -12,20 +12,43 @@
 
 # include <cstring>
 
+#include <functional>
 #include <glibmm/refptr.h>
+#include <glibmm/ustring.h>
 #include <gdkmm/pixbuf.h>
+#include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 
+#include "message.h"
+#include "svg/path-string.h"
+
 class SPImage;
 class SPItem;
 class SPShape;
 
+namespace org {
+namespace siox {
+class SioxImage;
+}
+}
+
 namespace Inkscape {
 
+class Pixbuf;
+class Selection;
+
 namespace Trace {
 
 
+/**
+ * Number of threads the tracing engines and their filters may use, as set
+ * in the preferences.  Defaults to the number of processors with OpenMP,
+ * and to 1 without.
+ */
+int threadCount();
+
 
 /**
  *
@@ -46,11 +69,11 @@ public:
 	    nodeCount(theNodeCount)
         {}
 
-    TracingEngineResult(const TracingEngineResult &other)
-        { assign(other); }
+    TracingEngineResult(const TracingEngineResult &other) = default;
+    TracingEngineResult(TracingEngineResult &&other) = default;
 
-    virtual TracingEngineResult &operator=(const TracingEngineResult &other)
-        { assign(other); return *this; }
+    virtual TracingEngineResult &operator=(const TracingEngineResult &other) = default;
+    virtual TracingEngineResult &operator=(TracingEngineResult &&other) = default;
 
 
     /**
@@ -63,30 +86,23 @@ public:
     /**
      *
      */
-    std::string getStyle()
+    std::string const &getStyle() const
         { return style; }
 
     /**
      *
      */
-    std::string getPathData()
+    std::string const &getPathData() const
         { return pathData; }
 
     /**
      *
      */
-    long getNodeCount()
+    long getNodeCount() const
         { return nodeCount; }
 
 private:
 
-    void assign(const TracingEngineResult &other)
-        {
-        style = other.style;
-        pathData = other.pathData;
-        nodeCount = other.nodeCount;
-        }
-
     std::string style;
 
     std::string pathData;
@@ -109,8 +125,10 @@ class TracingEngine
     /**
      *
      */
-    TracingEngine()
-        = default;
+    TracingEngine() :
+        threads(threadCount()),
+        pathStringSettings(Inkscape::SVG::PathString::Settings::fromPreferences())
+        {}
 
     /**
      *
@@ -128,11 +146,35 @@ class TracingEngine
     virtual  std::vector<TracingEngineResult> trace(
                            Glib::RefPtr<Gdk::Pixbuf> /*pixbuf*/) = 0;
 
+    /**
+     *  Receives the traced layers one at a time, in output order.
+     */
+    typedef std::function<void (TracingEngineResult &&)> ResultSink;
+
+    /**
+     *  Like trace(), but hand every result to sink as soon as it is
+     *  known to be part of the output, instead of collecting them all.
+     *  Engines that can produce their layers incrementally override
+     *  this; the default just forwards the results of trace().
+     */
+    virtual void traceTo(Glib::RefPtr<Gdk::Pixbuf> pixbuf, ResultSink const &sink)
+        {
+        for (auto &result : trace(pixbuf))
+            sink(std::move(result));
+        }
+
     /**
      *  Abort the thread that is executing getPathDataFromPixbuf()
      */
     virtual void abort() = 0;
 
+    /**
+     *  The preferences a trace needs, read when the engine is made.
+     *  Engines are made on the GUI thread but may trace on others,
+     *  which must not read preferences.
+     */
+    int threads;
+    Inkscape::SVG::PathString::Settings pathStringSettings;
 
 
 };//class TracingEngine
@@ -160,11 +202,7 @@ public:
     /**
      *
      */
-    Tracer()
-        {
-        engine       = nullptr;
-        sioxEnabled  = false;
-        }
+    Tracer();
 
 
 
@@ -188,6 +226,24 @@ public:
      */
     void trace(TracingEngine *engine);
 
+    /**
+     * Trace the bitmap in the file inputName and write the result to
+     * outputName as a standalone SVG file, without building a document.
+     * Returns false if the image can not be read or the SVG file can
+     * not be written.
+     */
+    bool traceFile(TracingEngine *engine, std::string const &inputName, std::string const &outputName);
+
+    /**
+     * Trace the bitmap in the file inputName once with every engine,
+     * writing the result of engines[i] to outputNames[i].  The image is
+     * only read once, and without a desktop the variants are traced
+     * concurrently, each engine with its share of the threads.  Returns
+     * the node count of every variant, or -1 for the ones that failed.
+     */
+    std::vector<long> traceFileVariants(std::vector<TracingEngine *> const &engines, std::string const &inputName,
+                                        std::vector<std::string> const &outputNames);
+
 
     /**
      *  Abort the thread that is executing convertImageToPath()
@@ -199,15 +255,56 @@ public:
      */
     void enableSiox(bool enable);
 
+    /**
+     * Rasterize shapes over the pixel grid of img, and mark the pixels
+     * they cover as unknown and all others as certain background.  The
+     * shapes are shown on a private drawing, so no desktop is needed.
+     * Returns false if img has no area or the mask can not be made.
+     */
+    static bool sioxMask(SPImage *img, std::vector<SPShape *> const &shapes, org::siox::SioxImage &simage);
+
+    /**
+     * Receives the status messages of a trace.
+     */
+    typedef std::function<void (Inkscape::MessageType, Glib::ustring const &)> MessageCallback;
+
+    /**
+     *  Send status messages to the given callback.  Without one, they go
+     *  to the message stack of the active desktop, or to stderr when
+     *  running without a desktop.
+     */
+    void setMessageCallback(MessageCallback callback);
+
 
 private:
 
+    /**
+     * The selection to trace: the active desktop's one, or the
+     * application's active selection when running headless.
+     */
+    Inkscape::Selection *getSelection();
+
+    /**
+     * Report a status message.
+     */
+    void flash(Inkscape::MessageType type, Glib::ustring const &msg);
+
+    MessageCallback messageCallback;
+
     /**
      * This is the single path code that is called by its counterpart above.
      * Threaded method that does single bitmap--->path conversion.
      */
     void traceThread();
 
+    /**
+     * Trace pixbuf with engine and write the result to outputName.  Sets
+     * *nodeCount, or *error when it fails.  Does not report messages, so
+     * that several traces can run at the same time.
+     */
+    bool writeTraceFile(TracingEngine *engine, Glib::RefPtr<Gdk::Pixbuf> pixbuf, std::string const &outputName,
+                        long *nodeCount, Glib::ustring *error);
+
     /**
      * This is true during execution. Setting it to false (like abort()
      * does) should inform the threaded code that it needs to stop
@@ -220,6 +317,24 @@ private:
      */
     TracingEngine *engine;
 
+    /**
+     * The pixels of an image in GdkPixbuf format, which the engines
+     * only read: shared with the image when no desktop can draw it,
+     * otherwise a copy that is made once and reused by later traces of
+     * the same image.
+     */
+    Glib::RefPtr<Gdk::Pixbuf> getImagePixbuf(SPImage *img);
+
+    /**
+     * Copy the pixels of pb, converting them from Cairo's format while
+     * copying when needed, in a single pass.
+     */
+    static Glib::RefPtr<Gdk::Pixbuf> copyImagePixbuf(Inkscape::Pixbuf *pb);
+
+    //## The image pixbuf last copied by getImagePixbuf(), and its copy
+    Glib::RefPtr<Gdk::Pixbuf> lastImageSource;
+    Glib::RefPtr<Gdk::Pixbuf> lastImagePixbuf;
+
     /**
      * Get the selected image.  Also check for any SPItems over it, in
      * case the user wants SIOX pre-processing.
@@ -230,6 +345,12 @@ private:
 
     bool sioxEnabled;
 
+    /**
+     * Keeps the intermediate images of traces for as long as this
+     * tracer lives, so that tracing the same image again is faster.
+     */
+    std::shared_ptr<void> stageCacheHold;
+
     /**
      * Process a GdkPixbuf, according to which areas have been
      * obscured in the GUI.
@@ -361,14 +361,14 @@ static void do_trace(bitmap_coords_info bci, guchar *trace_px, SPDesktop *deskto
 
     unsigned char *trace_t;
 
-    GrayMap *gray_map = GrayMapCreate((max_x - min_x + 1), (max_y - min_y + 1));
+    auto gray_map = GrayMapCreate((max_x - min_x + 1), (max_y - min_y + 1));
     if (!gray_map) {
         desktop->messageStack()->flash(Inkscape::ERROR_MESSAGE, _("Failed mid-operation, no objects created."));
         return;
     }
     unsigned int gray_map_y = 0;
     for (unsigned int y = min_y; y <= max_y; y++) {
-        unsigned long *gray_map_t = gray_map->rows[gray_map_y];
+        unsigned short *gray_map_t = gray_map->row(gray_map_y);
 
         trace_t = get_trace_pixel(trace_px, min_x, y, bci.width);
         for (unsigned int x = min_x; x <= max_x; x++) {
@@ -381,8 +381,8 @@ static void do_trace(bitmap_coords_info bci, guchar *trace_px, SPDesktop *deskto
 
     Inkscape::Trace::Potrace::PotraceTracingEngine pte;
     pte.keepGoing = 1;
-    std::vector<Inkscape::Trace::TracingEngineResult> results = pte.traceGrayMap(gray_map);
-    gray_map->destroy(gray_map);
+    std::vector<Inkscape::Trace::TracingEngineResult> results = pte.traceGrayMap(*gray_map);
+    gray_map.reset();
 
     //XML Tree being used here directly while it shouldn't be...."
     Inkscape::XML::Document *xml_doc = desktop->doc()->getReprDoc();
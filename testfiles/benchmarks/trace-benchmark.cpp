@@ -0,0 +1,574 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/** @file
+ * Benchmark of the bitmap tracers.
+ *
+ * Times the stages of tracing (decoding, filtering, quantization, the
+ * tracing engines and the insertion of their paths into a document) on
+ * the images given on the command line and on a few synthetic ones,
+ * and writes the timings, peak memory and output sizes as JSON.
+ * For a breakdown of every stage and color layer, also set
+ * INKSCAPE_DEBUG_LOG (see doc/LOGGING.txt).
+ *
+ * Usage: trace_benchmark [--output FILE] [--repeat N] [--threads N] [--quick] [IMAGE...]
+ *//*
+ * Authors: see git history
+ *
+ * Copyright (C) 2020 Authors
+ * Released under GNU GPL v2+, read the file 'COPYING' for more information.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <2geom/transforms.h>
+#include <gdkmm/pixbuf.h>
+#include <gdkmm/wrap_init.h>
+#include <glibmm/miscutils.h>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+#include "document.h"
+#include "debug/logger.h"
+#include "inkscape.h"
+#include "preferences.h"
+#include "object/sp-item.h"
+#include "trace/autotrace/inkscape-autotrace.h"
+#include "trace/depixelize/inkscape-depixelize.h"
+#include "trace/filterset.h"
+#include "trace/imagemap-gdk.h"
+#include "trace/potrace/inkscape-potrace.h"
+#include "trace/quantize.h"
+#include "trace/siox.h"
+#include "xml/repr.h"
+
+using Inkscape::Trace::TracingEngine;
+using Inkscape::Trace::TracingEngineResult;
+
+namespace {
+
+/**
+ * Engines that are much slower than potrace are only run on images up to
+ * these sizes, in pixels.
+ */
+constexpr long AUTOTRACE_MAX_PIXELS = 1024 * 1024;
+constexpr long DEPIXELIZE_MAX_PIXELS = 256 * 256;
+
+struct Image
+{
+    std::string name;
+    Glib::RefPtr<Gdk::Pixbuf> pixbuf;
+    double decodeMs = -1.0;
+};
+
+/**
+ * One timed stage on one image.
+ */
+struct Record
+{
+    std::string image;
+    std::string stage;
+    std::string variant;
+    int width = 0;
+    int height = 0;
+    std::vector<double> ms;
+    long peakKiB = 0;
+    long paths = -1;
+    long nodes = -1;
+    long bytes = -1;
+};
+
+struct Sizes
+{
+    long paths = -1;
+    long nodes = -1;
+    long bytes = -1;
+};
+
+Sizes sizesOf(std::vector<TracingEngineResult> const &results)
+{
+    Sizes sizes{0, 0, 0};
+    for (auto const &result : results) {
+        sizes.paths++;
+        sizes.nodes += result.getNodeCount();
+        sizes.bytes += result.getPathData().size();
+    }
+    return sizes;
+}
+
+/**
+ * Reset the peak resident set size of the process, so that the next
+ * peakMemoryKiB() only covers what follows.  Only possible on Linux;
+ * elsewhere the peak of the whole run is reported.
+ */
+void resetPeakMemory()
+{
+#ifdef __linux__
+    std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+long peakMemoryKiB()
+{
+#ifdef __linux__
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::atol(line.c_str() + 6);
+        }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+#else
+    return 0;
+#endif
+}
+
+class Benchmark
+{
+public:
+    Benchmark(int repeat)
+        : _repeat(repeat)
+    {}
+
+    void run(Image const &image);
+    void write(std::ostream &out, int threads) const;
+
+private:
+    /**
+     * Run stage repeat times and record the timings, the highest peak
+     * memory of all the runs and the sizes returned by the last one.  setup, if
+     * any, runs untimed before every run.
+     */
+    void measure(Image const &image, char const *stage, std::string const &variant,
+                 std::function<Sizes ()> const &stage_fn, std::function<void ()> const &setup = nullptr);
+
+    void traceWith(Image const &image, std::string const &variant, TracingEngine &engine);
+
+    int _repeat;
+    std::vector<Record> _records;
+};
+
+void Benchmark::measure(Image const &image, char const *stage, std::string const &variant,
+                        std::function<Sizes ()> const &stage_fn, std::function<void ()> const &setup)
+{
+    Record record;
+    record.image = image.name;
+    record.stage = stage;
+    record.variant = variant;
+    record.width = image.pixbuf->get_width();
+    record.height = image.pixbuf->get_height();
+
+    Sizes sizes;
+    for (int i = 0; i < _repeat; i++) {
+        if (setup) {
+            setup();
+        }
+        resetPeakMemory();
+        auto start = std::chrono::steady_clock::now();
+        sizes = stage_fn();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        record.ms.push_back(elapsed.count());
+        record.peakKiB = std::max(record.peakKiB, peakMemoryKiB());
+    }
+    record.paths = sizes.paths;
+    record.nodes = sizes.nodes;
+    record.bytes = sizes.bytes;
+
+    std::cerr << image.name << " " << stage << " " << variant << ": "
+              << *std::min_element(record.ms.begin(), record.ms.end()) << " ms" << std::endl;
+    _records.push_back(std::move(record));
+}
+
+void Benchmark::traceWith(Image const &image, std::string const &variant, TracingEngine &engine)
+{
+    // Every run starts from scratch, without the stages of the previous one
+    measure(image, "trace", variant, [&] { return sizesOf(engine.trace(image.pixbuf)); },
+            &Inkscape::Trace::Potrace::PotraceTracingEngine::clearStageCache);
+}
+
+void Benchmark::run(Image const &image)
+{
+    GdkPixbuf *pixbuf = image.pixbuf->gobj();
+    long pixels = long(image.pixbuf->get_width()) * image.pixbuf->get_height();
+
+    if (image.decodeMs >= 0.0) {
+        Record record;
+        record.image = image.name;
+        record.stage = "decode";
+        record.width = image.pixbuf->get_width();
+        record.height = image.pixbuf->get_height();
+        record.ms.push_back(image.decodeMs);
+        record.peakKiB = peakMemoryKiB();
+        _records.push_back(std::move(record));
+    }
+
+    // Filters and quantization, on their own
+    int const threads = Inkscape::Trace::threadCount();
+    auto gray = gdkPixbufToGrayMap(pixbuf);
+    auto rgb = gdkPixbufToRgbMap(pixbuf);
+    measure(image, "filter", "gray-map", [&] { gdkPixbufToGrayMap(pixbuf); return Sizes(); });
+    measure(image, "filter", "gaussian-gray", [&] { grayMapGaussian(*gray, threads); return Sizes(); });
+    measure(image, "filter", "gaussian-rgb", [&] { rgbMapGaussian(*rgb, threads); return Sizes(); });
+    measure(image, "filter", "canny", [&] { grayMapCanny(*gray, 0.1, 0.65, threads); return Sizes(); });
+    measure(image, "quantize", "rgb-8", [&] {
+        auto map = rgbMapQuantize(*rgb, 8, threads);
+        Sizes sizes;
+        sizes.paths = map ? map->nrColors : 0;
+        return sizes;
+    });
+    measure(image, "quantize", "band-8", [&] { quantizeBand(*rgb, 8, threads); return Sizes(); });
+
+    // Tracing engines, from pixbuf to path data
+    using namespace Inkscape::Trace::Potrace;
+    auto potrace = [&](std::string const &variant, PotraceTracingEngine &&engine) {
+        engine.potraceParams->progress.callback = nullptr;
+        traceWith(image, variant, engine);
+    };
+    potrace("potrace-brightness",
+            PotraceTracingEngine(TRACE_BRIGHTNESS, false, 8, 0.45, 0.0, 0.65, 8, false, false, false));
+    potrace("potrace-canny",
+            PotraceTracingEngine(TRACE_CANNY, false, 8, 0.45, 0.0, 0.65, 8, false, false, false));
+    potrace("potrace-quant",
+            PotraceTracingEngine(TRACE_QUANT, false, 8, 0.45, 0.0, 0.65, 8, false, false, false));
+    potrace("potrace-brightness-multi",
+            PotraceTracingEngine(TRACE_BRIGHTNESS_MULTI, false, 8, 0.45, 0.0, 0.65, 8, true, false, false));
+    potrace("potrace-color-8",
+            PotraceTracingEngine(TRACE_QUANT_COLOR, false, 8, 0.45, 0.0, 0.65, 8, true, true, false));
+    potrace("potrace-color-32",
+            PotraceTracingEngine(TRACE_QUANT_COLOR, false, 8, 0.45, 0.0, 0.65, 32, false, false, true));
+
+    // Tracing again with other potrace settings, which reuses the quantized image
+    auto hold = PotraceTracingEngine::holdStageCache();
+    PotraceTracingEngine retrace(TRACE_QUANT_COLOR, false, 8, 0.45, 0.0, 0.65, 8, true, true, false);
+    retrace.potraceParams->progress.callback = nullptr;
+    measure(image, "retrace", "potrace-color-8", [&] {
+        retrace.potraceParams->turdsize = retrace.potraceParams->turdsize == 2 ? 4 : 2;
+        return sizesOf(retrace.trace(image.pixbuf));
+    }, [&] {
+        PotraceTracingEngine::clearStageCache();
+        retrace.trace(image.pixbuf);
+    });
+
+    if (pixels <= AUTOTRACE_MAX_PIXELS) {
+        Inkscape::Trace::Autotrace::AutotraceTracingEngine outline;
+        outline.opts->color_count = 8;
+        traceWith(image, "autotrace-color-8", outline);
+
+        Inkscape::Trace::Autotrace::AutotraceTracingEngine centerline;
+        centerline.opts->color_count = 2;
+        centerline.opts->centerline = true;
+        centerline.opts->preserve_width = true;
+        traceWith(image, "autotrace-centerline", centerline);
+    }
+
+    if (pixels <= DEPIXELIZE_MAX_PIXELS) {
+        using namespace Inkscape::Trace::Depixelize;
+        DepixelizeTracingEngine voronoi(TRACE_VORONOI, 1.0, 5, 4, 1.0, false);
+        traceWith(image, "depixelize-voronoi", voronoi);
+        DepixelizeTracingEngine splines(TRACE_BSPLINES, 1.0, 5, 4, 1.0, true);
+        traceWith(image, "depixelize-bsplines", splines);
+    }
+
+    // Foreground extraction, with everything but a border of the image unknown
+    measure(image, "siox", "extract-foreground", [&] {
+        org::siox::SioxImage simage(pixbuf);
+        int border = std::max(1, std::min(simage.getWidth(), simage.getHeight()) / 8);
+        for (int y = 0; y < simage.getHeight(); y++) {
+            for (int x = 0; x < simage.getWidth(); x++) {
+                bool inside = x >= border && y >= border && x < simage.getWidth() - border &&
+                              y < simage.getHeight() - border;
+                simage.setConfidence(x, y, inside ? org::siox::Siox::UNKNOWN_REGION_CONFIDENCE
+                                                  : org::siox::Siox::CERTAIN_BACKGROUND_CONFIDENCE);
+            }
+        }
+        org::siox::Siox siox;
+        siox.setThreadCount(Inkscape::Preferences::get()->getInt("/options/threading/numthreads"));
+        siox.extractForeground(simage, 0xffffff);
+        return Sizes();
+    });
+
+    // Insertion of a multi-color trace into a document, like Tracer::traceThread
+    PotraceTracingEngine colors(TRACE_QUANT_COLOR, false, 8, 0.45, 0.0, 0.65, 8, true, true, false);
+    colors.potraceParams->progress.callback = nullptr;
+    auto results = colors.trace(image.pixbuf);
+    measure(image, "xml", "insert-paths", [&] {
+        static char const svg[] = "<svg xmlns=\"http://www.w3.org/2000/svg\"/>";
+        std::unique_ptr<SPDocument> doc(SPDocument::createNewDocFromMem(svg, strlen(svg), false));
+        Inkscape::XML::Document *xml_doc = doc->getReprDoc();
+        Inkscape::XML::Node *group = xml_doc->createElement("svg:g");
+        doc->getReprRoot()->appendChild(group);
+        Geom::Affine tf = Geom::Scale(0.75);
+        for (auto const &result : results) {
+            Inkscape::XML::Node *pathRepr = xml_doc->createElement("svg:path");
+            pathRepr->setAttributeOrRemoveIfEmpty("style", result.getStyle());
+            pathRepr->setAttributeOrRemoveIfEmpty("d", result.getPathData());
+            group->addChild(pathRepr, nullptr);
+            if (auto item = dynamic_cast<SPItem *>(doc->getObjectByRepr(pathRepr))) {
+                item->doWriteTransform(tf);
+            }
+            Inkscape::GC::release(pathRepr);
+        }
+        Inkscape::GC::release(group);
+        doc->ensureUpToDate();
+        return sizesOf(results);
+    });
+}
+
+void writeString(std::ostream &out, std::string const &s)
+{
+    out << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec
+                << std::setfill(' ');
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+void Benchmark::write(std::ostream &out, int threads) const
+{
+    out << std::fixed << std::setprecision(3);
+    out << "{\n  \"benchmark\": \"trace\",\n  \"threads\": " << threads << ",\n  \"repeat\": " << _repeat
+        << ",\n  \"results\": [";
+    bool first = true;
+    for (auto const &record : _records) {
+        auto ms = record.ms;
+        std::sort(ms.begin(), ms.end());
+        out << (first ? "\n" : ",\n") << "    {\"image\": ";
+        writeString(out, record.image);
+        out << ", \"width\": " << record.width << ", \"height\": " << record.height << ", \"stage\": ";
+        writeString(out, record.stage);
+        out << ", \"variant\": ";
+        writeString(out, record.variant);
+        out << ", \"ms_min\": " << ms.front() << ", \"ms_median\": " << ms[ms.size() / 2]
+            << ", \"peak_kib\": " << record.peakKiB;
+        if (record.paths >= 0) {
+            out << ", \"paths\": " << record.paths;
+        }
+        if (record.nodes >= 0) {
+            out << ", \"nodes\": " << record.nodes;
+        }
+        if (record.bytes >= 0) {
+            out << ", \"bytes\": " << record.bytes;
+        }
+        out << "}";
+        first = false;
+    }
+    out << "\n  ]\n}\n";
+}
+
+/**
+ * Deterministic pseudo random numbers, so that the synthetic images are
+ * the same on every run and platform.
+ */
+class Random
+{
+public:
+    unsigned next()
+    {
+        _state = _state * 1664525u + 1013904223u;
+        return _state >> 8;
+    }
+
+    int noise(int amplitude) { return int(next() % (2 * amplitude + 1)) - amplitude; }
+
+private:
+    unsigned _state = 12345;
+};
+
+guint8 clamp8(double v)
+{
+    return guint8(std::max(0.0, std::min(255.0, v)));
+}
+
+Image synthetic(std::string const &name, int width, int height,
+                std::function<void (int x, int y, guint8 *rgb)> const &shader)
+{
+    auto pixbuf = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, true, 8, width, height);
+    for (int y = 0; y < height; y++) {
+        guint8 *p = pixbuf->get_pixels() + y * pixbuf->get_rowstride();
+        for (int x = 0; x < width; x++, p += 4) {
+            shader(x, y, p);
+            p[3] = 255;
+        }
+    }
+    Image image;
+    image.name = name;
+    image.pixbuf = pixbuf;
+    return image;
+}
+
+std::vector<Image> syntheticImages(bool quick)
+{
+    std::vector<Image> images;
+
+    // Many small isolated shapes: tens of thousands of subpaths
+    images.push_back(synthetic("synthetic-dots", 900, 900, [](int x, int y, guint8 *rgb) {
+        rgb[0] = rgb[1] = rgb[2] = (x % 3 < 2 && y % 3 < 2) ? 0 : 255;
+    }));
+
+    // Smooth color fields with sensor noise, like a photo
+    Random photoNoise;
+    images.push_back(synthetic("synthetic-photo", 1280, 960, [&](int x, int y, guint8 *rgb) {
+        double u = x / 1280.0, v = y / 960.0;
+        rgb[0] = clamp8(128 + 100 * std::sin(6.0 * u + 2.0 * v) + photoNoise.noise(8));
+        rgb[1] = clamp8(128 + 90 * std::sin(4.0 * v - 3.0 * u * u) + photoNoise.noise(8));
+        rgb[2] = clamp8(128 + 80 * std::cos(9.0 * u * v + 1.0) + photoNoise.noise(8));
+    }));
+
+    // A page of text scanned at 300 dpi: dark words on noisy paper
+    if (!quick) {
+        Random scanNoise;
+        images.push_back(synthetic("synthetic-scan", 2480, 3508, [&](int x, int y, guint8 *rgb) {
+            int line = (y - 200) / 60, lineY = (y - 200) % 60;
+            int word = (x - 200) / 90, wordX = (x - 200) % 90;
+            bool ink = y >= 200 && y < 3300 && x >= 200 && x < 2280 && lineY >= 20 && lineY < 44 &&
+                       wordX < 60 + (line * 7 + word * 13) % 25 && (wordX / 6 + lineY / 4 + line + word) % 5 != 0;
+            double paper = 235 + scanNoise.noise(10);
+            rgb[0] = rgb[1] = rgb[2] = clamp8(ink ? 40 + scanNoise.noise(20) : paper);
+        }));
+    }
+
+    return images;
+}
+
+/**
+ * Set a preference for as long as this lives, then put back the value it
+ * had, so that running the benchmark leaves the user's profile alone.
+ */
+class TemporaryPreference
+{
+public:
+    TemporaryPreference(Glib::ustring path, int value)
+        : _path(std::move(path))
+    {
+        auto prefs = Inkscape::Preferences::get();
+        auto entry = prefs->getEntry(_path);
+        _was_set = entry.isValid();
+        _old_value = entry.getString();
+        prefs->setInt(_path, value);
+    }
+
+    ~TemporaryPreference()
+    {
+        auto prefs = Inkscape::Preferences::get();
+        if (_was_set) {
+            prefs->setString(_path, _old_value);
+        } else {
+            prefs->remove(_path);
+        }
+    }
+
+    TemporaryPreference(TemporaryPreference const &) = delete;
+    TemporaryPreference &operator=(TemporaryPreference const &) = delete;
+
+private:
+    Glib::ustring _path;
+    Glib::ustring _old_value;
+    bool _was_set;
+};
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::string output;
+    int repeat = 3;
+    int threads = 0;
+    bool quick = false;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--output" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--quick") {
+            quick = true;
+        } else if (arg.compare(0, 2, "--") == 0) {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--output FILE] [--repeat N] [--threads N] [--quick] [IMAGE...]" << std::endl;
+            return 1;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    // setup hidden dependencies
+    Inkscape::Application::create(false);
+    Gdk::wrap_init();
+    Inkscape::Debug::Logger::init();
+
+    // Make the thread count explicit, so that it can be reported
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    TemporaryPreference numthreads("/options/threading/numthreads", threads);
+
+    Benchmark benchmark(repeat);
+    for (auto const &file : files) {
+        Image image;
+        image.name = Glib::path_get_basename(file);
+        auto start = std::chrono::steady_clock::now();
+        try {
+            image.pixbuf = Gdk::Pixbuf::create_from_file(file);
+        } catch (Glib::Error const &e) {
+            std::cerr << file << ": " << e.what() << std::endl;
+            continue;
+        }
+        // The tracers expect RGBA pixels
+        image.pixbuf = image.pixbuf->add_alpha(false, 0, 0, 0);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        image.decodeMs = elapsed.count();
+        benchmark.run(image);
+    }
+    for (auto const &image : syntheticImages(quick)) {
+        benchmark.run(image);
+    }
+
+    if (output.empty()) {
+        benchmark.write(std::cout, threads);
+    } else {
+        std::ofstream out(output);
+        benchmark.write(out, threads);
+        if (!out) {
+            std::cerr << "Could not write " << output << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
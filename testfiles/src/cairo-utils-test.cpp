@@ -10,6 +10,7 @@
  */
 
 #include <gtest/gtest.h>
+#include <vector>
 #include <src/display/cairo-utils.h>
 #include <src/inkscape.h>
 
@@ -48,4 +49,23 @@ TEST_F(PixbufTest, creatingFromSvgUriWithoutViewboxOrWidthAndHeightReturnsNull)
     double default_dpi = 96.0;
 
     ASSERT_EQ(Inkscape::Pixbuf::create_from_data_uri(uri_data.c_str(), default_dpi), nullptr);
-}
\ No newline at end of file
+}
+
+TEST(CairoUtilsTest, convertingPixelsToPixbufMatchesConvertingEachPixel)
+{
+    // Every alpha with every channel value, in each channel
+    int const w = 256, h = 256;
+    std::vector<guint32> pixels;
+    for (guint32 a = 0; a < 256; a++) {
+        for (guint32 c = 0; c < 256; c++) {
+            pixels.push_back((a << 24) | (c << 16) | ((255 - c) << 8) | ((c * 7) & 0xff));
+        }
+    }
+
+    std::vector<guint32> converted = pixels;
+    convert_pixels_argb32_to_pixbuf(reinterpret_cast<guchar *>(converted.data()), w, h, w * 4);
+
+    for (size_t i = 0; i < pixels.size(); i++) {
+        ASSERT_EQ(converted[i], pixbuf_from_argb32(pixels[i])) << "pixel " << std::hex << pixels[i];
+    }
+}
@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/** @file
+ * Drawing rendering tests
+ *//*
+ * Authors: see git history
+ *
+ * Copyright (C) 2020 Authors
+ * Released under GNU GPL v2+, read the file 'COPYING' for more information.
+ */
+
+#include <gtest/gtest.h>
+#include <doc-per-case-test.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include "display/cairo-utils.h"
+#include "helper/pixbuf-ops.h"
+#include "preferences.h"
+
+class DrawingTest : public DocPerCaseTest
+{
+public:
+    DrawingTest()
+    {
+        // A gradient, a pattern, a blur, a clip and text, all across tile boundaries
+        char const *docString = "\
+<svg xmlns='http://www.w3.org/2000/svg' width='600' height='500'>\
+<defs>\
+<linearGradient id='grad'><stop offset='0' stop-color='#f00'/><stop offset='1' stop-color='#00f'/></linearGradient>\
+<radialGradient id='rgrad'><stop offset='0' stop-color='#ff0'/><stop offset='1' stop-color='#0f0' stop-opacity='0.3'/></radialGradient>\
+<pattern id='pat' width='20' height='20' patternUnits='userSpaceOnUse'><circle cx='10' cy='10' r='7' fill='#080'/></pattern>\
+<filter id='blur'><feGaussianBlur stdDeviation='2'/></filter>\
+<clipPath id='clip'><circle cx='420' cy='300' r='150'/></clipPath>\
+</defs>\
+<rect x='10' y='10' width='580' height='200' fill='url(#grad)' stroke='#000' stroke-width='3'/>\
+<ellipse cx='300' cy='330' rx='280' ry='150' fill='url(#rgrad)' opacity='0.7'/>\
+<rect x='30' y='230' width='300' height='250' fill='url(#pat)'/>\
+<circle cx='250' cy='256' r='100' fill='#c0c' filter='url(#blur)'/>\
+<rect x='260' y='150' width='330' height='340' fill='#048' clip-path='url(#clip)'/>\
+<text x='20' y='270' font-size='60' fill='#fff' stroke='#000'>Tiles</text>\
+</svg>";
+        doc.reset(SPDocument::createNewDocFromMem(docString, static_cast<int>(strlen(docString)), false));
+    }
+
+    ~DrawingTest() override = default;
+
+    std::unique_ptr<Inkscape::Pixbuf> render(int threads)
+    {
+        Inkscape::Preferences::get()->setInt("/options/threading/numthreads", threads);
+        return std::unique_ptr<Inkscape::Pixbuf>(
+            sp_generate_internal_bitmap(doc.get(), nullptr, 0, 0, 600, 500, 600, 500, 96, 96, 0));
+    }
+
+    std::unique_ptr<SPDocument> doc;
+};
+
+/**
+ * Rendering in tiles on several threads gives the pixels of rendering on one.
+ */
+TEST_F(DrawingTest, tiledRenderMatchesRender)
+{
+    ASSERT_TRUE(doc != nullptr);
+
+    auto single = render(1);
+    auto tiled = render(4);
+    ASSERT_TRUE(single && tiled);
+
+    cairo_surface_t *a = single->getSurfaceRaw();
+    cairo_surface_t *b = tiled->getSurfaceRaw();
+    ASSERT_EQ(cairo_image_surface_get_width(a), cairo_image_surface_get_width(b));
+    ASSERT_EQ(cairo_image_surface_get_height(a), cairo_image_surface_get_height(b));
+    ASSERT_EQ(cairo_image_surface_get_stride(a), cairo_image_surface_get_stride(b));
+
+    int stride = cairo_image_surface_get_stride(a);
+    int height = cairo_image_surface_get_height(a);
+    unsigned char const *pa = cairo_image_surface_get_data(a);
+    unsigned char const *pb = cairo_image_surface_get_data(b);
+
+    // the blur is computed per tile, so allow for rounding at the seams
+    int worst = 0;
+    bool painted = false;
+    for (int i = 0; i < stride * height; i++) {
+        worst = std::max(worst, std::abs(pa[i] - pb[i]));
+        painted |= pa[i] != 0;
+    }
+    EXPECT_TRUE(painted);
+    EXPECT_LE(worst, 1);
+}
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4 :
@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/** @file
+ * Autotrace tracing engine tests
+ *//*
+ * Authors: see git history
+ *
+ * Copyright (C) 2020 Authors
+ * Released under GNU GPL v2+, read the file 'COPYING' for more information.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <gdkmm/wrap_init.h>
+
+#include "inkscape.h"
+#include "preferences.h"
+#include "trace/autotrace/inkscape-autotrace.h"
+
+using Inkscape::Trace::TracingEngineResult;
+using Inkscape::Trace::Autotrace::AutotraceTracingEngine;
+
+static long countOf(std::string const &d, char a, char b)
+{
+    return std::count_if(d.begin(), d.end(), [=](char c) { return c == a || c == b; });
+}
+
+/**
+ * Every color gets one closed path of its own, in the same order and
+ * with the same data whatever the number of fitting threads.
+ */
+TEST(AutotraceTest, tracesEveryColorRegionIndependentlyOfThreadCount)
+{
+    // setup hidden dependencies
+    Inkscape::Application::create(false);
+    Gdk::wrap_init();
+
+    // A red and a blue disc on white
+    auto pixbuf = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, true, 8, 80, 40);
+    for (int y = 0; y < pixbuf->get_height(); y++) {
+        guint8 *p = pixbuf->get_pixels() + y * pixbuf->get_rowstride();
+        for (int x = 0; x < pixbuf->get_width(); x++) {
+            int cx = x < 40 ? 20 : 60;
+            int r2 = (x - cx) * (x - cx) + (y - 20) * (y - 20);
+            bool inside = r2 < 15 * 15;
+            p[4 * x] = inside && x >= 40 ? 0 : 255;
+            p[4 * x + 1] = inside ? 0 : 255;
+            p[4 * x + 2] = inside && x < 40 ? 0 : 255;
+            p[4 * x + 3] = 255;
+        }
+    }
+
+    auto prefs = Inkscape::Preferences::get();
+    std::vector<std::vector<TracingEngineResult>> traces;
+    for (int threads : {1, 4}) {
+        prefs->setInt("/options/threading/numthreads", threads);
+        AutotraceTracingEngine engine;
+        traces.push_back(engine.trace(pixbuf));
+    }
+
+    auto const &results = traces[0];
+    ASSERT_EQ(results.size(), 2u);
+    EXPECT_NE(results[0].getStyle(), results[1].getStyle());
+    for (auto const &result : results) {
+        auto const &d = result.getPathData();
+        EXPECT_EQ(result.getStyle().rfind("fill:#", 0), 0u);
+        EXPECT_EQ(countOf(d, 'M', 'm'), 1);
+        EXPECT_EQ(countOf(d, 'Z', 'z'), 1);
+    }
+
+    ASSERT_EQ(traces[1].size(), results.size());
+    for (size_t i = 0; i < results.size(); i++) {
+        EXPECT_EQ(traces[1][i].getStyle(), results[i].getStyle());
+        EXPECT_EQ(traces[1][i].getPathData(), results[i].getPathData());
+        EXPECT_EQ(traces[1][i].getNodeCount(), results[i].getNodeCount());
+    }
+}
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4 :
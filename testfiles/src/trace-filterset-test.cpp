@@ -0,0 +1,113 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/** @file
+ * Trace filter tests
+ *//*
+ * Authors: see git history
+ *
+ * Copyright (C) 2020 Authors
+ * Released under GNU GPL v2+, read the file 'COPYING' for more information.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+
+#include "trace/filterset.h"
+#include "trace/imagemap.h"
+
+static int const gaussMatrix[5][5] = {
+    {2, 4, 5, 4, 2},
+    {4, 9, 12, 9, 4},
+    {5, 12, 15, 12, 5},
+    {4, 9, 12, 9, 4},
+    {2, 4, 5, 4, 2},
+};
+
+/**
+ * The plain 5x5 convolution of one pixel, borders left untouched.
+ */
+template <typename Get>
+static int gaussPixel(int width, int height, int x, int y, int value, Get get)
+{
+    if (x < 2 || x > width - 3 || y < 2 || y > height - 3) {
+        return value;
+    }
+    int sum = 0;
+    for (int i = 0; i < 5; i++) {
+        for (int j = 0; j < 5; j++) {
+            sum += gaussMatrix[i][j] * get(x + j - 2, y + i - 2);
+        }
+    }
+    return sum / 159;
+}
+
+static std::unique_ptr<GrayMap> noisyGrayMap(int width, int height)
+{
+    auto map = GrayMapCreate(width, height);
+    srand(1);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            map->setPixel(x, y, (x * 37 + y * 11 + rand() % 200) % (GRAYMAP_WHITE + 1));
+        }
+    }
+    return map;
+}
+
+TEST(TraceFiltersetTest, grayGaussianMatchesConvolution)
+{
+    for (int size : {1, 4, 5, 6, 33}) {
+        auto map = noisyGrayMap(size + 7, size);
+        auto smooth = grayMapGaussian(*map, 4);
+        ASSERT_TRUE(smooth);
+        for (int y = 0; y < map->height(); y++) {
+            for (int x = 0; x < map->width(); x++) {
+                int expected = gaussPixel(map->width(), map->height(), x, y, map->getPixel(x, y),
+                                          [&](int i, int j) { return map->getPixel(i, j); });
+                ASSERT_EQ(smooth->getPixel(x, y), expected) << "at " << x << "," << y;
+            }
+        }
+    }
+}
+
+TEST(TraceFiltersetTest, rgbGaussianMatchesConvolution)
+{
+    auto map = RgbMapCreate(41, 29);
+    srand(2);
+    for (int y = 0; y < map->height(); y++) {
+        for (int x = 0; x < map->width(); x++) {
+            map->setPixel(x, y, {(unsigned char)rand(), (unsigned char)(x * 5 + y), (unsigned char)(rand() % 40)});
+        }
+    }
+
+    auto smooth = rgbMapGaussian(*map, 4);
+    ASSERT_TRUE(smooth);
+    int w = map->width(), h = map->height();
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            RGB in = map->getPixel(x, y);
+            RGB out = smooth->getPixel(x, y);
+            EXPECT_EQ(out.r, gaussPixel(w, h, x, y, in.r, [&](int i, int j) { return map->getPixel(i, j).r; }));
+            EXPECT_EQ(out.g, gaussPixel(w, h, x, y, in.g, [&](int i, int j) { return map->getPixel(i, j).g; }));
+            EXPECT_EQ(out.b, gaussPixel(w, h, x, y, in.b, [&](int i, int j) { return map->getPixel(i, j).b; }));
+        }
+    }
+}
+
+TEST(TraceFiltersetTest, cannyFindsTheEdgesOfASquare)
+{
+    auto map = GrayMapCreate(20, 20);
+    map->fill(GRAYMAP_WHITE);
+    for (int y = 5; y < 15; y++) {
+        for (int x = 5; x < 15; x++) {
+            map->setPixel(x, y, GRAYMAP_BLACK);
+        }
+    }
+
+    auto edges = grayMapCanny(*map, 0.1, 0.4, 4);
+    ASSERT_TRUE(edges);
+    // edges are black, everything else white
+    EXPECT_EQ(edges->getPixel(5, 10), GRAYMAP_BLACK);
+    EXPECT_EQ(edges->getPixel(10, 5), GRAYMAP_BLACK);
+    EXPECT_EQ(edges->getPixel(10, 10), GRAYMAP_WHITE);
+    EXPECT_EQ(edges->getPixel(1, 1), GRAYMAP_WHITE);
+}
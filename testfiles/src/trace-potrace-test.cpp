@@ -0,0 +1,294 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/** @file
+ * Potrace tracing engine tests
+ *//*
+ * Authors: see git history
+ *
+ * Copyright (C) 2020 Authors
+ * Released under GNU GPL v2+, read the file 'COPYING' for more information.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <gdkmm/wrap_init.h>
+
+#include "inkscape.h"
+#include "trace/imagemap-gdk.h"
+#include "trace/imagemap.h"
+#include "trace/potrace/inkscape-potrace.h"
+
+using Inkscape::Trace::TracingEngineResult;
+using Inkscape::Trace::Potrace::PotraceTracingEngine;
+
+class PotraceTest : public ::testing::Test {
+  protected:
+    void SetUp() override
+    {
+        // no GUI to keep responsive here
+        engine.potraceParams->progress.callback = nullptr;
+    }
+
+    /**
+     * A white map with a grid of isolated 2x2 black squares, each of
+     * which traces to its own subpath.
+     */
+    static std::unique_ptr<GrayMap> dotGrid(int dotsX, int dotsY)
+    {
+        auto map = GrayMapCreate(3 * dotsX, 3 * dotsY);
+        map->fill(GRAYMAP_WHITE);
+        for (int y = 0; y < map->height(); y++) {
+            for (int x = 0; x < map->width(); x++) {
+                if (x % 3 < 2 && y % 3 < 2) {
+                    map->setPixel(x, y, GRAYMAP_BLACK);
+                }
+            }
+        }
+        return map;
+    }
+
+    static long countSubpaths(std::string const &d)
+    {
+        return std::count_if(d.begin(), d.end(), [](char c) { return c == 'M' || c == 'm'; });
+    }
+
+    /**
+     * Three vertical bands: black, gray and white.
+     */
+    static Glib::RefPtr<Gdk::Pixbuf> threeBands()
+    {
+        // setup hidden dependencies
+        Inkscape::Application::create(false);
+        Gdk::wrap_init();
+
+        auto pixbuf = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, false, 8, 30, 10);
+        for (int y = 0; y < pixbuf->get_height(); y++) {
+            guint8 *p = pixbuf->get_pixels() + y * pixbuf->get_rowstride();
+            for (int x = 0; x < pixbuf->get_width(); x++) {
+                guint8 v = x < 10 ? 0 : x < 20 ? 128 : 255;
+                p[3 * x] = p[3 * x + 1] = p[3 * x + 2] = v;
+            }
+        }
+        return pixbuf;
+    }
+
+    /**
+     * Overlapping discs of several colors on a white background.
+     */
+    static Glib::RefPtr<Gdk::Pixbuf> colorDiscs()
+    {
+        // setup hidden dependencies
+        Inkscape::Application::create(false);
+        Gdk::wrap_init();
+
+        struct Disc { int cx, cy, r; guint8 rgb[3]; };
+        Disc const discs[] = {
+            {20, 20, 15, {200, 0, 0}},
+            {45, 22, 14, {0, 160, 0}},
+            {30, 40, 12, {0, 0, 220}},
+            {55, 45, 10, {230, 200, 0}},
+            {12, 50, 8, {120, 0, 140}},
+        };
+
+        auto pixbuf = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, false, 8, 70, 60);
+        for (int y = 0; y < pixbuf->get_height(); y++) {
+            guint8 *p = pixbuf->get_pixels() + y * pixbuf->get_rowstride();
+            for (int x = 0; x < pixbuf->get_width(); x++) {
+                guint8 const *rgb = nullptr;
+                for (auto const &disc : discs) {
+                    if ((x - disc.cx) * (x - disc.cx) + (y - disc.cy) * (y - disc.cy) < disc.r * disc.r) {
+                        rgb = disc.rgb;
+                    }
+                }
+                for (int c = 0; c < 3; c++) {
+                    p[3 * x + c] = rgb ? rgb[c] : 255;
+                }
+            }
+        }
+        return pixbuf;
+    }
+
+    static void expectSameResults(std::vector<TracingEngineResult> const &a,
+                                  std::vector<TracingEngineResult> const &b)
+    {
+        ASSERT_EQ(a.size(), b.size());
+        for (size_t i = 0; i < a.size(); i++) {
+            EXPECT_EQ(a[i].getStyle(), b[i].getStyle());
+            EXPECT_EQ(a[i].getPathData(), b[i].getPathData());
+            EXPECT_EQ(a[i].getNodeCount(), b[i].getNodeCount());
+        }
+    }
+
+    PotraceTracingEngine engine;
+};
+
+TEST_F(PotraceTest, tracesEverySubpathOfADotGrid)
+{
+    auto map = dotGrid(20, 10);
+    auto results = engine.traceGrayMap(*map);
+    ASSERT_EQ(results.size(), 1u);
+    EXPECT_EQ(countSubpaths(results[0].getPathData()), 200);
+}
+
+/**
+ * The layers handed to a sink are the ones trace() returns, in the same
+ * order, and removing the background drops the last one of them.
+ */
+TEST_F(PotraceTest, streamsTheLayersOfAMultiScan)
+{
+    auto pixbuf = threeBands();
+
+    PotraceTracingEngine quant(Inkscape::Trace::Potrace::TRACE_QUANT_COLOR, false, 8, 0.45, 0.0, 0.65, 3, false,
+                               false, false);
+    quant.potraceParams->progress.callback = nullptr;
+
+    std::vector<TracingEngineResult> streamed;
+    quant.traceTo(pixbuf, [&](TracingEngineResult &&result) { streamed.push_back(std::move(result)); });
+    auto results = quant.trace(pixbuf);
+
+    ASSERT_GT(results.size(), 1u);
+    ASSERT_EQ(streamed.size(), results.size());
+    for (size_t i = 0; i < results.size(); i++) {
+        EXPECT_EQ(streamed[i].getStyle(), results[i].getStyle());
+        EXPECT_EQ(streamed[i].getPathData(), results[i].getPathData());
+    }
+
+    quant.multiScanRemoveBackground = true;
+    auto withoutBackground = quant.trace(pixbuf);
+    ASSERT_EQ(withoutBackground.size(), results.size() - 1);
+    for (size_t i = 0; i < withoutBackground.size(); i++) {
+        EXPECT_EQ(withoutBackground[i].getPathData(), results[i].getPathData());
+    }
+}
+
+/**
+ * Tracing the same pixbuf again, while the stage cache is held, reuses
+ * its quantization and gives the same paths; a copy of its pixels is
+ * another image.
+ */
+TEST_F(PotraceTest, retracingTheSamePixbufReusesItsStages)
+{
+    auto pixbuf = threeBands();
+
+    auto hold = PotraceTracingEngine::holdStageCache();
+    PotraceTracingEngine::clearStageCache();
+
+    PotraceTracingEngine quant(Inkscape::Trace::Potrace::TRACE_QUANT_COLOR, false, 8, 0.45, 0.0, 0.65, 3, false,
+                               false, false);
+    quant.potraceParams->progress.callback = nullptr;
+
+    auto first = quant.trace(pixbuf);
+    ASSERT_GT(first.size(), 1u);
+    EXPECT_EQ(PotraceTracingEngine::stageCacheSize(), 1u);
+
+    auto second = quant.trace(pixbuf);
+    EXPECT_EQ(PotraceTracingEngine::stageCacheSize(), 1u);
+    expectSameResults(second, first);
+
+    auto copy = quant.trace(pixbuf->copy());
+    EXPECT_EQ(PotraceTracingEngine::stageCacheSize(), 2u);
+    expectSameResults(copy, first);
+}
+
+/**
+ * The layers and scans of a multi-color image are traced concurrently,
+ * but the paths do not depend on the number of threads.
+ */
+TEST_F(PotraceTest, tracesTheSamePathsOnAnyNumberOfThreads)
+{
+    using namespace Inkscape::Trace::Potrace;
+    auto pixbuf = colorDiscs();
+
+    for (auto type : {TRACE_QUANT_COLOR, TRACE_QUANT_MONO, TRACE_BRIGHTNESS_MULTI}) {
+        std::vector<std::vector<TracingEngineResult>> traces;
+        for (int threads : {1, 4}) {
+            PotraceTracingEngine multi(type, false, 8, 0.45, 0.0, 0.65, 6, true, false, false);
+            multi.potraceParams->progress.callback = nullptr;
+            multi.threads = threads;
+            traces.push_back(multi.trace(pixbuf));
+        }
+        ASSERT_GT(traces[0].size(), 1u) << "trace type " << type;
+        expectSameResults(traces[1], traces[0]);
+    }
+}
+
+/**
+ * A scan whose pixels are all specks has no path, so the floor of the
+ * next scans is not its threshold, as the pixel counts predict: those
+ * scans are traced again.  The paths are the ones of a serial scan that
+ * moves the floor up only past the scans that have a path.
+ */
+TEST_F(PotraceTest, retracesTheScansAboveAScanWithoutPath)
+{
+    using namespace Inkscape::Trace::Potrace;
+
+    // setup hidden dependencies
+    Inkscape::Application::create(false);
+    Gdk::wrap_init();
+
+    // A dark square, and a mid gray one with single pixels of a darker
+    // gray along its left side: alone they are too small for a path,
+    // with the square they notch its outline.  No gray lies in between.
+    auto pixbuf = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, true, 8, 60, 40);
+    for (int y = 0; y < pixbuf->get_height(); y++) {
+        guint8 *p = pixbuf->get_pixels() + y * pixbuf->get_rowstride();
+        for (int x = 0; x < pixbuf->get_width(); x++) {
+            guint8 v = 255;
+            if (x >= 5 && x < 20 && y >= 10 && y < 30) {
+                v = 20;
+            } else if (x >= 31 && x < 50 && y >= 8 && y < 32) {
+                v = 115;
+            } else if (x == 30 && y >= 10 && y < 30 && y % 3 == 0) {
+                v = 64;
+            }
+            p[4 * x] = p[4 * x + 1] = p[4 * x + 2] = v;
+            p[4 * x + 3] = 255;
+        }
+    }
+
+    int const nrScans = 7;
+    std::vector<std::string> expected;
+    {
+        auto gray = gdkPixbufToGrayMap(pixbuf->gobj());
+        auto scan = GrayMapCreate(gray->width(), gray->height());
+        double low = 0.2, high = 0.9, delta = (high - low) / nrScans;
+        double floor = 0.0;
+        for (double threshold = low; threshold <= high; threshold += delta) {
+            for (int y = 0; y < gray->height(); y++) {
+                for (int x = 0; x < gray->width(); x++) {
+                    double brightness = gray->getPixel(x, y);
+                    bool black = brightness >= 3.0 * (floor * 256.0) && brightness < 3.0 * (threshold * 256.0);
+                    scan->setPixel(x, y, black ? GRAYMAP_BLACK : GRAYMAP_WHITE);
+                }
+            }
+            auto d = engine.traceGrayMap(*scan)[0].getPathData();
+            if (!d.empty()) {
+                expected.push_back(d);
+                floor = threshold;
+            }
+        }
+    }
+    ASSERT_EQ(expected.size(), 2u);
+
+    for (int threads : {1, 4}) {
+        PotraceTracingEngine multi(TRACE_BRIGHTNESS_MULTI, false, 8, 0.45, 0.0, 0.65, nrScans, false, false, false);
+        multi.potraceParams->progress.callback = nullptr;
+        multi.threads = threads;
+        auto results = multi.trace(pixbuf);
+        ASSERT_EQ(results.size(), expected.size());
+        for (size_t i = 0; i < results.size(); i++) {
+            EXPECT_EQ(results[i].getPathData(), expected[i]) << "scan " << i << " on " << threads << " threads";
+        }
+    }
+}
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4 :
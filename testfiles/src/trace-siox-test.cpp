@@ -0,0 +1,154 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/** @file
+ * SIOX foreground extraction and masking tests
+ *//*
+ * Authors: see git history
+ *
+ * Copyright (C) 2020 Authors
+ * Released under GNU GPL v2+, read the file 'COPYING' for more information.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "document.h"
+#include "inkscape.h"
+#include "object/sp-image.h"
+#include "object/sp-shape.h"
+#include "trace/siox.h"
+#include "trace/trace.h"
+
+using org::siox::Siox;
+using org::siox::SioxImage;
+
+/**
+ * A noisy red disc on a noisy blue gradient.  The middle of the disc is
+ * certainly foreground, the border of the image certainly background,
+ * and the rest is left to SIOX.
+ */
+static SioxImage discOnGradient()
+{
+    int const width = 48, height = 40;
+    SioxImage image(width, height);
+    srand(3);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int dx = x - 24, dy = y - 20;
+            int r2 = dx * dx + dy * dy;
+            int noise = rand() % 24;
+            if (r2 < 12 * 12) {
+                image.setPixel(x, y, 255, 200 + noise, 30 + noise, 20);
+            } else {
+                image.setPixel(x, y, 255, 20, 60 + 2 * y + noise, 160 + noise);
+            }
+
+            float conf = Siox::UNKNOWN_REGION_CONFIDENCE;
+            if (r2 < 5 * 5) {
+                conf = Siox::CERTAIN_FOREGROUND_CONFIDENCE;
+            } else if (x < 4 || y < 4 || x >= width - 4 || y >= height - 4) {
+                conf = Siox::CERTAIN_BACKGROUND_CONFIDENCE;
+            }
+            image.setConfidence(x, y, conf);
+        }
+    }
+    return image;
+}
+
+TEST(TraceSioxTest, extractsTheSameForegroundOnAnyNumberOfThreads)
+{
+    SioxImage const image = discOnGradient();
+
+    std::vector<SioxImage> results;
+    for (int threads : {1, 4}) {
+        Siox siox;
+        siox.setThreadCount(threads);
+        results.push_back(siox.extractForeground(image, 0xffffff));
+        ASSERT_TRUE(results.back().isValid()) << threads << " threads";
+    }
+
+    auto &serial = results[0];
+    auto &parallel = results[1];
+    int width = serial.getWidth(), height = serial.getHeight();
+    ASSERT_EQ(parallel.getWidth(), width);
+    ASSERT_EQ(parallel.getHeight(), height);
+
+    // The disc is found, and the certain background stays background
+    EXPECT_GT(serial.getConfidence(24, 20), Siox::UNKNOWN_REGION_CONFIDENCE);
+    EXPECT_LT(serial.getConfidence(0, 0), Siox::UNKNOWN_REGION_CONFIDENCE);
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            ASSERT_EQ(parallel.getConfidence(x, y), serial.getConfidence(x, y)) << "at " << x << "," << y;
+            ASSERT_EQ(parallel.getPixel(x, y), serial.getPixel(x, y)) << "at " << x << "," << y;
+        }
+    }
+}
+
+/**
+ * The mask of the shapes over an image covers the pixels whose center
+ * lies in a shape, as a pick at every pixel center used to, and the
+ * pixels that the edge of a shape only crosses.  Nothing else.
+ */
+TEST(TraceSioxTest, masksThePixelsTheShapesCover)
+{
+    if (!Inkscape::Application::exists()) {
+        Inkscape::Application::create(false);
+    }
+
+    // Pixels of the 30x20 image are 2x2 user units; the disc is centered
+    // on pixel (17, 11) with a radius of 6 pixels.
+    char const *docString = "\
+<svg xmlns='http://www.w3.org/2000/svg' width='100' height='80'>\
+<image id='image' x='10' y='10' width='60' height='40'/>\
+<g transform='translate(4,2)'><circle id='disc' cx='40' cy='30' r='12'/></g>\
+</svg>";
+    std::unique_ptr<SPDocument> doc(
+        SPDocument::createNewDocFromMem(docString, static_cast<int>(strlen(docString)), false));
+    ASSERT_TRUE(doc);
+    doc->ensureUpToDate();
+
+    auto image = dynamic_cast<SPImage *>(doc->getObjectById("image"));
+    auto disc = dynamic_cast<SPShape *>(doc->getObjectById("disc"));
+    ASSERT_TRUE(image);
+    ASSERT_TRUE(disc);
+
+    SioxImage simage(30, 20);
+    ASSERT_TRUE(Inkscape::Trace::Tracer::sioxMask(image, {disc}, simage));
+
+    int inside = 0, masked = 0;
+    for (int row = 0; row < 20; row++) {
+        for (int col = 0; col < 30; col++) {
+            double distance = std::hypot(col + 0.5 - 17.0, row + 0.5 - 11.0);
+            float conf = simage.getConfidence(col, row);
+            if (distance < 6.0) {
+                inside++;
+                EXPECT_EQ(conf, Siox::UNKNOWN_REGION_CONFIDENCE) << "at " << col << "," << row;
+            } else if (distance > 6.0 + M_SQRT1_2) {
+                EXPECT_EQ(conf, Siox::CERTAIN_BACKGROUND_CONFIDENCE) << "at " << col << "," << row;
+            }
+            if (conf == Siox::UNKNOWN_REGION_CONFIDENCE) {
+                masked++;
+            }
+        }
+    }
+
+    // Only the pixels along the edge are added
+    EXPECT_GE(masked, inside);
+    EXPECT_LT(masked - inside, 2 * M_PI * 6.0 * 1.5);
+}
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4 :